@@ -0,0 +1,503 @@
+// Measures the parsers of GeneratorCPP on synthetic GeoNames files, so regressions can be found without the real dumps.
+//
+// Build and run from GeneratorCPP/Benchmarks, with nlohmann/json, argparse and zlib on the include path:
+//      g++ -std=c++20 -O2 -I.. GeneratorBenchmark.cpp -o GeneratorBenchmark -lz
+//      ./GeneratorBenchmark --cities 200000 --output results.json --label "$(git rev-parse --short HEAD)"
+//      ./GeneratorBenchmark --cities 200000 --compare results.json
+//
+// The fixture is written to --fixture (a temporary folder by default) and reused when it already holds the same size.
+// Every benchmark runs --repetitions times and the fastest run is reported with its throughput in lines/s and MB/s.
+// The query benchmarks and the compressed sizes compare the binary dataset written in every --order of GeneratorCPP.
+// On Linux the peak RSS is reset before each benchmark, elsewhere it is the peak of the process so far.
+
+#define GENERATORCPP_NO_MAIN
+#include "GeneratorCPP.cpp"
+
+#include <argparse/argparse.hpp>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <sstream>
+
+namespace
+{
+    constexpr std::array<const char *, 12> FIXTURE_COUNTRIES = {"US", "FR", "JP", "CN", "DE", "BR", "IN", "RU", "ES", "GB", "MX", "ZA"};
+    constexpr std::array<const char *, 10> FIXTURE_LANGUAGES = {"en", "fr", "ja", "zh", "ru", "es", "de", "ar", "hi", "pt"};
+    constexpr std::size_t FIXTURE_ADMIN1_PER_COUNTRY = 40;
+    // alternateNames.txt is much larger than the cities file, most of its names belong to places that are not cities
+    constexpr std::size_t FIXTURE_NAMES_PER_CITY = 24;
+
+    struct FixtureFiles
+    {
+        std::string folder;
+        std::string cities;
+        std::string alternateNames;
+        std::string admin1CodesASCII;
+        std::string localizedCountries;
+    };
+
+    FixtureFiles fixtureFiles(std::string folder)
+    {
+        if (!folder.ends_with('/') && !folder.ends_with('\\'))
+        {
+            folder += '/';
+        }
+        return {folder, folder + "cities15000.txt", folder + "alternateNames.txt", folder + "admin1CodesASCII.txt", folder + "localized-countries/"};
+    }
+
+    // Writes files with the columns GeneratorCPP reads, the same number of columns as the GeoNames dumps
+    // and a mix of preferred, duplicate, unselected and malformed names
+    void writeFixture(const FixtureFiles &files, const std::size_t cityCount, const std::uint32_t seed)
+    {
+        std::mt19937 random = std::mt19937(seed);
+        const auto pick = [&](const auto &values)
+        {
+            return values[random() % values.size()];
+        };
+        const auto word = [&](const std::size_t minimum, const std::size_t maximum)
+        {
+            std::string value = std::string(minimum + random() % (maximum - minimum + 1), 'a');
+            for (auto &c : value)
+            {
+                c = static_cast<char>('a' + random() % 26);
+            }
+            value[0] = static_cast<char>(value[0] - 'a' + 'A');
+            return value;
+        };
+        std::filesystem::create_directories(files.localizedCountries);
+
+        for (const auto *language : FIXTURE_LANGUAGES)
+        {
+            nlohmann::json names = nlohmann::json::object();
+            for (const auto *country : FIXTURE_COUNTRIES)
+            {
+                names[country] = word(4, 16) + " (" + language + ")";
+            }
+            std::ofstream(files.localizedCountries + language + ".json") << names.dump();
+        }
+
+        GeoNameId nextGeoNameId = 1;
+        std::vector<GeoNameId> placeIds = {};
+        {
+            std::ofstream admin1 = std::ofstream(files.admin1CodesASCII, std::ios::binary);
+            for (const auto *country : FIXTURE_COUNTRIES)
+            {
+                for (std::size_t a = 1; a <= FIXTURE_ADMIN1_PER_COUNTRY; a++)
+                {
+                    const auto name = word(4, 20);
+                    admin1 << country << '.' << std::setw(2) << std::setfill('0') << a << '\t' << name << '\t' << name << '\t' << nextGeoNameId << '\n';
+                    placeIds.push_back(nextGeoNameId++);
+                }
+            }
+        }
+        {
+            std::ofstream cities = std::ofstream(files.cities, std::ios::binary);
+            std::uniform_real_distribution<double> latitude = std::uniform_real_distribution<double>(-60, 75);
+            std::uniform_real_distribution<double> longitude = std::uniform_real_distribution<double>(-180, 180);
+            for (std::size_t i = 0; i < cityCount; i++)
+            {
+                const auto name = word(3, 24);
+                std::string alternates = {};
+                for (std::size_t n = random() % 12; n > 0; n--)
+                {
+                    alternates += (alternates.empty() ? "" : ",") + word(3, 16);
+                }
+                cities << nextGeoNameId << '\t' << name << '\t' << name << '\t' << alternates << '\t'
+                       << std::fixed << std::setprecision(5) << latitude(random) << '\t' << longitude(random) << '\t'
+                       << "P\tPPL\t" << pick(FIXTURE_COUNTRIES) << "\t\t" << std::setw(2) << std::setfill('0') << (1 + random() % FIXTURE_ADMIN1_PER_COUNTRY)
+                       << "\t\t\t\t" << (15000 + random() % 1000000) << "\t\t" << random() % 2000 << '\t' << "Europe/Paris\t2024-01-01\n";
+                placeIds.push_back(nextGeoNameId++);
+            }
+        }
+        {
+            std::ofstream alternateNames = std::ofstream(files.alternateNames, std::ios::binary);
+            const std::array<const char *, 6> otherLanguages = {"", "link", "wkdt", "post", "en", "abbr"};
+            const std::size_t lineCount = cityCount * FIXTURE_NAMES_PER_CITY;
+            for (std::size_t i = 1; i <= lineCount; i++)
+            {
+                // Half of the names belong to places that are neither cities nor admin1 regions
+                const GeoNameId geonameid = random() % 2 == 0 ? placeIds[random() % placeIds.size()] : nextGeoNameId + static_cast<GeoNameId>(random() % (4 * cityCount));
+                const char *language = random() % 3 == 0 ? pick(otherLanguages) : pick(FIXTURE_LANGUAGES);
+                alternateNames << i << '\t' << geonameid << '\t' << language << '\t' << word(3, 24);
+                if (random() % 10 == 0)
+                {
+                    // Some lines of the dump stop after isPreferredName
+                    alternateNames << '\t' << (random() % 5 == 0 ? "1" : "") << '\n';
+                    continue;
+                }
+                alternateNames << '\t' << (random() % 5 == 0 ? "1" : "") << '\t' << (random() % 10 == 0 ? "1" : "") << "\t\t\t\t\n";
+            }
+        }
+        std::ofstream(files.folder + "fixture.txt") << cityCount << ' ' << seed << '\n';
+    }
+
+    bool fixtureMatches(const FixtureFiles &files, const std::size_t cityCount, const std::uint32_t seed)
+    {
+        std::ifstream description = std::ifstream(files.folder + "fixture.txt");
+        std::size_t existingCityCount = 0;
+        std::uint32_t existingSeed = 0;
+        return description >> existingCityCount >> existingSeed && existingCityCount == cityCount && existingSeed == seed;
+    }
+
+    // Makes the next peakRssBytes measure only what happens after this call, where the platform allows it
+    // peakRssBytes comes from Instrumentation.hpp
+    void resetPeakRss()
+    {
+#ifdef __linux__
+        std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+    }
+
+    std::size_t countLines(const std::string &path)
+    {
+        MemoryMappedFile file = {};
+        file.open(path);
+        return static_cast<std::size_t>(std::count(file.data(), file.data() + file.size(), '\n'));
+    }
+
+    // GeneratorCPP reports its progress on std::cout, it is silenced while a benchmark runs
+    class SilenceCout
+    {
+        std::streambuf *previous;
+
+    public:
+        SilenceCout() : previous{std::cout.rdbuf(nullptr)} {}
+        ~SilenceCout()
+        {
+            std::cout.rdbuf(previous);
+            std::cout.clear();
+        }
+    };
+
+    struct Result
+    {
+        std::string name;
+        double seconds;
+        std::size_t lines;
+        std::size_t bytes;
+        std::size_t peakRssBytes;
+    };
+
+    // Runs run repetitions times and keeps the fastest, lines and bytes are what one run processes
+    Result measure(const std::string &name, const std::size_t repetitions, const std::size_t lines, const std::size_t bytes, const std::function<void()> &run)
+    {
+        resetPeakRss();
+        double best = std::numeric_limits<double>::infinity();
+        for (std::size_t i = 0; i < repetitions; i++)
+        {
+            const SilenceCout silence = {};
+            const auto start = std::chrono::steady_clock::now();
+            run();
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        return {name, best, lines, bytes, peakRssBytes()};
+    }
+
+    nlohmann::json toJson(const Result &r)
+    {
+        return {
+            {"name", r.name},
+            {"seconds", r.seconds},
+            {"lines", r.lines},
+            {"bytes", r.bytes},
+            {"linesPerSecond", r.lines / r.seconds},
+            {"megabytesPerSecond", r.bytes / r.seconds / 1e6},
+            {"peakRssBytes", r.peakRssBytes},
+        };
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    argparse::ArgumentParser program = argparse::ArgumentParser("GeneratorBenchmark", "0.1");
+    program.add_argument("--cities", "-c")
+        .help("number of cities in the synthetic fixture, alternateNames.txt gets 24 lines per city.")
+        .default_value(100000)
+        .scan<'i', int>();
+    program.add_argument("--seed")
+        .help("seed of the synthetic fixture.")
+        .default_value(1)
+        .scan<'i', int>();
+    program.add_argument("--fixture")
+        .help("folder of the synthetic fixture. Defaults to a folder in the temporary directory.")
+        .default_value(std::string(""));
+    program.add_argument("--languages", "-l")
+        .help("languages selected for parseAlternateNames and parseCities, a comma-seperated list of 639-1 codes.")
+        .default_value(std::string("en,fr,ja"));
+    program.add_argument("--threads", "-t")
+        .help("threads given to the parsers. Defaults to every core.")
+        .default_value(0)
+        .scan<'i', int>();
+    program.add_argument("--repetitions", "-r")
+        .help("runs of every benchmark, the fastest is reported.")
+        .default_value(3)
+        .scan<'i', int>();
+    program.add_argument("--label")
+        .help("label stored with the results, for example the commit.")
+        .default_value(std::string(""));
+    program.add_argument("--output", "-o")
+        .help("path of the JSON results.")
+        .default_value(std::string(""));
+    program.add_argument("--compare")
+        .help("path of earlier JSON results to compare with.")
+        .default_value(std::string(""));
+
+    try
+    {
+        program.parse_args(argc, argv);
+    }
+    catch (const std::runtime_error &err)
+    {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program << '\n';
+        return 1;
+    }
+
+    const int cityCount = program.get<int>("--cities");
+    const int repetitions = program.get<int>("--repetitions");
+    const int threadsArgument = program.get<int>("--threads");
+    if (cityCount <= 0 || repetitions <= 0 || threadsArgument < 0)
+    {
+        std::cerr << "--cities and --repetitions must be positive and --threads must not be negative.\n";
+        return 1;
+    }
+    const std::size_t threadCount = threadsArgument == 0 ? std::max(1u, std::thread::hardware_concurrency()) : static_cast<std::size_t>(threadsArgument);
+    const auto seed = static_cast<std::uint32_t>(program.get<int>("--seed"));
+
+    std::string fixtureArgument = program.get<std::string>("--fixture");
+    if (fixtureArgument.empty())
+    {
+        fixtureArgument = (std::filesystem::temp_directory_path() / "GeneratorBenchmark").string();
+    }
+    const FixtureFiles files = fixtureFiles(fixtureArgument);
+    if (!fixtureMatches(files, static_cast<std::size_t>(cityCount), seed))
+    {
+        std::cout << "Writing a fixture with " << cityCount << " cities to " << std::quoted(files.folder) << "\n";
+        writeFixture(files, static_cast<std::size_t>(cityCount), seed);
+    }
+
+    std::set<ISOLanguage> SELECTED_LANGUAGES = {};
+    for (const auto language : split(program.get<std::string>("--languages"), ','))
+    {
+        SELECTED_LANGUAGES.insert(std::string(language));
+    }
+    const std::set<ISOCountryCode> SELECTED_COUNTRIES = {};
+    const LanguageIds languageIds = LanguageIds(SELECTED_LANGUAGES);
+
+    const std::size_t citiesBytes = std::filesystem::file_size(files.cities);
+    const std::size_t citiesLines = countLines(files.cities);
+    const std::size_t alternateNamesBytes = std::filesystem::file_size(files.alternateNames);
+    const std::size_t alternateNamesLines = countLines(files.alternateNames);
+    const std::size_t admin1Bytes = std::filesystem::file_size(files.admin1CodesASCII);
+    const std::size_t admin1Lines = countLines(files.admin1CodesASCII);
+
+    MemoryMappedFile alternateNamesFile = {};
+    alternateNamesFile.open(files.alternateNames);
+    MemoryMappedFile citiesFile = {};
+    citiesFile.open(files.cities);
+    const auto rep = static_cast<std::size_t>(repetitions);
+    std::vector<Result> results = {};
+
+    std::size_t checksum = 0;
+    results.push_back(measure("split<5>/alternateNames", rep, alternateNamesLines, alternateNamesBytes, [&]()
+    {
+        forEachLine(alternateNamesFile.view(), [&](const std::string_view line)
+        { checksum += split<5>(line, '\t')[3].size(); });
+    }));
+    results.push_back(measure("split<18>/cities", rep, citiesLines, citiesBytes, [&]()
+    {
+        forEachLine(citiesFile.view(), [&](const std::string_view line)
+        { checksum += split<18>(line, '\t')[17].size(); });
+    }));
+    {
+        // The geonameid column of every alternate name
+        std::vector<std::string_view> ids = {};
+        forEachLine(alternateNamesFile.view(), [&](const std::string_view line)
+        { ids.push_back(split<2>(line, '\t')[1]); });
+        std::size_t idBytes = 0;
+        for (const auto id : ids)
+        {
+            idBytes += id.size();
+        }
+        results.push_back(measure("charDigitsToInt", rep, ids.size(), idBytes, [&]()
+        {
+            for (const auto id : ids)
+            {
+                checksum += static_cast<std::size_t>(charDigitsToInt(id));
+            }
+        }));
+    }
+    results.push_back(measure("parseAdminData", rep, admin1Lines, admin1Bytes, [&]()
+    {
+        Progress progress = Progress("admin1CodesASCII", false);
+        checksum += parseAdminData(files.admin1CodesASCII, progress).size();
+    }));
+    {
+        const SilenceCout silence = {};
+        Progress progress = Progress("alternateNames", false);
+        const auto admin1Map = parseAdminData(files.admin1CodesASCII, progress);
+        const auto referenced = collectReferencedGeoNameIds(files.cities, admin1Map, SELECTED_COUNTRIES, progress);
+        results.push_back(measure("parseAlternateNames", rep, alternateNamesLines, alternateNamesBytes, [&]()
+        { checksum += parseAlternateNames(files.alternateNames, languageIds, referenced, threadCount, progress).size(); }));
+    }
+    // End to end, every input file is read once per run
+    const std::size_t allLines = citiesLines + alternateNamesLines + admin1Lines;
+    const std::size_t allBytes = citiesBytes + alternateNamesBytes + admin1Bytes;
+    for (const std::string format : {"txt", "json", "binary"})
+    {
+        const std::string outputPath = files.folder + "output." + format;
+        results.push_back(measure("parseCities/" + format, rep, allLines, allBytes, [&]()
+        {
+            std::ofstream outputFile = std::ofstream(outputPath, format != "txt" ? std::ios::out | std::ios::binary : std::ios::out);
+            std::unique_ptr<RecordSink> sink = nullptr;
+            if (format == "binary")
+            {
+                sink = std::make_unique<BinaryRecordSink>(outputFile, SELECTED_LANGUAGES, 0);
+            }
+            else if (format == "json")
+            {
+                sink = std::make_unique<JsonRecordSink>(outputFile);
+            }
+            else
+            {
+                sink = std::make_unique<TxtRecordSink>(outputFile);
+            }
+            RunStats stats = RunStats(false);
+            parseCities(*sink, files.cities, files.alternateNames, SELECTED_LANGUAGES, SELECTED_COUNTRIES, files.admin1CodesASCII, files.localizedCountries, threadCount, RecordOrder::File, stats);
+        }));
+    }
+
+    // The binary dataset in every record order: its size once compressed, and the latency of queries that read
+    // their record. The queries are sorted along a Morton curve like queryBatch sorts them, so consecutive
+    // queries land close to each other and benefit from records that are stored close to each other.
+    constexpr std::size_t QUERY_COUNT = 200000;
+    std::vector<double> queries = {};
+    {
+        std::mt19937 random = std::mt19937(seed);
+        std::uniform_real_distribution<double> latitude = std::uniform_real_distribution<double>(-60, 70);
+        std::uniform_real_distribution<double> longitude = std::uniform_real_distribution<double>(-180, 180);
+        std::vector<std::pair<std::uint32_t, std::pair<double, double>>> sorted = {};
+        for (std::size_t i = 0; i < QUERY_COUNT; i++)
+        {
+            const double lat = latitude(random);
+            const double lon = longitude(random);
+            sorted.push_back({SpatialIndex::mortonKey(lat, lon), {lat, lon}});
+        }
+        std::sort(sorted.begin(), sorted.end());
+        for (const auto &query : sorted)
+        {
+            queries.push_back(query.second.first);
+            queries.push_back(query.second.second);
+        }
+    }
+    nlohmann::json orders = nlohmann::json::array();
+    for (const auto &[orderName, order] : {std::pair{"file", RecordOrder::File}, std::pair{"hilbert", RecordOrder::Hilbert}, std::pair{"morton", RecordOrder::Morton}})
+    {
+        std::ostringstream binary = std::ostringstream(std::ios::out | std::ios::binary);
+        {
+            const SilenceCout silence = {};
+            BinaryRecordSink sink = BinaryRecordSink(binary, SELECTED_LANGUAGES, 0);
+            RunStats stats = RunStats(false);
+            parseCities(sink, files.cities, files.alternateNames, SELECTED_LANGUAGES, SELECTED_COUNTRIES, files.admin1CodesASCII, files.localizedCountries, threadCount, order, stats);
+        }
+        const std::string bytes = binary.str();
+        uLongf compressedSize = compressBound(static_cast<uLong>(bytes.size()));
+        std::vector<Bytef> compressed = std::vector<Bytef>(compressedSize);
+        compress2(compressed.data(), &compressedSize, reinterpret_cast<const Bytef *>(bytes.data()), static_cast<uLong>(bytes.size()), Z_DEFAULT_COMPRESSION);
+        orders.push_back({{"order", orderName}, {"bytes", bytes.size()}, {"compressedBytes", compressedSize}});
+
+        // DatasetView needs the dataset aligned to 8 bytes
+        std::vector<std::uint64_t> aligned = std::vector<std::uint64_t>((bytes.size() + 7) / 8);
+        std::memcpy(aligned.data(), bytes.data(), bytes.size());
+        DatasetView view = {};
+        if (const auto error = view.open(reinterpret_cast<const char *>(aligned.data()), bytes.size()); error.has_value())
+        {
+            std::cerr << error.value() << "\n";
+            return 1;
+        }
+        std::vector<double> coordinates = std::vector<double>(view.recordCount() * 2);
+        for (std::size_t i = 0; i < view.recordCount(); i++)
+        {
+            coordinates[2 * i] = view.latitude(i);
+            coordinates[2 * i + 1] = view.longitude(i);
+        }
+        const SpatialIndex index = SpatialIndex(coordinates.data(), view.recordCount());
+        results.push_back(measure(std::string("query/") + orderName, rep, QUERY_COUNT, 0, [&]()
+        {
+            for (std::size_t i = 0; i < QUERY_COUNT; i++)
+            {
+                const auto id = static_cast<std::size_t>(index.nearest(queries[2 * i], queries[2 * i + 1], std::numeric_limits<double>::infinity()));
+                checksum += view.latinized(id, CITY_NAME).size() + view.latinized(id, ADMIN1_NAME).size() + view.timezone(id).size();
+                for (std::size_t language = 0; language < view.languageCount(); language++)
+                {
+                    checksum += view.localized(id, language, CITY_NAME).value_or("").size();
+                }
+            }
+        }));
+    }
+
+    nlohmann::json report = {
+        {"label", program.get<std::string>("--label")},
+        {"cities", cityCount},
+        {"seed", seed},
+        {"threads", threadCount},
+        {"languages", program.get<std::string>("--languages")},
+        // Depends on the parsed values and the repetitions only, it differs between two results of the same fixture when the parsers disagree
+        {"checksum", checksum},
+        {"benchmarks", nlohmann::json::array()},
+        {"orders", orders},
+    };
+    for (const auto &r : results)
+    {
+        report["benchmarks"].push_back(toJson(r));
+    }
+
+    std::map<std::string, double> previous = {};
+    if (const auto comparePath = program.get<std::string>("--compare"); !comparePath.empty())
+    {
+        std::ifstream compareFile = std::ifstream(comparePath);
+        if (!compareFile.good())
+        {
+            std::cerr << "--compare argument could not be opened. Received: " << std::quoted(comparePath) << "\n";
+            return 1;
+        }
+        for (const auto &benchmark : nlohmann::json::parse(compareFile)["benchmarks"])
+        {
+            previous[benchmark["name"].get<std::string>()] = benchmark["seconds"].get<double>();
+        }
+    }
+
+    std::cout << std::fixed << std::setprecision(2);
+    for (const auto &r : results)
+    {
+        std::cout << std::left << std::setw(26) << r.name << std::right
+                  << std::setw(10) << r.seconds * 1000 << " ms"
+                  << std::setw(14) << r.lines / r.seconds / 1e6 << " M lines/s"
+                  << std::setw(10) << r.bytes / r.seconds / 1e6 << " MB/s"
+                  << std::setw(10) << r.peakRssBytes / 1e6 << " MB peak";
+        if (const auto iter = previous.find(r.name); iter != previous.end())
+        {
+            // Above 1 is faster than the compared results
+            std::cout << std::setw(8) << iter->second / r.seconds << "x";
+        }
+        std::cout << "\n";
+    }
+    for (const auto &o : orders)
+    {
+        std::cout << "binary/" << std::left << std::setw(19) << o["order"].get<std::string>() << std::right
+                  << std::setw(10) << o["bytes"].get<std::size_t>() / 1e6 << " MB"
+                  << std::setw(10) << o["compressedBytes"].get<std::size_t>() / 1e6 << " MB compressed\n";
+    }
+
+    if (const auto outputPath = program.get<std::string>("--output"); !outputPath.empty())
+    {
+        std::ofstream outputFile = std::ofstream(outputPath);
+        if (!outputFile.good())
+        {
+            std::cerr << "--output argument was not good. Could not open stream. Received: " << outputPath << "\n";
+            return 1;
+        }
+        outputFile << report.dump(4) << "\n";
+    }
+    return 0;
+}
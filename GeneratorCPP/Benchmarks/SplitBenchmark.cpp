@@ -0,0 +1,238 @@
+// Compares the throughput of split in StringSplit.hpp with the byte-at-a-time implementation it replaced.
+//
+// Build and run from GeneratorCPP/Benchmarks, optionally with -mavx2 (or /arch:AVX2) to use AVX2:
+//      g++ -std=c++20 -O2 -I.. SplitBenchmark.cpp -o SplitBenchmark
+//      ./SplitBenchmark [file]
+// The lines of file are split on tabs, without a file the lines are generated like cities15000.txt and alternateNames.txt.
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <random>
+#include <functional>
+
+#include "StringSplit.hpp"
+
+namespace baseline
+{
+    // The implementation of split<maximum>(str, delim, count) before it was vectorized
+    template <std::size_t maximum>
+    std::array<std::string_view, maximum> split(const std::string_view str, const char delim, std::size_t &count) noexcept
+    {
+        count = 0;
+        std::array<std::string_view, maximum> retval = {};
+        std::pair<std::size_t, std::size_t> bounds = {0, 0};
+        std::size_t i = 0;
+        for (; i < str.size(); i++)
+        {
+            if (count == maximum)
+            {
+                return retval;
+            }
+            if (str[i] == delim)
+            {
+                retval[count] = std::string_view(str.begin() + bounds.first, str.begin() + bounds.second);
+                count++;
+                bounds = {i + 1, i + 1};
+            }
+            else
+            {
+                bounds.second += 1;
+            }
+        }
+        if (count < maximum)
+        {
+            retval[count] = std::string_view(str.begin() + bounds.first, str.begin() + bounds.second);
+        }
+        return retval;
+    }
+
+    std::vector<std::string_view> split(const std::string_view str, const char delim) noexcept
+    {
+        std::vector<std::string_view> retval = {};
+        std::pair<std::size_t, std::size_t> bounds = {0, 0};
+        for (std::size_t i = 0; i < str.size(); i++)
+        {
+            if (str[i] == delim)
+            {
+                retval.push_back(std::string_view(str.begin() + bounds.first, str.begin() + bounds.second));
+                bounds = {i + 1, i + 1};
+            }
+            else
+            {
+                bounds.second += 1;
+            }
+        }
+        retval.push_back(std::string_view(str.begin() + bounds.first, str.begin() + bounds.second));
+        return retval;
+    }
+}
+
+// Lines shaped like cities15000.txt (19 fields) and alternateNames.txt (8 fields), some fields are empty
+std::vector<std::string> generateLines(const std::size_t count)
+{
+    std::mt19937 random = std::mt19937(42);
+    const auto field = [&](const std::size_t maxLength)
+    {
+        std::string value = std::string(random() % (maxLength + 1), 'a');
+        for (auto &c : value)
+        {
+            c = static_cast<char>('a' + random() % 26);
+        }
+        return value;
+    };
+    std::vector<std::string> lines = {};
+    for (std::size_t i = 0; i < count; i++)
+    {
+        const std::size_t fields = i % 4 == 0 ? 19 : 8;
+        std::string line = {};
+        for (std::size_t f = 0; f < fields; f++)
+        {
+            line += field(f == 3 && fields == 19 ? 120 : 14);
+            if (f + 1 != fields)
+            {
+                line += '\t';
+            }
+        }
+        lines.push_back(std::move(line));
+    }
+    return lines;
+}
+
+template <typename T>
+bool same(const T &a, const T &b)
+{
+    return std::equal(a.begin(), a.end(), b.begin(), b.end());
+}
+
+// Checks that both implementations agree, including empty fields and truncation
+bool check(const std::vector<std::string> &lines)
+{
+    std::vector<std::string> cases = lines;
+    for (const auto *extra : {"", "\t", "\t\t", "a", "a\t", "\ta", "abaabaaabbabbbabb"})
+    {
+        cases.push_back(extra);
+    }
+    std::mt19937 random = std::mt19937(7);
+    for (std::size_t i = 0; i < 10000; i++)
+    {
+        std::string value = std::string(random() % 100, 'a');
+        for (auto &c : value)
+        {
+            c = random() % 3 == 0 ? '\t' : static_cast<char>(random());
+        }
+        cases.push_back(std::move(value));
+    }
+    for (const auto &line : cases)
+    {
+        std::size_t expectedCount = 0;
+        std::size_t count = 0;
+        const auto expected4 = baseline::split<4>(line, '\t', expectedCount);
+        const auto actual4 = split<4>(line, '\t', count);
+        std::size_t expectedCount18 = 0;
+        std::size_t count18 = 0;
+        const auto expected18 = baseline::split<18>(line, '\t', expectedCount18);
+        const auto actual18 = split<18>(line, '\t', count18);
+        if (!same(expected4, actual4) || expectedCount != count || !same(expected18, actual18) || expectedCount18 != count18 ||
+            !same(baseline::split(line, '\t'), split(line, '\t')))
+        {
+            std::cerr << "Mismatch on " << std::quoted(line) << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Keeps the compiler from removing the measured calls
+std::size_t benchmarkSink = 0;
+
+// Returns the throughput of run over every line in GB/s, repeating it until it ran for a while
+double measure(const std::vector<std::string> &lines, const std::function<std::size_t(std::string_view)> &run)
+{
+    std::size_t bytes = 0;
+    for (const auto &line : lines)
+    {
+        bytes += line.size() + 1;
+    }
+    std::size_t sink = 0;
+    std::size_t repetitions = 0;
+    const auto start = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::duration<double>(0);
+    while (elapsed.count() < 1)
+    {
+        for (const auto &line : lines)
+        {
+            sink += run(line);
+        }
+        repetitions++;
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+    benchmarkSink += sink;
+    return double(bytes) * repetitions / elapsed.count() / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> lines = {};
+    if (argc > 1)
+    {
+        std::ifstream file = std::ifstream(argv[1]);
+        std::string line = {};
+        while (std::getline(file, line))
+        {
+            lines.push_back(line);
+        }
+    }
+    else
+    {
+        lines = generateLines(200000);
+    }
+    if (!check(lines))
+    {
+        return 1;
+    }
+#if defined(__AVX2__)
+    const char *const simd = "AVX2";
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    const char *const simd = "SSE2";
+#else
+    const char *const simd = "none";
+#endif
+    std::cout << "Splitting " << lines.size() << " lines, SIMD: " << simd << "\n";
+    std::cout << std::fixed << std::setprecision(2);
+
+    const auto report = [&](const char *name, const std::function<std::size_t(std::string_view)> &before, const std::function<std::size_t(std::string_view)> &after)
+    {
+        const double b = measure(lines, before);
+        const double a = measure(lines, after);
+        std::cout << std::left << std::setw(12) << name << " baseline " << b << " GB/s, split " << a << " GB/s, x" << a / b << "\n";
+    };
+    report("split<4>", [](const std::string_view line)
+    {
+        std::size_t count = 0;
+        return baseline::split<4>(line, '\t', count)[0].size() + count;
+    }, [](const std::string_view line)
+    {
+        std::size_t count = 0;
+        return split<4>(line, '\t', count)[0].size() + count;
+    });
+    report("split<18>", [](const std::string_view line)
+    {
+        std::size_t count = 0;
+        return baseline::split<18>(line, '\t', count)[0].size() + count;
+    }, [](const std::string_view line)
+    {
+        std::size_t count = 0;
+        return split<18>(line, '\t', count)[0].size() + count;
+    });
+    report("split", [](const std::string_view line)
+    { return baseline::split(line, '\t').size(); }, [](const std::string_view line)
+    { return split(line, '\t').size(); });
+    return 0;
+}
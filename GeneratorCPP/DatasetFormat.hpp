@@ -0,0 +1,700 @@
+#ifndef __HEADER_DATASETFORMAT_HPP_CPP_
+#define __HEADER_DATASETFORMAT_HPP_CPP_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <optional>
+#include <ostream>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <span>
+#include <numeric>
+#include <algorithm>
+
+#include "NearestGrid.hpp"
+#include "Microdegrees.hpp"
+
+// The binary dataset written by GeneratorCPP with --format binary and memory mapped by QueryCPP.
+//
+// All integers are little-endian. The file starts with a DatasetHeader, followed by sections
+// that are each aligned to 8 bytes. The header holds the offset and size of every section,
+// so a reader can use the mapped file in place without parsing it.
+//
+// Strings are stored once in the string table and referenced by a uint32 string id.
+// String id 0 is always the empty string, DATASET_ABSENT_STRING marks a language without localization.
+//
+// The GRID sections are optional, they hold the nearest record raster described in NearestGrid.hpp.
+// The COUNTRIES section is optional. When it is present the records of each country are contiguous,
+// and it holds the range and bounding box of every country sorted by code.
+// The SPATIAL_INDEX sections are optional, they hold the arrays of the SpatialIndex of the records so a reader
+// uses them in place instead of building the index. A reader whose LEAF_SIZE differs builds it instead.
+// The COUNTRY_INDEX sections are optional and only present with the two above. They hold the SpatialIndex of the
+// records of every country, one after the other in the order of COUNTRIES. The ids of an index are relative to the
+// first record of its country, and its nodes start after the SpatialIndex::nodeCount nodes of the countries before it.
+
+constexpr char DATASET_MAGIC[8] = {'L', 'G', 'E', 'O', 'B', 'I', 'N', '\0'};
+constexpr std::uint32_t DATASET_VERSION = 3;
+constexpr std::uint32_t DATASET_ABSENT_STRING = 0xFFFFFFFF;
+
+// The 3 names of a record, in this order
+constexpr std::size_t DATASET_NAME_COUNT = 3;
+enum DatasetName : std::size_t
+{
+    CITY_NAME = 0,
+    ADMIN1_NAME = 1,
+    COUNTRY_NAME = 2,
+};
+
+enum DatasetSectionId : std::size_t
+{
+    LATITUDES = 0,        // int32[recordCount], microdegrees
+    LONGITUDES = 1,       // int32[recordCount], microdegrees
+    COUNTRY_CODES = 2,    // char[recordCount][2]
+    TIMEZONES = 3,        // uint32[recordCount], string ids
+    LATINIZED = 4,        // uint32[recordCount][DATASET_NAME_COUNT], string ids
+    LANGUAGES = 5,        // char[languageCount][2], ISO 639-1 codes
+    LOCALIZED = 6,        // uint32[recordCount][languageCount][DATASET_NAME_COUNT], string ids
+    STRING_OFFSETS = 7,   // uint32[stringCount + 1], string i is the bytes [offsets[i], offsets[i + 1])
+    STRING_BYTES = 8,     // char[]
+    GRID = 9,             // NearestGridHeader, empty when there is no grid
+    GRID_CELLS = 10,      // uint32[rows * columns]
+    GRID_CANDIDATES = 11, // uint32[]
+    POPULATIONS = 12,     // uint32[recordCount]
+    FEATURE_CODES = 13,   // uint32[recordCount], string ids of GeoNames feature codes like "PPLC"
+    COUNTRIES = 14,       // DatasetCountry[], empty when the records are not partitioned by country
+    SPATIAL_INDEX = 15,       // DatasetSpatialIndex, empty when there is no index
+    SPATIAL_INDEX_NODES = 16, // SpatialIndexNode[], Eytzinger order
+    SPATIAL_INDEX_XS = 17,    // double[recordCount], tree order
+    SPATIAL_INDEX_YS = 18,    // double[recordCount], tree order
+    SPATIAL_INDEX_ZS = 19,    // double[recordCount], tree order
+    SPATIAL_INDEX_IDS = 20,   // int32[recordCount], the record of each tree position
+    COUNTRY_INDEX_NODES = 21, // SpatialIndexNode[], the nodes of every country
+    COUNTRY_INDEX_XS = 22,    // double[recordCount], tree order within each country
+    COUNTRY_INDEX_YS = 23,    // double[recordCount], tree order within each country
+    COUNTRY_INDEX_ZS = 24,    // double[recordCount], tree order within each country
+    COUNTRY_INDEX_IDS = 25,   // int32[recordCount], the record of each tree position minus the first record of its country
+};
+constexpr std::size_t DATASET_SECTION_SLOTS = 32;
+
+struct DatasetSection
+{
+    std::uint64_t offset;
+    std::uint64_t size;
+};
+
+struct DatasetHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t recordCount;
+    std::uint32_t languageCount;
+    std::uint32_t stringCount;
+    // Unused slots are zero, later versions add sections without moving the existing ones
+    DatasetSection sections[DATASET_SECTION_SLOTS];
+};
+static_assert(sizeof(DatasetHeader) == 24 + 16 * DATASET_SECTION_SLOTS, "DatasetHeader must not have padding");
+
+// The records [first, first + count) of one country and their bounding box in microdegrees
+struct DatasetCountry
+{
+    char code[2];
+    std::uint16_t reserved;
+    std::uint32_t first;
+    std::uint32_t count;
+    Microdegrees minLatitude;
+    Microdegrees maxLatitude;
+    Microdegrees minLongitude;
+    Microdegrees maxLongitude;
+};
+static_assert(sizeof(DatasetCountry) == 28, "DatasetCountry must not have padding");
+
+// How the stored SpatialIndex was built
+struct DatasetSpatialIndex
+{
+    std::uint32_t leafSize;
+    std::uint32_t nodeCount;
+};
+static_assert(sizeof(DatasetSpatialIndex) == 8, "DatasetSpatialIndex must not have padding");
+
+// Collects records and writes them as a binary dataset
+class DatasetWriter
+{
+    std::vector<std::array<char, 2>> languages = {};
+    std::vector<Microdegrees> latitudes = {};
+    std::vector<Microdegrees> longitudes = {};
+    std::vector<std::array<char, 2>> countryCodes = {};
+    std::vector<std::uint32_t> timezones = {};
+    std::vector<std::uint32_t> latinized = {};
+    std::vector<std::uint32_t> localized = {};
+    std::vector<std::uint32_t> populations = {};
+    std::vector<std::uint32_t> featureCodes = {};
+    std::vector<DatasetCountry> countries = {};
+
+    std::unordered_map<std::string, std::uint32_t> stringIds = {};
+    std::vector<std::uint32_t> stringOffsets = {0};
+    std::string stringBytes = {};
+
+    NearestGrid grid = {};
+    SpatialIndex index = {};
+    std::vector<SpatialIndex> countryIndexes = {};
+
+    static void pad(std::ostream &os, std::uint64_t &position) noexcept
+    {
+        while (position % 8 != 0)
+        {
+            os.put('\0');
+            position++;
+        }
+    }
+
+    template <typename T>
+    static void writeSection(std::ostream &os, std::uint64_t &position, DatasetSection &section, const T *data, const std::size_t count) noexcept
+    {
+        pad(os, position);
+        section.offset = position;
+        section.size = count * sizeof(T);
+        os.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(section.size));
+        position += section.size;
+    }
+
+    // Writes the array member of every index one after the other as one section
+    template <typename Member>
+    static void writeSection(std::ostream &os, std::uint64_t &position, DatasetSection &section, const std::vector<SpatialIndex> &indexes, const Member member) noexcept
+    {
+        pad(os, position);
+        section.offset = position;
+        section.size = 0;
+        for (const auto &index : indexes)
+        {
+            const auto values = index.arrays().*member;
+            os.write(reinterpret_cast<const char *>(values.data()), static_cast<std::streamsize>(values.size_bytes()));
+            section.size += values.size_bytes();
+        }
+        position += section.size;
+    }
+
+public:
+    // languages are the ISO 639-1 codes of the localized names, in the order they are passed to addRecord
+    DatasetWriter(const std::vector<std::string> &languageCodes) noexcept
+    {
+        for (const auto &language : languageCodes)
+        {
+            languages.push_back({language.size() > 0 ? language[0] : '\0', language.size() > 1 ? language[1] : '\0'});
+        }
+        internString("");
+    }
+
+    std::uint32_t internString(const std::string_view str) noexcept
+    {
+        const auto [iter, inserted] = stringIds.try_emplace(std::string(str), static_cast<std::uint32_t>(stringOffsets.size() - 1));
+        if (inserted)
+        {
+            stringBytes.append(str);
+            stringOffsets.push_back(static_cast<std::uint32_t>(stringBytes.size()));
+        }
+        return iter->second;
+    }
+
+    std::size_t languageCount() const noexcept
+    {
+        return languages.size();
+    }
+    std::size_t stringCount() const noexcept
+    {
+        return stringIds.size();
+    }
+    double stringLoadFactor() const noexcept
+    {
+        return stringIds.load_factor();
+    }
+
+    // localizedNames holds languageCount() entries, std::nullopt when the record has no localization for the language
+    void addRecord(
+        const Microdegrees latitude,
+        const Microdegrees longitude,
+        const std::string_view countryCode,
+        const std::string_view timezone,
+        const std::uint32_t population,
+        const std::string_view featureCode,
+        const std::array<std::string_view, DATASET_NAME_COUNT> &latinizedNames,
+        const std::vector<std::optional<std::array<std::string_view, DATASET_NAME_COUNT>>> &localizedNames) noexcept
+    {
+        latitudes.push_back(latitude);
+        longitudes.push_back(longitude);
+        countryCodes.push_back({countryCode.size() > 0 ? countryCode[0] : '\0', countryCode.size() > 1 ? countryCode[1] : '\0'});
+        timezones.push_back(internString(timezone));
+        populations.push_back(population);
+        featureCodes.push_back(internString(featureCode));
+        for (const auto name : latinizedNames)
+        {
+            latinized.push_back(internString(name));
+        }
+        for (std::size_t i = 0; i < languages.size(); i++)
+        {
+            for (std::size_t n = 0; n < DATASET_NAME_COUNT; n++)
+            {
+                const bool present = i < localizedNames.size() && localizedNames[i].has_value();
+                localized.push_back(present ? internString(localizedNames[i].value()[n]) : DATASET_ABSENT_STRING);
+            }
+        }
+    }
+
+    // Moves the records added so far so the records of each country are contiguous, keeping their order
+    // within a country, and records the range and bounding box of every country. Call it before buildGrid.
+    void partitionByCountry() noexcept
+    {
+        std::vector<std::uint32_t> order = std::vector<std::uint32_t>(latitudes.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](const std::uint32_t a, const std::uint32_t b)
+                         { return countryCodes[a] < countryCodes[b]; });
+        // Gathers the stride values of each record in the new order
+        const auto permute = [&](auto &values, const std::size_t stride)
+        {
+            auto permuted = std::remove_reference_t<decltype(values)>();
+            permuted.reserve(values.size());
+            for (const auto record : order)
+            {
+                permuted.insert(permuted.end(), values.begin() + record * stride, values.begin() + (record + 1) * stride);
+            }
+            values = std::move(permuted);
+        };
+        permute(latitudes, 1);
+        permute(longitudes, 1);
+        permute(countryCodes, 1);
+        permute(timezones, 1);
+        permute(latinized, DATASET_NAME_COUNT);
+        permute(localized, languages.size() * DATASET_NAME_COUNT);
+        permute(populations, 1);
+        permute(featureCodes, 1);
+
+        countries.clear();
+        for (std::uint32_t i = 0; i < latitudes.size(); i++)
+        {
+            if (countries.empty() || std::memcmp(countries.back().code, countryCodes[i].data(), 2) != 0)
+            {
+                countries.push_back({{countryCodes[i][0], countryCodes[i][1]}, 0, i, 0, latitudes[i], latitudes[i], longitudes[i], longitudes[i]});
+            }
+            DatasetCountry &country = countries.back();
+            country.count++;
+            country.minLatitude = std::min(country.minLatitude, latitudes[i]);
+            country.maxLatitude = std::max(country.maxLatitude, latitudes[i]);
+            country.minLongitude = std::min(country.minLongitude, longitudes[i]);
+            country.maxLongitude = std::max(country.maxLongitude, longitudes[i]);
+        }
+    }
+
+    std::vector<double> coordinates() const noexcept
+    {
+        std::vector<double> coordinates = std::vector<double>(latitudes.size() * 2);
+        for (std::size_t i = 0; i < latitudes.size(); i++)
+        {
+            coordinates[2 * i] = toDegrees(latitudes[i]);
+            coordinates[2 * i + 1] = toDegrees(longitudes[i]);
+        }
+        return coordinates;
+    }
+
+    // Builds the nearest record raster of the records added so far, it is written with them
+    const NearestGrid &buildGrid(const std::uint32_t cellsPerDegree) noexcept
+    {
+        grid = buildNearestGrid(coordinates().data(), latitudes.size(), cellsPerDegree);
+        return grid;
+    }
+
+    // Builds the spatial index of the records added so far, and the one of each country when they are partitioned,
+    // they are written with them. Call it after partitionByCountry.
+    const SpatialIndex &buildIndex() noexcept
+    {
+        const std::vector<double> all = coordinates();
+        index = SpatialIndex(all.data(), latitudes.size());
+        countryIndexes.clear();
+        for (const auto &country : countries)
+        {
+            countryIndexes.emplace_back(all.data() + 2 * std::size_t(country.first), country.count);
+        }
+        return index;
+    }
+
+    void write(std::ostream &os) const noexcept
+    {
+        DatasetHeader header = {};
+        std::memcpy(header.magic, DATASET_MAGIC, sizeof(DATASET_MAGIC));
+        header.version = DATASET_VERSION;
+        header.recordCount = static_cast<std::uint32_t>(latitudes.size());
+        header.languageCount = static_cast<std::uint32_t>(languages.size());
+        header.stringCount = static_cast<std::uint32_t>(stringOffsets.size() - 1);
+
+        // A placeholder header is written first and replaced once the offsets are known
+        os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        std::uint64_t position = sizeof(header);
+        writeSection(os, position, header.sections[LATITUDES], latitudes.data(), latitudes.size());
+        writeSection(os, position, header.sections[LONGITUDES], longitudes.data(), longitudes.size());
+        writeSection(os, position, header.sections[COUNTRY_CODES], countryCodes.data(), countryCodes.size());
+        writeSection(os, position, header.sections[TIMEZONES], timezones.data(), timezones.size());
+        writeSection(os, position, header.sections[LATINIZED], latinized.data(), latinized.size());
+        writeSection(os, position, header.sections[LANGUAGES], languages.data(), languages.size());
+        writeSection(os, position, header.sections[LOCALIZED], localized.data(), localized.size());
+        writeSection(os, position, header.sections[POPULATIONS], populations.data(), populations.size());
+        writeSection(os, position, header.sections[FEATURE_CODES], featureCodes.data(), featureCodes.size());
+        writeSection(os, position, header.sections[STRING_OFFSETS], stringOffsets.data(), stringOffsets.size());
+        writeSection(os, position, header.sections[STRING_BYTES], stringBytes.data(), stringBytes.size());
+        if (!grid.cells.empty())
+        {
+            writeSection(os, position, header.sections[GRID], &grid.header, 1);
+            writeSection(os, position, header.sections[GRID_CELLS], grid.cells.data(), grid.cells.size());
+            writeSection(os, position, header.sections[GRID_CANDIDATES], grid.candidates.data(), grid.candidates.size());
+        }
+        if (!countries.empty())
+        {
+            writeSection(os, position, header.sections[COUNTRIES], countries.data(), countries.size());
+        }
+        if (index.size() != 0)
+        {
+            const SpatialIndexArrays arrays = index.arrays();
+            const DatasetSpatialIndex spatialIndex = {static_cast<std::uint32_t>(SpatialIndex::LEAF_SIZE), static_cast<std::uint32_t>(arrays.nodes.size())};
+            writeSection(os, position, header.sections[SPATIAL_INDEX], &spatialIndex, 1);
+            writeSection(os, position, header.sections[SPATIAL_INDEX_NODES], arrays.nodes.data(), arrays.nodes.size());
+            writeSection(os, position, header.sections[SPATIAL_INDEX_XS], arrays.xs.data(), arrays.xs.size());
+            writeSection(os, position, header.sections[SPATIAL_INDEX_YS], arrays.ys.data(), arrays.ys.size());
+            writeSection(os, position, header.sections[SPATIAL_INDEX_ZS], arrays.zs.data(), arrays.zs.size());
+            writeSection(os, position, header.sections[SPATIAL_INDEX_IDS], arrays.ids.data(), arrays.ids.size());
+            if (!countryIndexes.empty())
+            {
+                writeSection(os, position, header.sections[COUNTRY_INDEX_NODES], countryIndexes, &SpatialIndexArrays::nodes);
+                writeSection(os, position, header.sections[COUNTRY_INDEX_XS], countryIndexes, &SpatialIndexArrays::xs);
+                writeSection(os, position, header.sections[COUNTRY_INDEX_YS], countryIndexes, &SpatialIndexArrays::ys);
+                writeSection(os, position, header.sections[COUNTRY_INDEX_ZS], countryIndexes, &SpatialIndexArrays::zs);
+                writeSection(os, position, header.sections[COUNTRY_INDEX_IDS], countryIndexes, &SpatialIndexArrays::ids);
+            }
+        }
+        pad(os, position);
+
+        os.seekp(0);
+        os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        os.seekp(static_cast<std::streamoff>(position));
+    }
+};
+
+// A read-only view of a binary dataset held in memory, usually a memory mapped file.
+// The view does not copy anything, the memory must outlive it.
+class DatasetView
+{
+    const char *data_ = nullptr;
+    const DatasetHeader *header = nullptr;
+    NearestGridView grid_ = {};
+    const DatasetCountry *countries_ = nullptr;
+    std::size_t countryCount_ = 0;
+    std::optional<SpatialIndexArrays> spatialIndex_ = std::nullopt;
+    // countryCount_ + 1 offsets into COUNTRY_INDEX_NODES, empty when the dataset has no country indexes
+    std::vector<std::size_t> countryNodeOffsets_ = {};
+
+    template <typename T>
+    const T *section(const DatasetSectionId id) const noexcept
+    {
+        return reinterpret_cast<const T *>(data_ + header->sections[id].offset);
+    }
+
+    // Checks that section id is inside the file and holds count elements of T
+    template <typename T>
+    static bool checkSection(const DatasetHeader &h, const std::size_t size, const DatasetSectionId id, const std::uint64_t count) noexcept
+    {
+        const auto &s = h.sections[id];
+        return s.offset % alignof(T) == 0 && s.offset <= size && s.size <= size - s.offset && s.size == count * sizeof(T);
+    }
+
+public:
+    DatasetView() noexcept = default;
+
+    // Returns an error message if data is not a valid dataset of this version
+    std::optional<std::string> open(const char *data, const std::size_t size) noexcept
+    {
+        if (data == nullptr || size < sizeof(DatasetHeader))
+        {
+            return "The file is too small to be a dataset.";
+        }
+        if (reinterpret_cast<std::uintptr_t>(data) % 8 != 0)
+        {
+            return "The dataset is not aligned to 8 bytes.";
+        }
+        const auto &h = *reinterpret_cast<const DatasetHeader *>(data);
+        if (std::memcmp(h.magic, DATASET_MAGIC, sizeof(DATASET_MAGIC)) != 0)
+        {
+            return "The file is not a dataset.";
+        }
+        if (h.version != DATASET_VERSION)
+        {
+            return "The dataset version " + std::to_string(h.version) + " is not supported, expected " + std::to_string(DATASET_VERSION) + ".";
+        }
+        const std::uint64_t records = h.recordCount;
+        const std::uint64_t names = records * h.languageCount * DATASET_NAME_COUNT;
+        if (!checkSection<Microdegrees>(h, size, LATITUDES, records) ||
+            !checkSection<Microdegrees>(h, size, LONGITUDES, records) ||
+            !checkSection<std::array<char, 2>>(h, size, COUNTRY_CODES, records) ||
+            !checkSection<std::uint32_t>(h, size, TIMEZONES, records) ||
+            !checkSection<std::uint32_t>(h, size, LATINIZED, records * DATASET_NAME_COUNT) ||
+            !checkSection<std::array<char, 2>>(h, size, LANGUAGES, h.languageCount) ||
+            !checkSection<std::uint32_t>(h, size, LOCALIZED, names) ||
+            !checkSection<std::uint32_t>(h, size, POPULATIONS, records) ||
+            !checkSection<std::uint32_t>(h, size, FEATURE_CODES, records) ||
+            !checkSection<std::uint32_t>(h, size, STRING_OFFSETS, std::uint64_t(h.stringCount) + 1))
+        {
+            return "The dataset sections are not consistent with its header.";
+        }
+        const auto *offsets = reinterpret_cast<const std::uint32_t *>(data + h.sections[STRING_OFFSETS].offset);
+        const auto &bytes = h.sections[STRING_BYTES];
+        if (bytes.offset > size || bytes.size > size - bytes.offset || offsets[0] != 0 || offsets[h.stringCount] != bytes.size)
+        {
+            return "The dataset string table is not consistent with its header.";
+        }
+        for (std::uint32_t i = 0; i < h.stringCount; i++)
+        {
+            if (offsets[i] > offsets[i + 1])
+            {
+                return "The dataset string table is not consistent with its header.";
+            }
+        }
+        // Every string id must be valid, so lookups never have to check it
+        const auto checkIds = [&](const DatasetSectionId id, const std::uint64_t count, const bool allowAbsent)
+        {
+            const auto *ids = reinterpret_cast<const std::uint32_t *>(data + h.sections[id].offset);
+            for (std::uint64_t i = 0; i < count; i++)
+            {
+                if (ids[i] >= h.stringCount && !(allowAbsent && ids[i] == DATASET_ABSENT_STRING))
+                {
+                    return false;
+                }
+            }
+            return true;
+        };
+        if (!checkIds(TIMEZONES, records, false) || !checkIds(FEATURE_CODES, records, false) || !checkIds(LATINIZED, records * DATASET_NAME_COUNT, false) || !checkIds(LOCALIZED, names, true))
+        {
+            return "The dataset references a string that does not exist.";
+        }
+        // The names of a language are all present or all absent, so localized only has to check the city name
+        const auto *localized = reinterpret_cast<const std::uint32_t *>(data + h.sections[LOCALIZED].offset);
+        for (std::uint64_t i = 0; i < names; i += DATASET_NAME_COUNT)
+        {
+            const bool isAbsent = localized[i] == DATASET_ABSENT_STRING;
+            for (std::size_t n = 1; n < DATASET_NAME_COUNT; n++)
+            {
+                if ((localized[i + n] == DATASET_ABSENT_STRING) != isAbsent)
+                {
+                    return "The dataset has a localization with only some of its names.";
+                }
+            }
+        }
+        NearestGridView grid = {};
+        if (h.sections[GRID].size != 0)
+        {
+            const auto &cells = h.sections[GRID_CELLS];
+            const auto &candidates = h.sections[GRID_CANDIDATES];
+            if (!checkSection<NearestGridHeader>(h, size, GRID, 1) ||
+                !checkSection<std::uint32_t>(h, size, GRID_CELLS, cells.size / sizeof(std::uint32_t)) ||
+                !checkSection<std::uint32_t>(h, size, GRID_CANDIDATES, candidates.size / sizeof(std::uint32_t)) ||
+                !grid.open(reinterpret_cast<const NearestGridHeader *>(data + h.sections[GRID].offset),
+                           reinterpret_cast<const std::uint32_t *>(data + cells.offset), cells.size / sizeof(std::uint32_t),
+                           reinterpret_cast<const std::uint32_t *>(data + candidates.offset), candidates.size / sizeof(std::uint32_t),
+                           records))
+            {
+                return "The dataset grid is not consistent with its header.";
+            }
+        }
+        const DatasetCountry *countries = reinterpret_cast<const DatasetCountry *>(data + h.sections[COUNTRIES].offset);
+        const std::size_t countryCount = h.sections[COUNTRIES].size / sizeof(DatasetCountry);
+        if (countryCount != 0)
+        {
+            if (!checkSection<DatasetCountry>(h, size, COUNTRIES, countryCount))
+            {
+                return "The dataset countries are not consistent with its header.";
+            }
+            // The ranges must cover the records in order, and the codes must be sorted for countryPartition
+            std::uint64_t next = 0;
+            for (std::size_t i = 0; i < countryCount; i++)
+            {
+                if (countries[i].first != next || countries[i].count == 0 || (i > 0 && std::memcmp(countries[i - 1].code, countries[i].code, 2) >= 0))
+                {
+                    return "The dataset countries are not consistent with its records.";
+                }
+                next += countries[i].count;
+            }
+            if (next != records)
+            {
+                return "The dataset countries are not consistent with its records.";
+            }
+        }
+        // Only the sizes are checked here, SpatialIndex::open checks the arrays themselves
+        std::optional<SpatialIndexArrays> spatialIndex = std::nullopt;
+        if (h.sections[SPATIAL_INDEX].size != 0)
+        {
+            if (!checkSection<DatasetSpatialIndex>(h, size, SPATIAL_INDEX, 1))
+            {
+                return "The dataset spatial index is not consistent with its header.";
+            }
+            const auto &description = *reinterpret_cast<const DatasetSpatialIndex *>(data + h.sections[SPATIAL_INDEX].offset);
+            if (!checkSection<SpatialIndexNode>(h, size, SPATIAL_INDEX_NODES, description.nodeCount) ||
+                !checkSection<double>(h, size, SPATIAL_INDEX_XS, records) ||
+                !checkSection<double>(h, size, SPATIAL_INDEX_YS, records) ||
+                !checkSection<double>(h, size, SPATIAL_INDEX_ZS, records) ||
+                !checkSection<std::int32_t>(h, size, SPATIAL_INDEX_IDS, records))
+            {
+                return "The dataset spatial index is not consistent with its header.";
+            }
+            // An index built with other leaves can not be searched by this reader, it builds its own
+            if (description.leafSize == SpatialIndex::LEAF_SIZE)
+            {
+                spatialIndex = SpatialIndexArrays{
+                    std::span<const SpatialIndexNode>(reinterpret_cast<const SpatialIndexNode *>(data + h.sections[SPATIAL_INDEX_NODES].offset), description.nodeCount),
+                    std::span<const double>(reinterpret_cast<const double *>(data + h.sections[SPATIAL_INDEX_XS].offset), records),
+                    std::span<const double>(reinterpret_cast<const double *>(data + h.sections[SPATIAL_INDEX_YS].offset), records),
+                    std::span<const double>(reinterpret_cast<const double *>(data + h.sections[SPATIAL_INDEX_ZS].offset), records),
+                    std::span<const std::int32_t>(reinterpret_cast<const std::int32_t *>(data + h.sections[SPATIAL_INDEX_IDS].offset), records)};
+            }
+        }
+        // Like the spatial index, only the sizes are checked here and a reader with other leaves ignores them
+        std::vector<std::size_t> countryNodeOffsets = {};
+        if (h.sections[COUNTRY_INDEX_IDS].size != 0)
+        {
+            countryNodeOffsets.push_back(0);
+            for (std::size_t i = 0; i < countryCount; i++)
+            {
+                countryNodeOffsets.push_back(countryNodeOffsets.back() + SpatialIndex::nodeCount(countries[i].count));
+            }
+            if (countryCount == 0 || h.sections[SPATIAL_INDEX].size == 0 ||
+                !checkSection<SpatialIndexNode>(h, size, COUNTRY_INDEX_NODES, countryNodeOffsets.back()) ||
+                !checkSection<double>(h, size, COUNTRY_INDEX_XS, records) ||
+                !checkSection<double>(h, size, COUNTRY_INDEX_YS, records) ||
+                !checkSection<double>(h, size, COUNTRY_INDEX_ZS, records) ||
+                !checkSection<std::int32_t>(h, size, COUNTRY_INDEX_IDS, records))
+            {
+                return "The dataset country indexes are not consistent with its header.";
+            }
+            if (!spatialIndex.has_value())
+            {
+                countryNodeOffsets.clear();
+            }
+        }
+        data_ = data;
+        header = &h;
+        grid_ = grid;
+        countries_ = countries;
+        countryCount_ = countryCount;
+        spatialIndex_ = spatialIndex;
+        countryNodeOffsets_ = std::move(countryNodeOffsets);
+        return std::nullopt;
+    }
+
+    std::size_t recordCount() const noexcept
+    {
+        return header->recordCount;
+    }
+    std::size_t languageCount() const noexcept
+    {
+        return header->languageCount;
+    }
+    const Microdegrees *latitudes() const noexcept
+    {
+        return section<Microdegrees>(LATITUDES);
+    }
+    const Microdegrees *longitudes() const noexcept
+    {
+        return section<Microdegrees>(LONGITUDES);
+    }
+    double latitude(const std::size_t record) const noexcept
+    {
+        return toDegrees(latitudes()[record]);
+    }
+    double longitude(const std::size_t record) const noexcept
+    {
+        return toDegrees(longitudes()[record]);
+    }
+    // Empty when the dataset was written without a grid
+    const NearestGridView &grid() const noexcept
+    {
+        return grid_;
+    }
+    // The country partitions sorted by code, empty when the records are not partitioned
+    std::span<const DatasetCountry> countries() const noexcept
+    {
+        return std::span<const DatasetCountry>(countries_, countryCount_);
+    }
+    // The partition of the records of code, nullptr when the dataset has none
+    const DatasetCountry *countryPartition(const std::string_view code) const noexcept
+    {
+        const auto found = std::lower_bound(countries_, countries_ + countryCount_, code, [](const DatasetCountry &country, const std::string_view c)
+                                            { return std::string_view(country.code, 2) < c; });
+        return found != countries_ + countryCount_ && std::string_view(found->code, 2) == code ? found : nullptr;
+    }
+    // The arrays of the stored spatial index for SpatialIndex::open, std::nullopt when the dataset has none
+    // or when it was built with a different LEAF_SIZE
+    const std::optional<SpatialIndexArrays> &spatialIndex() const noexcept
+    {
+        return spatialIndex_;
+    }
+    // The arrays of the stored index of the partition countries()[partition] for SpatialIndex::open, whose ids are
+    // relative to its first record. std::nullopt when the dataset has none or when it was built with a different LEAF_SIZE.
+    std::optional<SpatialIndexArrays> countryIndex(const std::size_t partition) const noexcept
+    {
+        if (countryNodeOffsets_.empty())
+        {
+            return std::nullopt;
+        }
+        const DatasetCountry &country = countries_[partition];
+        const std::size_t nodeOffset = countryNodeOffsets_[partition];
+        return SpatialIndexArrays{
+            std::span<const SpatialIndexNode>(section<SpatialIndexNode>(COUNTRY_INDEX_NODES) + nodeOffset, countryNodeOffsets_[partition + 1] - nodeOffset),
+            std::span<const double>(section<double>(COUNTRY_INDEX_XS) + country.first, country.count),
+            std::span<const double>(section<double>(COUNTRY_INDEX_YS) + country.first, country.count),
+            std::span<const double>(section<double>(COUNTRY_INDEX_ZS) + country.first, country.count),
+            std::span<const std::int32_t>(section<std::int32_t>(COUNTRY_INDEX_IDS) + country.first, country.count)};
+    }
+    std::string_view string(const std::uint32_t id) const noexcept
+    {
+        const auto *offsets = section<std::uint32_t>(STRING_OFFSETS);
+        return std::string_view(section<char>(STRING_BYTES) + offsets[id], offsets[id + 1] - offsets[id]);
+    }
+    std::string_view countryCode(const std::size_t record) const noexcept
+    {
+        return std::string_view(section<std::array<char, 2>>(COUNTRY_CODES)[record].data(), 2);
+    }
+    std::string_view timezone(const std::size_t record) const noexcept
+    {
+        return string(section<std::uint32_t>(TIMEZONES)[record]);
+    }
+    std::uint32_t population(const std::size_t record) const noexcept
+    {
+        return section<std::uint32_t>(POPULATIONS)[record];
+    }
+    // Records with the same feature code have the same id
+    std::uint32_t featureCodeId(const std::size_t record) const noexcept
+    {
+        return section<std::uint32_t>(FEATURE_CODES)[record];
+    }
+    std::string_view featureCode(const std::size_t record) const noexcept
+    {
+        return string(featureCodeId(record));
+    }
+    std::string_view latinized(const std::size_t record, const DatasetName name) const noexcept
+    {
+        return string(section<std::uint32_t>(LATINIZED)[record * DATASET_NAME_COUNT + name]);
+    }
+    std::string_view language(const std::size_t language) const noexcept
+    {
+        return std::string_view(section<std::array<char, 2>>(LANGUAGES)[language].data(), 2);
+    }
+    // Returns std::nullopt when the record has no localization for language, open checks that its names are all present or all absent
+    std::optional<std::string_view> localized(const std::size_t record, const std::size_t language, const DatasetName name) const noexcept
+    {
+        const auto id = section<std::uint32_t>(LOCALIZED)[(record * header->languageCount + language) * DATASET_NAME_COUNT + name];
+        if (id == DATASET_ABSENT_STRING)
+        {
+            return std::nullopt;
+        }
+        return string(id);
+    }
+};
+
+#endif // !__HEADER_DATASETFORMAT_HPP_CPP_
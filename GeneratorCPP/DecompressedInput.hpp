@@ -0,0 +1,453 @@
+#ifndef __HEADER_DECOMPRESSEDINPUT_HPP_CPP_
+#define __HEADER_DECOMPRESSEDINPUT_HPP_CPP_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#include <zlib.h>
+
+#include "MemoryMappedFile.hpp"
+
+// Reads the GeoNames dumps as they are distributed, a gzip file or a zip archive, without writing the
+// uncompressed file to disk. The archive is memory mapped and inflated with zlib on its own thread,
+// which hands out blocks of whole lines so decompression overlaps with parsing.
+//
+// Only the stored and deflate methods of zip are supported, ZIP64 archives are not.
+
+// Whether the file at path starts with the magic bytes of a gzip file or a zip archive
+inline bool isCompressedFile(const std::string &path) noexcept
+{
+    std::ifstream file = std::ifstream(path, std::ios::in | std::ios::binary);
+    char magic[4] = {};
+    if (!file.read(magic, sizeof(magic)))
+    {
+        return false;
+    }
+    const bool isGzip = static_cast<unsigned char>(magic[0]) == 0x1f && static_cast<unsigned char>(magic[1]) == 0x8b;
+    const bool isZip = std::memcmp(magic, "PK\x03\x04", 4) == 0;
+    return isGzip || isZip;
+}
+
+// The blocks of uncompressed text of a gzip file or of one entry of a zip archive, in file order.
+// Every block ends directly after a '\n' except the last one, so no line is split between blocks.
+// next can be called from several threads, the index of a block tells its position in the file.
+class DecompressedBlocks
+{
+public:
+    struct Block
+    {
+        std::size_t index;
+        std::string text;
+    };
+
+private:
+    static constexpr std::size_t BLOCK_SIZE = 4 << 20;
+    static constexpr std::size_t INFLATE_STEP = 256 << 10;
+
+    MemoryMappedFile file = {};
+    // The compressed bytes of the gzip file or zip entry
+    std::string_view input = {};
+    bool isGzip = false;
+    // 0 for stored, 8 for deflate
+    std::uint16_t zipMethod = 0;
+
+    std::mutex mutex = {};
+    std::condition_variable notFull = {};
+    std::condition_variable notEmpty = {};
+    std::deque<Block> queue = {};
+    std::size_t capacity = 0;
+    bool finished = false;
+    bool stopping = false;
+    std::string error_ = {};
+    std::thread thread = {};
+
+    static std::uint32_t readLE(const char *p, const std::size_t bytes) noexcept
+    {
+        std::uint32_t value = 0;
+        for (std::size_t i = 0; i < bytes; i++)
+        {
+            value |= std::uint32_t(static_cast<unsigned char>(p[i])) << (8 * i);
+        }
+        return value;
+    }
+
+    // Finds the entry to read in the central directory: the .txt named like the archive, otherwise the first .txt, otherwise the first entry
+    std::optional<std::string> openZipEntry(const std::string &path) noexcept
+    {
+        const auto view = file.view();
+        constexpr std::size_t EOCD_SIZE = 22;
+        if (view.size() < EOCD_SIZE)
+        {
+            return "The zip archive is too small.";
+        }
+        std::size_t eocd = std::string_view::npos;
+        for (std::size_t i = view.size() - EOCD_SIZE + 1; i-- > 0 && view.size() - i <= EOCD_SIZE + 0xFFFF;)
+        {
+            if (readLE(view.data() + i, 4) == 0x06054b50)
+            {
+                eocd = i;
+                break;
+            }
+        }
+        if (eocd == std::string_view::npos)
+        {
+            return "The zip archive has no end of central directory.";
+        }
+        const std::size_t entryCount = readLE(view.data() + eocd + 10, 2);
+        std::size_t position = readLE(view.data() + eocd + 16, 4);
+        if (entryCount == 0xFFFF || position == 0xFFFFFFFF)
+        {
+            return "ZIP64 archives are not supported.";
+        }
+
+        const std::string filename = path.substr(path.find_last_of("/\\") + 1);
+        const std::string expected = filename.substr(0, filename.find_last_of('.')) + ".txt";
+        struct Entry
+        {
+            std::string name;
+            std::uint16_t method;
+            std::uint32_t compressedSize;
+            std::uint32_t localHeader;
+        };
+        std::optional<Entry> chosen = std::nullopt;
+        int chosenRank = 3;
+        for (std::size_t i = 0; i < entryCount; i++)
+        {
+            if (position + 46 > view.size() || readLE(view.data() + position, 4) != 0x02014b50)
+            {
+                return "The zip central directory is corrupted.";
+            }
+            const char *header = view.data() + position;
+            const std::size_t nameLength = readLE(header + 28, 2);
+            const std::size_t extraLength = readLE(header + 30, 2);
+            const std::size_t commentLength = readLE(header + 32, 2);
+            if (position + 46 + nameLength > view.size())
+            {
+                return "The zip central directory is corrupted.";
+            }
+            Entry entry = {std::string(header + 46, nameLength), static_cast<std::uint16_t>(readLE(header + 10, 2)), readLE(header + 20, 4), readLE(header + 42, 4)};
+            const std::string entryFilename = entry.name.substr(entry.name.find_last_of('/') + 1);
+            const int rank = entryFilename == expected ? 0 : entry.name.ends_with(".txt") ? 1 : 2;
+            if (rank < chosenRank)
+            {
+                chosen = entry;
+                chosenRank = rank;
+            }
+            position += 46 + nameLength + extraLength + commentLength;
+        }
+        if (!chosen.has_value())
+        {
+            return "The zip archive is empty.";
+        }
+        if (chosen->compressedSize == 0xFFFFFFFF || chosen->localHeader == 0xFFFFFFFF)
+        {
+            return "ZIP64 archives are not supported.";
+        }
+        if (chosen->method != 0 && chosen->method != 8)
+        {
+            return "The zip entry \"" + chosen->name + "\" uses an unsupported compression method.";
+        }
+        const std::size_t local = chosen->localHeader;
+        if (local + 30 > view.size() || readLE(view.data() + local, 4) != 0x04034b50)
+        {
+            return "The zip local header of \"" + chosen->name + "\" is corrupted.";
+        }
+        const std::size_t dataStart = local + 30 + readLE(view.data() + local + 26, 2) + readLE(view.data() + local + 28, 2);
+        if (dataStart > view.size() || chosen->compressedSize > view.size() - dataStart)
+        {
+            return "The zip entry \"" + chosen->name + "\" is truncated.";
+        }
+        input = view.substr(dataStart, chosen->compressedSize);
+        zipMethod = chosen->method;
+        return std::nullopt;
+    }
+
+    // Waits for room in the queue, returns false when the reader is being destroyed
+    bool push(std::string &&text, std::size_t &index) noexcept
+    {
+        std::unique_lock<std::mutex> lock = std::unique_lock<std::mutex>(mutex);
+        notFull.wait(lock, [&]()
+                     { return queue.size() < capacity || stopping; });
+        if (stopping)
+        {
+            return false;
+        }
+        queue.push_back({index++, std::move(text)});
+        notEmpty.notify_one();
+        return true;
+    }
+
+    void finish(std::string &&error) noexcept
+    {
+        const std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(mutex);
+        error_ = std::move(error);
+        finished = true;
+        notEmpty.notify_all();
+    }
+
+    void run() noexcept
+    {
+        std::size_t index = 0;
+        std::string block = {};
+        // Hands out every whole line of block once it is large enough, or everything when isLast
+        const auto emit = [&](const bool isLast)
+        {
+            if (block.size() < BLOCK_SIZE && !isLast)
+            {
+                return true;
+            }
+            std::size_t cut = block.size();
+            if (!isLast)
+            {
+                const auto newline = block.rfind('\n');
+                if (newline == std::string::npos)
+                {
+                    // A single line longer than a block, keep growing it
+                    return true;
+                }
+                cut = newline + 1;
+            }
+            if (cut == 0)
+            {
+                return true;
+            }
+            std::string rest = block.substr(cut);
+            block.resize(cut);
+            const bool pushed = push(std::move(block), index);
+            block = std::move(rest);
+            block.reserve(BLOCK_SIZE + INFLATE_STEP);
+            return pushed;
+        };
+
+        if (!isGzip && zipMethod == 0)
+        {
+            for (std::size_t position = 0; position < input.size(); position += BLOCK_SIZE)
+            {
+                block.append(input.substr(position, BLOCK_SIZE));
+                if (!emit(false))
+                {
+                    return;
+                }
+            }
+            emit(true);
+            finish("");
+            return;
+        }
+
+        z_stream stream = {};
+        // 16 + MAX_WBITS reads the gzip wrapper, a negative size reads the raw deflate data of a zip entry
+        if (inflateInit2(&stream, isGzip ? 16 + MAX_WBITS : -MAX_WBITS) != Z_OK)
+        {
+            finish("Could not initialize zlib.");
+            return;
+        }
+        std::size_t consumed = 0;
+        std::string error = {};
+        while (true)
+        {
+            if (stream.avail_in == 0 && consumed < input.size())
+            {
+                // avail_in is 32 bits, large files are fed a slice at a time
+                const std::size_t slice = std::min<std::size_t>(input.size() - consumed, 1u << 30);
+                stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.data() + consumed));
+                stream.avail_in = static_cast<uInt>(slice);
+                consumed += slice;
+            }
+            const std::size_t previousSize = block.size();
+            block.resize(previousSize + INFLATE_STEP);
+            stream.next_out = reinterpret_cast<Bytef *>(block.data() + previousSize);
+            stream.avail_out = static_cast<uInt>(INFLATE_STEP);
+            const int result = inflate(&stream, Z_NO_FLUSH);
+            block.resize(previousSize + INFLATE_STEP - stream.avail_out);
+
+            if (result == Z_STREAM_END)
+            {
+                // A gzip file may hold several members back to back
+                const std::size_t remaining = stream.avail_in + (input.size() - consumed);
+                if (isGzip && remaining >= 2 && static_cast<unsigned char>(input[input.size() - remaining]) == 0x1f)
+                {
+                    inflateReset(&stream);
+                    continue;
+                }
+                break;
+            }
+            if (result == Z_BUF_ERROR && stream.avail_in == 0 && consumed == input.size())
+            {
+                error = "The compressed file is truncated.";
+                break;
+            }
+            if (result != Z_OK && result != Z_BUF_ERROR)
+            {
+                error = std::string("The compressed file is corrupted: ") + (stream.msg != nullptr ? stream.msg : "unknown zlib error") + ".";
+                break;
+            }
+            if (!emit(false))
+            {
+                inflateEnd(&stream);
+                return;
+            }
+        }
+        inflateEnd(&stream);
+        emit(true);
+        finish(std::move(error));
+    }
+
+    // Maps the file and finds its compressed bytes
+    std::optional<std::string> openInput(const std::string &path) noexcept
+    {
+        if (!file.open(path))
+        {
+            return "Could not memory map \"" + path + "\".";
+        }
+        const auto view = file.view();
+        isGzip = view.size() >= 2 && static_cast<unsigned char>(view[0]) == 0x1f && static_cast<unsigned char>(view[1]) == 0x8b;
+        if (isGzip)
+        {
+            input = view;
+            return std::nullopt;
+        }
+        if (view.starts_with("PK\x03\x04"))
+        {
+            return openZipEntry(path);
+        }
+        return "\"" + path + "\" is not a gzip file or zip archive.";
+    }
+
+public:
+    DecompressedBlocks() noexcept = default;
+    DecompressedBlocks(const DecompressedBlocks &) = delete;
+    DecompressedBlocks &operator=(const DecompressedBlocks &) = delete;
+    ~DecompressedBlocks()
+    {
+        {
+            const std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(mutex);
+            stopping = true;
+        }
+        notFull.notify_all();
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+
+    // Starts decompressing the file at path, at most queuedBlocks blocks wait to be parsed at a time.
+    // Returns an error message if the file is not a gzip file or zip archive that can be read, next then returns no block.
+    std::optional<std::string> open(const std::string &path, const std::size_t queuedBlocks) noexcept
+    {
+        auto error = openInput(path);
+        if (error.has_value())
+        {
+            finish(std::string(error.value()));
+            return error;
+        }
+        capacity = std::max<std::size_t>(1, queuedBlocks);
+        thread = std::thread([this]()
+                             { run(); });
+        return std::nullopt;
+    }
+
+    // Waits for the next block, returns std::nullopt once every block was handed out
+    std::optional<Block> next() noexcept
+    {
+        std::unique_lock<std::mutex> lock = std::unique_lock<std::mutex>(mutex);
+        notEmpty.wait(lock, [&]()
+                      { return !queue.empty() || finished; });
+        if (queue.empty())
+        {
+            return std::nullopt;
+        }
+        Block block = std::move(queue.front());
+        queue.pop_front();
+        notFull.notify_one();
+        return block;
+    }
+
+    // Empty unless decompression stopped early, only meaningful once next returned std::nullopt
+    std::string error() noexcept
+    {
+        const std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(mutex);
+        return error_;
+    }
+};
+
+// Reads the lines of a text file the way std::getline would.
+// Gzip files and zip archives are decompressed on another thread while the lines are read.
+class LineReader
+{
+    std::ifstream file = {};
+    std::string line = {};
+    std::unique_ptr<DecompressedBlocks> blocks = nullptr;
+    std::string block = {};
+    std::size_t position = 0;
+
+public:
+    // Returns false if the file could not be opened
+    bool open(const std::string &path) noexcept
+    {
+        if (isCompressedFile(path))
+        {
+            blocks = std::make_unique<DecompressedBlocks>();
+            if (const auto error = blocks->open(path, 2); error.has_value())
+            {
+                std::cerr << error.value() << "\n";
+                blocks = nullptr;
+                return false;
+            }
+            return true;
+        }
+        file.open(path);
+        return file.good();
+    }
+
+    // The line stays valid until the next call
+    bool next(std::string_view &out) noexcept
+    {
+        if (blocks == nullptr)
+        {
+            if (!std::getline(file, line))
+            {
+                return false;
+            }
+            out = line;
+            return true;
+        }
+        while (position >= block.size())
+        {
+            auto nextBlock = blocks->next();
+            if (!nextBlock.has_value())
+            {
+                if (const auto error = blocks->error(); !error.empty())
+                {
+                    std::cerr << error << "\n";
+                }
+                return false;
+            }
+            block = std::move(nextBlock->text);
+            position = 0;
+        }
+        auto end = block.find('\n', position);
+        if (end == std::string::npos)
+        {
+            end = block.size();
+        }
+        out = std::string_view(block).substr(position, end - position);
+        position = end + 1;
+        return true;
+    }
+};
+
+#endif // !__HEADER_DECOMPRESSEDINPUT_HPP_CPP_
@@ -7,6 +7,20 @@
 #include <set>
 #include <filesystem>
 #include <optional>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <array>
+#include <span>
+#include <limits>
+#include <cstdint>
+#include <cctype>
+#include <charconv>
+#include <memory>
 
 #ifdef _DEBUG
 #define DBOUT std::cout // or any other ostream
@@ -16,15 +30,22 @@
 
 #include <nlohmann/json.hpp>
 #include "StringSplit.hpp"
+#include "MemoryMappedFile.hpp"
+#include "DatasetFormat.hpp"
+#include "JsonWriter.hpp"
+#include "DecompressedInput.hpp"
+#include "Microdegrees.hpp"
+#include "Instrumentation.hpp"
 
 template <std::size_t n>
 class NCharString
 {
     std::array<char, n> c = {};
-    unsigned char size_;
+    unsigned char size_ = 0;
 
 public:
-    NCharString(std::string_view sv)
+    NCharString() noexcept = default;
+    NCharString(std::string_view sv) noexcept
     {
         std::size_t i = 0;
         for (; i < sv.size() && i < n; i++)
@@ -35,7 +56,7 @@ public:
     }
     std::string_view toStringView() const noexcept
     {
-        return std::string_view(c.begin(), c.end());
+        return std::string_view(c.data(), size_);
     }
     std::string toString() const noexcept
     {
@@ -93,11 +114,57 @@ typedef std::string Admin1Code;
 
 typedef std::string IANATimezone;
 
+// Index of a language in SELECTED_LANGUAGES
+typedef std::uint16_t LanguageId;
+
+// Maps the ISO 639-1 codes of the selected languages to a LanguageId without allocating
+class LanguageIds
+{
+    // One slot per pair of lowercase letters, -1 when the language is not selected
+    std::array<std::int16_t, 26 * 26> ids = {};
+    std::vector<ISOLanguage> languages = {};
+
+public:
+    LanguageIds(const std::set<ISOLanguage> &SELECTED_LANGUAGES) noexcept
+    {
+        ids.fill(-1);
+        for (const auto &language : SELECTED_LANGUAGES)
+        {
+            if (language.size() == 2 && std::islower(static_cast<unsigned char>(language[0])) && std::islower(static_cast<unsigned char>(language[1])))
+            {
+                ids[(language[0] - 'a') * 26 + (language[1] - 'a')] = static_cast<std::int16_t>(languages.size());
+                languages.push_back(language);
+            }
+        }
+    }
+    std::optional<LanguageId> find(const std::string_view language) const noexcept
+    {
+        if (language.size() != 2 || language[0] < 'a' || language[0] > 'z' || language[1] < 'a' || language[1] > 'z')
+        {
+            return std::nullopt;
+        }
+        const auto id = ids[(language[0] - 'a') * 26 + (language[1] - 'a')];
+        if (id < 0)
+        {
+            return std::nullopt;
+        }
+        return static_cast<LanguageId>(id);
+    }
+    const ISOLanguage &language(const LanguageId id) const noexcept
+    {
+        return languages[id];
+    }
+    std::size_t size() const noexcept
+    {
+        return languages.size();
+    }
+};
+
 struct LocalizedNames
 {
-    std::string cityName;
-    std::string admin1Name;
-    std::string countryName;
+    std::string_view cityName;
+    std::string_view admin1Name;
+    std::string_view countryName;
 
     void toStreamAsTxt(std::ostream &os) const noexcept
     {
@@ -105,479 +172,2243 @@ struct LocalizedNames
     }
 };
 
+// The coordinates are parsed once when the record is built and kept in fixed point
 struct GeoLocation
 {
-    IANATimezone timezone;
-    std::string latitude;
-    std::string longitude;
+    std::string_view timezone;
+    Microdegrees latitude = 0;
+    Microdegrees longitude = 0;
 
     void toStreamAsTxt(std::ostream &os) const noexcept
     {
-        os << timezone << '\t' << latitude << '\t' << longitude;
+        std::array<char, MICRODEGREES_TEXT_SIZE> buffer = {};
+        os << timezone << '\t';
+        os.write(buffer.data(), static_cast<std::streamsize>(formatMicrodegrees(buffer.data(), latitude)));
+        os << '\t';
+        os.write(buffer.data(), static_cast<std::streamsize>(formatMicrodegrees(buffer.data(), longitude)));
     }
 };
 
+// The strings of a record are views into the line of the cities file and the tables parseCities loads,
+// so building one does not allocate. They stay valid until the sink returns from write.
 struct Record
 {
     GeoNameId gni;
-    ISOCountryCode countryCode;
+    NCharString<2> countryCode;
     GeoLocation location;
+    // Only the binary format writes these, for the filtered queries of QueryCPP
+    std::uint32_t population = 0;
+    std::string_view featureCode;
     LocalizedNames latinizedName;
-    std::map<ISOLanguage, LocalizedNames> localizedNames;
+    // One slot per LanguageId of languageIds, std::nullopt when the record has no localization for the language
+    std::vector<std::optional<LocalizedNames>> localizedNames;
+    const LanguageIds *languageIds = nullptr;
 
+    std::size_t localizedCount() const noexcept
+    {
+        return static_cast<std::size_t>(std::count_if(localizedNames.begin(), localizedNames.end(), [](const auto &slot)
+                                                      { return slot.has_value(); }));
+    }
+
+    // The languages are written in LanguageId order, which is the order of their ISO 639-1 codes
     void toStreamAsTxt(std::ostream &os) const noexcept
     {
-        os << countryCode << '\t';
+        os << countryCode.toStringView() << '\t';
         location.toStreamAsTxt(os);
         os << '\t';
         latinizedName.toStreamAsTxt(os);
         os << '\t';
-        os << localizedNames.size() << '\t';
-        for (const auto &kv : localizedNames)
+        os << localizedCount() << '\t';
+        for (LanguageId language = 0; language < localizedNames.size(); language++)
         {
-            os << kv.first << '\t';
-            kv.second.toStreamAsTxt(os);
-            os << '\t';
+            if (localizedNames[language].has_value())
+            {
+                os << languageIds->language(language) << '\t';
+                localizedNames[language]->toStreamAsTxt(os);
+                os << '\t';
+            }
         }
     }
 };
 
-std::unordered_map<GeoNameId, std::map<ISOLanguage, std::pair<std::string, bool>>> parseAlternateNames(
-    const std::string &alternateNamesPath,
-    const std::set<ISOLanguage> &SELECTED_LANGUAGES,
-    const std::set<ISOCountryCode> &SELECTED_COUNTRIES) noexcept
+// Receives every record parseCities creates, in the order of the cities file
+class RecordSink
+{
+public:
+    virtual ~RecordSink() = default;
+    virtual void write(const Record &r) noexcept = 0;
+    // Called once after the last record
+    virtual void finish() noexcept {}
+    // Adds the sizes of the tables the sink built to the stats of stage
+    virtual void describe(Stage &) const noexcept {}
+};
+
+// Writes values seperated by '\t' and entries by '\n'
+class TxtRecordSink : public RecordSink
 {
-    // GeoNameId -> { ISOLanguage, { alternativeName, isPreferred } }
-    std::unordered_map<GeoNameId,
-                       std::map<ISOLanguage,
-                                std::pair<std::string, bool>>>
-        alternateData = {};
+    std::ostream &os;
 
-    std::ifstream inputFile = std::ifstream(alternateNamesPath);
-    std::size_t lineNumber = 0;
-    for (std::string line; std::getline(inputFile, line);)
+public:
+    TxtRecordSink(std::ostream &os) : os{os} {}
+
+    void write(const Record &r) noexcept override
     {
-        lineNumber++;
-        if (lineNumber % 100'000 == 0)
-        {
-            std::cout << "Currently on line " << lineNumber << "\n";
-        }
-        const auto strvs = split<5>(line, '\t');
+        r.toStreamAsTxt(os);
+        os << '\n';
+    }
+};
 
-        const auto languageSV = strvs.at(2);
-        const auto languageSize = languageSV.size();
+// Writes the same JSON array generate.js creates from the txt file, one element per record:
+// [countryCode, timezone, [cityName, admin1Name, countryName], [[language, cityName, admin1Name, countryName], ...], latitude, longitude]
+// Without localized names the language array of every record is empty, like the base of PackRecordSink.
+class JsonRecordSink : public RecordSink
+{
+    JsonWriter json;
+    bool isLocalized;
+    bool isFirst = true;
+    // Reused for every record
+    std::string upperCase = {};
+    std::string lowerCase = {};
 
-        if (languageSize > 2)
-        {
-            // The string is not an ISO language
-            DBOUT << lineNumber << " Skipping due to not ISO language, received: \"" << languageSV << "\"\n";
-            continue;
-        }
-        const ISOLanguage language = std::string(languageSV); // Will not allocate due to SSO
-        if (SELECTED_LANGUAGES.find(language) == SELECTED_LANGUAGES.end())
-        {
-            // The language is not selected, but is not the default
-            DBOUT << lineNumber << " Skipping due to not selected, received: \"" << languageSV << "\"\n";
-            continue;
-        }
+public:
+    JsonRecordSink(std::ostream &os, const bool isLocalized = true) : json{os}, isLocalized{isLocalized} {}
 
-        const GeoNameId geonameid = charDigitsToInt(strvs.at(1));
-        const bool isCurrentPreferred = strvs.at(4) == "1";
+    void write(const Record &r) noexcept override
+    {
+        json.raw(isFirst ? '[' : ',');
+        isFirst = false;
 
-        auto languageNameMap = alternateData.find(geonameid);
-        if (alternateData.find(geonameid) == alternateData.end())
-        {
-            // The geonameid key doesn't exist, create its map
+        upperCase.assign(r.countryCode.toStringView());
+        std::transform(upperCase.begin(), upperCase.end(), upperCase.begin(), [](const unsigned char c)
+                       { return static_cast<char>(std::toupper(c)); });
+        json.raw('[');
+        json.string(upperCase);
+        json.raw(',');
+        json.string(r.location.timezone);
 
-            DBOUT << lineNumber << " Creating entry for " << geonameid << " since it didn't exist\n";
-            const std::string alternativeName = std::string(strvs.at(3));
-            alternateData.insert({geonameid, {{language, {alternativeName, isCurrentPreferred}}}});
-        }
-        else
+        json.raw(",[");
+        json.string(r.latinizedName.cityName);
+        json.raw(',');
+        json.string(r.latinizedName.admin1Name);
+        json.raw(',');
+        json.string(r.latinizedName.countryName);
+        json.raw("],[");
+        bool isFirstLanguage = true;
+        for (LanguageId language = 0; isLocalized && language < r.localizedNames.size(); language++)
         {
-            // Check if language key already exists
-            auto &languageAlternateNameInfo = languageNameMap->second;
-            auto alternateNameInfo = languageAlternateNameInfo.find(language);
-            if (alternateNameInfo == languageAlternateNameInfo.end())
+            if (!r.localizedNames[language].has_value())
             {
-                // The language has not yet been inserted.
-                DBOUT << lineNumber << " Creating entry for " << geonameid << " (" << language << ") since it didn't exist.\n";
-                const std::string alternativeName = std::string(strvs.at(3));
-                languageAlternateNameInfo.insert({language, {alternativeName, isCurrentPreferred}});
-            }
-            else
-            {
-                auto &nameInfo = alternateNameInfo->second;
-                if (!nameInfo.second && isCurrentPreferred)
-                {
-                    // The existing entry is not preferred and the
-                    // current line has the preferred entry
-                    DBOUT << lineNumber << " Replacing entry for " << geonameid << " (" << language << ") since new entry has preferrence.\n";
-                    const std::string alternativeName = std::string(strvs.at(3));
-                    nameInfo.first = alternativeName;
-                }
-                else
-                {
-                    DBOUT << lineNumber << " Didn't place " << geonameid << " (" << language << ") since there was already an entry.\n";
-                }
+                continue;
             }
+            const auto &names = r.localizedNames[language].value();
+            lowerCase.assign(r.languageIds->language(language));
+            std::transform(lowerCase.begin(), lowerCase.end(), lowerCase.begin(), [](const unsigned char c)
+                           { return static_cast<char>(std::tolower(c)); });
+            json.raw(isFirstLanguage ? "[" : ",[");
+            isFirstLanguage = false;
+            json.string(lowerCase);
+            json.raw(',');
+            json.string(names.cityName);
+            json.raw(',');
+            json.string(names.admin1Name);
+            json.raw(',');
+            json.string(names.countryName);
+            json.raw(']');
         }
+        json.raw("],");
+        json.number(toDegrees(r.location.latitude));
+        json.raw(',');
+        json.number(toDegrees(r.location.longitude));
+        json.raw(']');
     }
-    std::cout << "Finished creating \"alternateData\"\n";
-    return alternateData;
-}
-
-void printAdminDataMap(const std::unordered_map<Admin1Code, std::pair<std::string, GeoNameId>> &m)
-{
-    std::cout << "\n==========PRINT AdminData MAP==========\n";
-    for (const auto &kvAdmin1Code : m)
+    void finish() noexcept override
     {
-        std::cout << "Admin1Code: " << kvAdmin1Code.first << "\n";
-        const auto &nameGeoId = kvAdmin1Code.second;
-        std::cout << "\tLatinized: " << nameGeoId.first << "\n";
-        std::cout << "\tGeoNameId: " << nameGeoId.second << "\n";
+        if (isFirst)
+        {
+            json.raw('[');
+        }
+        json.raw(']');
+        json.flush();
     }
-    std::cout << "\n==========PRINT AdminData MAP==========\n";
-}
+};
 
-std::unordered_map<Admin1Code, std::pair<std::string, GeoNameId>> parseAdminData(const std::string &admin1CodesASCIIPath)
+// Writes a base pack and one name pack per language, so a query engine only loads the languages it is asked for.
+// The base pack is the json format without localized names, Geocode.Init can read it alone. The name pack of a
+// language is a JSON array with [cityName, admin1Name, countryName] for each record of the base pack, or null when
+// the record has no names in that language. The manifest lists them:
+// {"records": 2, "base": "base.json", "languages": {"fr": "names-fr.json"}}
+class PackRecordSink : public RecordSink
 {
+    std::ostream &manifest;
+    JsonRecordSink base;
+    std::vector<ISOLanguage> languages;
+    // One writer per language, in the order of languages
+    std::vector<std::unique_ptr<JsonWriter>> names = {};
+    std::size_t recordCount = 0;
 
-    // Admin1Code -> { LatinizedName, GeoNameId }
-    std::unordered_map<Admin1Code, std::pair<std::string, GeoNameId>> adminData = {};
+public:
+    static constexpr std::string_view MANIFEST_FILENAME = "packs.json";
+    static constexpr std::string_view BASE_FILENAME = "base.json";
 
-    std::ifstream inputFile = std::ifstream(admin1CodesASCIIPath);
-    std::size_t lineNumber = 0;
-    for (std::string line; std::getline(inputFile, line);)
+    static std::string namesFilename(const std::string_view language) noexcept
     {
-        lineNumber++;
-        if (lineNumber % 100 == 0)
+        return "names-" + std::string(language) + ".json";
+    }
+
+    // namesStreams holds the stream of each language of SELECTED_LANGUAGES, in the same order
+    PackRecordSink(std::ostream &manifest, std::ostream &baseStream, const std::set<ISOLanguage> &SELECTED_LANGUAGES, const std::vector<std::ostream *> &namesStreams)
+        : manifest{manifest}, base{baseStream, false}, languages{SELECTED_LANGUAGES.begin(), SELECTED_LANGUAGES.end()}
+    {
+        for (const auto os : namesStreams)
         {
-            std::cout << "Currently on line " << lineNumber << "\n";
+            names.push_back(std::make_unique<JsonWriter>(*os));
         }
-        const auto strvs = split<4>(line, '\t');
+    }
 
-        const Admin1Code admin1code = std::string(strvs.at(0));
-        if (auto it = adminData.find(admin1code); it == adminData.end())
+    void write(const Record &r) noexcept override
+    {
+        base.write(r);
+        for (std::size_t i = 0; i < languages.size(); i++)
         {
-            const GeoNameId geonameid = charDigitsToInt(strvs.at(3));
-            const std::string latinName = std::string(strvs.at(1));
-            DBOUT << lineNumber << " Inserting Admin1Code \"" << admin1code << "\" with geonameid \"" << geonameid << "\"\n";
-            adminData.insert({admin1code, {latinName, geonameid}});
+            JsonWriter &json = *names[i];
+            json.raw(recordCount == 0 ? '[' : ',');
+            const auto language = r.languageIds->find(languages[i]);
+            if (!language.has_value() || !r.localizedNames[language.value()].has_value())
+            {
+                json.raw("null");
+                continue;
+            }
+            const auto &localized = r.localizedNames[language.value()].value();
+            json.raw('[');
+            json.string(localized.cityName);
+            json.raw(',');
+            json.string(localized.admin1Name);
+            json.raw(',');
+            json.string(localized.countryName);
+            json.raw(']');
         }
-        else
+        recordCount++;
+    }
+    void finish() noexcept override
+    {
+        base.finish();
+        nlohmann::json files = nlohmann::json::object();
+        for (std::size_t i = 0; i < languages.size(); i++)
         {
-            DBOUT << lineNumber << " Skipping Admin1Code \"" << admin1code << "\" since it already exists.\n";
+            names[i]->raw(recordCount == 0 ? "[]" : "]");
+            names[i]->flush();
+            files[languages[i]] = namesFilename(languages[i]);
         }
+        const nlohmann::json json = {
+            {"records", recordCount},
+            {"base", BASE_FILENAME},
+            {"languages", files},
+        };
+        manifest << json.dump(4) << '\n';
     }
-    std::cout << "Finished creating \"adminData\"\n";
-
-    return adminData;
-}
+};
 
-class LocalizedCountryNameManager
+// Collects every record and writes them as a binary dataset once the last one is received, see DatasetFormat.hpp.
+// The records are partitioned by country, in the order they were received within each country, and stored with their spatial index.
+class BinaryRecordSink : public RecordSink
 {
-    std::string countryLocalizationsPath;
-    std::unordered_map<ISOLanguage, std::map<ISOCountryCode, std::string>> localizedCountryNames = {};
+    std::ostream &os;
+    std::vector<ISOLanguage> languages;
+    DatasetWriter writer;
+    // 0 when the dataset has no grid
+    std::uint32_t gridCellsPerDegree;
+    // Reused for every record
+    std::vector<std::optional<std::array<std::string_view, DATASET_NAME_COUNT>>> localized = {};
 
 public:
-    LocalizedCountryNameManager(const std::string &countryLocalizationsPath) : countryLocalizationsPath{countryLocalizationsPath} {}
+    BinaryRecordSink(std::ostream &os, const std::set<ISOLanguage> &SELECTED_LANGUAGES, const std::uint32_t gridCellsPerDegree)
+        : os{os}, languages{SELECTED_LANGUAGES.begin(), SELECTED_LANGUAGES.end()}, writer{languages}, gridCellsPerDegree{gridCellsPerDegree} {}
 
-    std::optional<std::string> getLocalizedCountryName(const ISOLanguage &lang, const ISOCountryCode &code) noexcept
+    void write(const Record &r) noexcept override
     {
-        // Check if exists in map first
-        if (const auto languageIter = localizedCountryNames.find(lang); languageIter != localizedCountryNames.end())
+        localized.assign(languages.size(), std::nullopt);
+        for (std::size_t i = 0; i < languages.size(); i++)
         {
-            const auto &countryMap = languageIter->second;
-            // The language exists in the map
-            if (const auto countryMapIter = countryMap.find(code); countryMapIter != countryMap.end())
-            {
-                return countryMapIter->second;
-            }
-            else
+            if (const auto language = r.languageIds->find(languages[i]); language.has_value() && r.localizedNames[language.value()].has_value())
             {
-                DBOUT << "The language doesn't exist in the map, and could not be loaded in.\n";
-                return std::nullopt;
+                const auto &names = r.localizedNames[language.value()].value();
+                localized[i] = {names.cityName, names.admin1Name, names.countryName};
             }
         }
-        else
+        writer.addRecord(
+            r.location.latitude,
+            r.location.longitude,
+            r.countryCode.toStringView(),
+            r.location.timezone,
+            r.population,
+            r.featureCode,
+            {r.latinizedName.cityName, r.latinizedName.admin1Name, r.latinizedName.countryName},
+            localized);
+    }
+    void finish() noexcept override
+    {
+        writer.partitionByCountry();
+        writer.buildIndex();
+        if (gridCellsPerDegree != 0)
         {
-            // The language doesn't exist in the map, read the file and add it
-            std::string filepath = countryLocalizationsPath;
-            filepath += lang;
-            filepath += ".json";
-            if (!std::filesystem::exists(filepath))
-            {
-                DBOUT << "The file: \"" << filepath << "\" does not exist.\n";
-                return std::nullopt;
-            }
-            DBOUT << "The file \"" << filepath << "\" exists, reading it.\n";
+            const auto &grid = writer.buildGrid(gridCellsPerDegree);
+            std::cout << "Finished creating the nearest city grid with " << grid.cells.size() << " cells, "
+                      << grid.listCells << " with candidates and " << grid.ambiguousCells << " ambiguous\n";
+        }
+        writer.write(os);
+    }
+    void describe(Stage &stage) const noexcept override
+    {
+        stage.table("datasetStrings.size", static_cast<double>(writer.stringCount()));
+        stage.table("datasetStrings.loadFactor", writer.stringLoadFactor());
+    }
+};
 
-            std::ifstream file = std::ifstream(filepath);
-            nlohmann::json json;
-            try
-            {
-                json = nlohmann::json::parse(file);
-            }
-            catch (std::exception e)
-            {
-                DBOUT << "Received an exception.\n\t" << e.what() << "\n";
-                return std::nullopt;
-            }
-            if (!json.is_object())
-            {
-                DBOUT << "Expected a JSON object, but didn't get one.\n";
-                return std::nullopt;
-            }
-            for (const auto &kv : json.items())
-            {
-                const auto &countryCode = kv.key();
-                if (countryCode.size() != 2)
-                {
-                    DBOUT << "Received invalid country code: \"" << countryCode << "\" for " << lang << ".\n";
-                    continue;
-                }
-                const auto &value = kv.value();
-                if (!value.is_string())
-                {
-                    DBOUT << "Value associated with country code \"" << countryCode << "\" was not a string for " << lang << ".\n";
-                    continue;
-                }
-                const std::string svalue = value.get<std::string>();
-                if (auto iter = localizedCountryNames.find(lang); iter != localizedCountryNames.end())
-                {
-                    DBOUT << "The language \"" << lang << "\" already exists in map, adding new value.\n";
-                    auto &countryLocalizationMap = iter->second;
-                    countryLocalizationMap[countryCode] = svalue;
-                }
-                else
-                {
-                    DBOUT << "Adding language \"" << lang << "\" to map.\n";
-                    localizedCountryNames.insert({lang, {{countryCode, svalue}}});
-                }
-            }
-            DBOUT << "Finished adding language \"" << lang << "\" to the map.\n";
-            if (const auto localizationIter = localizedCountryNames.find(lang); localizationIter != localizedCountryNames.end())
-            {
-                const auto &countryLocalizationMap = localizationIter->second;
-                if (const auto codeIter = countryLocalizationMap.find(code); codeIter != countryLocalizationMap.end())
-                {
-                    return codeIter->second;
-                }
-                else
-                {
-                    DBOUT << "Parsed \"" << filepath << "\" and coult not find code: " << code << "\n";
-                    return std::nullopt;
-                }
-            }
-            else
+// Passes sink the records of one output profile: the records of its countries with the names of its languages.
+// parseCities creates the records for every language and country of all profiles, a record only has names
+// for a language when that language has them, so each profile gets the same records as a run with its own selection.
+class ProfileRecordSink : public RecordSink
+{
+    std::unique_ptr<RecordSink> sink;
+    std::set<ISOLanguage> languages;
+    // Every country when empty
+    std::set<ISOCountryCode> countries;
+    // Reused for every record
+    Record filtered = {};
+
+public:
+    ProfileRecordSink(std::unique_ptr<RecordSink> sink, const std::set<ISOLanguage> &languages, const std::set<ISOCountryCode> &countries)
+        : sink{std::move(sink)}, languages{languages}, countries{countries} {}
+
+    void write(const Record &r) noexcept override
+    {
+        if (countries.size() != 0 && countries.find(r.countryCode.toString()) == countries.end())
+        {
+            return;
+        }
+        const auto isOtherLanguage = [&](const LanguageId language)
+        {
+            return r.localizedNames[language].has_value() && languages.find(r.languageIds->language(language)) == languages.end();
+        };
+        bool hasOtherLanguages = false;
+        for (LanguageId language = 0; language < r.localizedNames.size(); language++)
+        {
+            hasOtherLanguages = hasOtherLanguages || isOtherLanguage(language);
+        }
+        if (!hasOtherLanguages)
+        {
+            sink->write(r);
+            return;
+        }
+        // Copying into the reused record keeps the capacity of its slots
+        filtered = r;
+        for (LanguageId language = 0; language < filtered.localizedNames.size(); language++)
+        {
+            if (isOtherLanguage(language))
             {
-                DBOUT << "Parsed \"" << filepath << "\" and coult not find language: " << lang << "\n";
-                return std::nullopt;
+                filtered.localizedNames[language] = std::nullopt;
             }
         }
+        sink->write(filtered);
+    }
+    void finish() noexcept override
+    {
+        sink->finish();
+    }
+    void describe(Stage &stage) const noexcept override
+    {
+        sink->describe(stage);
     }
 };
 
-// Creates a txt file with values seperated by '\t' and entries by '\n'
-void parseCities(
-    std::ostream &outputFile,
-    const std::string &citiesPath,
-    const std::string &alternateNamesPath,
-    const std::set<ISOLanguage> &SELECTED_LANGUAGES,
-    const std::set<ISOCountryCode> &SELECTED_COUNTRIES,
-    const std::string &admin1CodesASCIIPath,
-    const std::string &countryLocalizationsPath) noexcept
+// Passes every record to each of its sinks, so one parse of the inputs writes several outputs
+class FanOutRecordSink : public RecordSink
 {
-    const auto alternateNamesMap = parseAlternateNames(alternateNamesPath, SELECTED_LANGUAGES, SELECTED_COUNTRIES);
-    const auto admin1Map = parseAdminData(admin1CodesASCIIPath);
+    std::vector<std::unique_ptr<RecordSink>> sinks;
 
-    std::ifstream inputFile = std::ifstream(citiesPath);
-    std::size_t lineNumber = 0;
-    for (std::string line; std::getline(inputFile, line);)
+public:
+    FanOutRecordSink(std::vector<std::unique_ptr<RecordSink>> &&sinks) : sinks{std::move(sinks)} {}
+
+    void write(const Record &r) noexcept override
     {
-        lineNumber++;
-        if (lineNumber % 1'000 == 0)
+        for (const auto &sink : sinks)
         {
-            std::cout << "Currently on line " << lineNumber << "\n";
+            sink->write(r);
         }
-        const auto strvs = split<18>(line, '\t');
-
-        // Set the country code
-        const ISOCountryCode countryCode = std::string(strvs.at(8));
-        if (SELECTED_COUNTRIES.size() != 0)
+    }
+    void finish() noexcept override
+    {
+        for (const auto &sink : sinks)
         {
-            if (SELECTED_COUNTRIES.find(countryCode) != SELECTED_COUNTRIES.end())
-            {
-                continue;
-            }
+            sink->finish();
         }
-        if (countryCode.size() != 2)
+    }
+    void describe(Stage &stage) const noexcept override
+    {
+        for (const auto &sink : sinks)
         {
-            DBOUT << lineNumber << " Received invalid country code, was not 2-characters. Received: \"" << countryCode << "\".\n";
-            continue;
+            sink->describe(stage);
         }
+    }
+};
 
-        Record r = {};
+// One alternate name, the name itself lives in the arena of the table that owns the entry
+struct AlternateNameEntry
+{
+    // 64 bits, the arena of allCountries with many languages can pass 4 GiB
+    std::uint64_t offset;
+    GeoNameId geonameid;
+    std::uint16_t length : 15;
+    std::uint16_t isPreferred : 1;
+    LanguageId language;
 
-        // Set the country code
-        r.countryCode = countryCode;
+    bool operator<(const AlternateNameEntry &other) const noexcept
+    {
+        return geonameid != other.geonameid ? geonameid < other.geonameid : language < other.language;
+    }
+    bool sameKey(const AlternateNameEntry &other) const noexcept
+    {
+        return geonameid == other.geonameid && language == other.language;
+    }
+};
 
-        // Set the geonameid
-        const GeoNameId geonameid = charDigitsToInt(strvs.at(0));
-        r.gni = geonameid;
+// Collects the alternate names of one part of alternateNames.txt
+struct AlternateNamesChunk
+{
+    std::string arena = {};
+    std::vector<AlternateNameEntry> entries = {};
 
-        // Set location/geographic data
-        r.location.timezone = static_cast<IANATimezone>(std::string(strvs.at(17)));
-        r.location.latitude = std::string(strvs.at(4));
-        r.location.longitude = std::string(strvs.at(5));
+    void add(const GeoNameId geonameid, const LanguageId language, const std::string_view name, const bool isPreferred) noexcept
+    {
+        if (name.size() >= (1u << 15))
+        {
+            DBOUT << "Skipping alternate name for " << geonameid << " since it does not fit in the table.\n";
+            return;
+        }
+        AlternateNameEntry entry = {};
+        entry.geonameid = geonameid;
+        entry.offset = arena.size();
+        entry.length = static_cast<std::uint16_t>(name.size());
+        entry.isPreferred = isPreferred;
+        entry.language = language;
+        entries.push_back(entry);
+        arena.append(name);
+    }
 
-        // Attempt to set admin1Name data for latinized and locale
+    // Sorts the entries by { GeoNameId, LanguageId } and keeps the names of a key that can win, in file order.
+    // The name of a key is the first name seen when it is preferred, otherwise the last preferred name,
+    // otherwise the first name seen. The first name and the last preferred name decide it, so only those are kept
+    // and AlternateNames applies the rule to the names kept by every chunk.
+    void sortAndDeduplicate() noexcept
+    {
+        std::stable_sort(entries.begin(), entries.end());
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < entries.size();)
         {
-            const Admin1Code admin1Code = countryCode + "." + std::string(strvs.at(10));
-            const auto admin1MapIter = admin1Map.find(admin1Code);
-            if (admin1MapIter != admin1Map.end())
-            {
-                // Found administrative region
-                const auto &p = admin1MapIter->second;
-                // Set the latinized admin1Name
-                r.latinizedName.admin1Name = p.first;
-                // Search for admin1 locale names
-                const GeoNameId admin1GNI = p.second;
-                if (const auto localeAdmin1NameIter = alternateNamesMap.find(admin1GNI); localeAdmin1NameIter != alternateNamesMap.end())
+            std::size_t lastPreferred = i;
+            std::size_t j = i;
+            for (; j < entries.size() && entries[j].sameKey(entries[i]); j++)
+            {
+                if (entries[j].isPreferred)
                 {
-                    const auto &languageMap = localeAdmin1NameIter->second;
-                    for (const auto &language : SELECTED_LANGUAGES)
-                    {
-                        // Loop through selected languages
-                        if (const auto languageMapIter = languageMap.find(language); languageMapIter != languageMap.end())
-                        {
-                            // An alternate name exists for the selected language
-                            const auto &localizedName = languageMapIter->second.first;
-                            const auto localizedIter = r.localizedNames.find(language);
-                            if (localizedIter != r.localizedNames.end())
-                            {
-                                // An entry already exists, add the new name
-                                localizedIter->second.admin1Name = localizedName;
-                            }
-                            else
-                            {
-                                // An entry does not exist, create it
-                                LocalizedNames ln = {};
-                                ln.admin1Name = localizedName;
-                                r.localizedNames.insert({language, ln});
-                            }
-                        }
-                    }
+                    lastPreferred = j;
                 }
-                DBOUT << lineNumber << " Finished setting admin1 names.\n";
             }
-            else
+            entries[kept++] = entries[i];
+            if (lastPreferred != i)
             {
-                // Can't find administrative region
-                DBOUT << lineNumber << " Could not find admin1 code.\n";
+                entries[kept++] = entries[lastPreferred];
             }
+            i = j;
         }
+        entries.resize(kept);
+        entries.shrink_to_fit();
+    }
+};
 
-        // Atempt to set cityName for latinized and locale
+// GeoNameId -> { LanguageId, alternativeName }
+// The names are stored back to back in one arena and the entries are
+// sorted by { GeoNameId, LanguageId }, so a lookup is a binary search
+// and all languages of a GeoNameId are adjacent.
+class AlternateNames
+{
+    std::string arena = {};
+    std::vector<AlternateNameEntry> entries = {};
+
+public:
+    AlternateNames() noexcept = default;
+
+    // Merges chunks that were each sorted and deduplicated, in file order.
+    // The rule of AlternateNamesChunk::sortAndDeduplicate is applied across chunks,
+    // so the result is the same as if the whole file was a single chunk.
+    AlternateNames(std::vector<AlternateNamesChunk> &&chunks) noexcept
+    {
+        std::size_t entryCount = 0;
+        for (const auto &chunk : chunks)
         {
-            // Set the latinized city name
-            r.latinizedName.cityName = std::string(strvs.at(1));
-            const auto altNameIter = alternateNamesMap.find(geonameid);
-            if (altNameIter != alternateNamesMap.end())
+            entryCount += chunk.entries.size();
+        }
+        entries.reserve(entryCount);
+
+        // Min-heap of chunk indices by the key of their next entry, ties go to the earlier chunk
+        std::vector<std::size_t> positions = std::vector<std::size_t>(chunks.size(), 0);
+        const auto later = [&](const std::size_t a, const std::size_t b)
+        {
+            const auto &ea = chunks[a].entries[positions[a]];
+            const auto &eb = chunks[b].entries[positions[b]];
+            if (ea.sameKey(eb))
             {
-                const auto &languageMap = altNameIter->second;
-                for (const auto &language : SELECTED_LANGUAGES)
-                {
-                    // Loop through selected languages
-                    if (const auto languageMapIter = languageMap.find(language); languageMapIter != languageMap.end())
-                    {
-                        // An alternate name exists for the selected language
-                        const auto &localizedName = languageMapIter->second.first;
-                        const auto localizedIter = r.localizedNames.find(language);
-                        if (localizedIter != r.localizedNames.end())
-                        {
-                            // An entry already exists, add the new name
-                            localizedIter->second.cityName = localizedName;
-                        }
-                        else
-                        {
-                            // An entry does not exist, create it
-                            LocalizedNames ln = {};
-                            ln.cityName = localizedName;
-                            r.localizedNames.insert({language, ln});
-                        }
-                    }
-                }
+                return a > b;
             }
-            else
+            return eb < ea;
+        };
+        std::vector<std::size_t> heap = {};
+        for (std::size_t i = 0; i < chunks.size(); i++)
+        {
+            if (!chunks[i].entries.empty())
             {
-                DBOUT << lineNumber << " Could not find geonameid " << lineNumber << " in alternate names.\n";
+                heap.push_back(i);
             }
         }
+        std::make_heap(heap.begin(), heap.end(), later);
 
-        // Attempt to set countryName for latinized and locale
+        std::optional<std::pair<AlternateNameEntry, std::size_t>> winner = std::nullopt;
+        // Whether the first name of the key of winner is preferred, it then stays the name of the key
+        bool isFirstPreferred = false;
+        const auto flush = [&]()
         {
-            auto lcm = LocalizedCountryNameManager(countryLocalizationsPath);
-            // Default latinized is English
-            if (const auto englishLatinized = lcm.getLocalizedCountryName("en", countryCode); englishLatinized.has_value())
+            if (winner.has_value())
             {
-                r.latinizedName.countryName = englishLatinized.value();
+                auto entry = winner->first;
+                const auto name = std::string_view(chunks[winner->second].arena).substr(entry.offset, entry.length);
+                entry.offset = arena.size();
+                arena.append(name);
+                entries.push_back(entry);
             }
-            else
+        };
+        while (!heap.empty())
+        {
+            std::pop_heap(heap.begin(), heap.end(), later);
+            const std::size_t chunkIndex = heap.back();
+            const auto &entry = chunks[chunkIndex].entries[positions[chunkIndex]];
+            if (!winner.has_value() || !winner->first.sameKey(entry))
             {
-                DBOUT << lineNumber << " Could not find english latinized country name for \"" << countryCode << "\".\n";
+                flush();
+                winner = {entry, chunkIndex};
+                isFirstPreferred = entry.isPreferred;
             }
-            // Find localized for each selected languages
-            for (const auto &language : SELECTED_LANGUAGES)
+            else if (!isFirstPreferred && entry.isPreferred)
             {
-                // Loop through selected languages
-                if (const auto localizedName = lcm.getLocalizedCountryName(language, countryCode); localizedName.has_value())
-                {
-                    if (auto localizedIter = r.localizedNames.find(language); localizedIter != r.localizedNames.end())
-                    {
-                        auto &localizedData = localizedIter->second;
-                        localizedData.countryName = localizedName.value();
-                    }
-                    else
+                winner = {entry, chunkIndex};
+            }
+            positions[chunkIndex]++;
+            if (positions[chunkIndex] < chunks[chunkIndex].entries.size())
+            {
+                std::push_heap(heap.begin(), heap.end(), later);
+            }
+            else
+            {
+                heap.pop_back();
+            }
+        }
+        flush();
+        chunks.clear();
+        arena.shrink_to_fit();
+        entries.shrink_to_fit();
+    }
+
+    // Returns every entry of geonameid, ordered by LanguageId
+    std::span<const AlternateNameEntry> find(const GeoNameId geonameid) const noexcept
+    {
+        const auto compare = [](const AlternateNameEntry &entry, const GeoNameId id)
+        { return entry.geonameid < id; };
+        const auto first = std::lower_bound(entries.begin(), entries.end(), geonameid, compare);
+        auto last = first;
+        while (last != entries.end() && last->geonameid == geonameid)
+        {
+            last++;
+        }
+        return std::span<const AlternateNameEntry>(first, last);
+    }
+    std::string_view name(const AlternateNameEntry &entry) const noexcept
+    {
+        return std::string_view(arena).substr(entry.offset, entry.length);
+    }
+    std::size_t size() const noexcept
+    {
+        return entries.size();
+    }
+    // The number of bytes held by the table
+    std::size_t memoryUsage() const noexcept
+    {
+        return arena.capacity() + entries.capacity() * sizeof(AlternateNameEntry);
+    }
+};
+
+// A set of GeoNameIds stored as a bitmap.
+// GeoNameIds are dense and stay below a few tens of millions, so the bitmap is a few MB at most.
+class GeoNameIdSet
+{
+    std::vector<std::uint64_t> bits = {};
+    std::size_t size_ = 0;
+
+public:
+    void insert(const GeoNameId geonameid) noexcept
+    {
+        if (geonameid < 0)
+        {
+            return;
+        }
+        const auto word = static_cast<std::size_t>(geonameid) / 64;
+        if (word >= bits.size())
+        {
+            bits.resize(word + 1, 0);
+        }
+        const std::uint64_t mask = std::uint64_t(1) << (geonameid % 64);
+        if ((bits[word] & mask) == 0)
+        {
+            bits[word] |= mask;
+            size_++;
+        }
+    }
+    bool contains(const GeoNameId geonameid) const noexcept
+    {
+        if (geonameid < 0)
+        {
+            return false;
+        }
+        const auto word = static_cast<std::size_t>(geonameid) / 64;
+        return word < bits.size() && (bits[word] >> (geonameid % 64)) & 1;
+    }
+    std::size_t size() const noexcept
+    {
+        return size_;
+    }
+    std::size_t memoryUsage() const noexcept
+    {
+        return bits.size() * sizeof(std::uint64_t);
+    }
+};
+
+// Parses one line of alternateNames.txt into chunk.
+// Only names of GeoNameIds in referenced are kept.
+void parseAlternateNamesLine(
+    AlternateNamesChunk &chunk,
+    const std::string_view line,
+    const std::size_t lineNumber,
+    const LanguageIds &languageIds,
+    const GeoNameIdSet &referenced) noexcept
+{
+    const auto strvs = split<5>(line, '\t');
+
+    const auto languageSV = strvs.at(2);
+    const auto languageSize = languageSV.size();
+
+    if (languageSize > 2)
+    {
+        // The string is not an ISO language
+        DBOUT << lineNumber << " Skipping due to not ISO language, received: \"" << languageSV << "\"\n";
+        return;
+    }
+    const auto language = languageIds.find(languageSV);
+    if (!language.has_value())
+    {
+        // The language is not selected, but is not the default
+        DBOUT << lineNumber << " Skipping due to not selected, received: \"" << languageSV << "\"\n";
+        return;
+    }
+
+    const GeoNameId geonameid = charDigitsToInt(strvs.at(1));
+    if (!referenced.contains(geonameid))
+    {
+        // No city or admin1 region uses this name
+        return;
+    }
+    const bool isCurrentPreferred = strvs.at(4) == "1";
+    chunk.add(geonameid, language.value(), strvs.at(3), isCurrentPreferred);
+}
+
+AlternateNames parseAlternateNamesSequential(
+    const std::string &alternateNamesPath,
+    const LanguageIds &languageIds,
+    const GeoNameIdSet &referenced,
+    Progress &progress) noexcept
+{
+    std::vector<AlternateNamesChunk> chunks = std::vector<AlternateNamesChunk>(1);
+
+    LineReader inputFile = {};
+    inputFile.open(alternateNamesPath);
+    ProgressCounter counter = ProgressCounter(progress);
+    std::size_t lineNumber = 0;
+    for (std::string_view line; inputFile.next(line);)
+    {
+        lineNumber++;
+        counter.line(line.size());
+        parseAlternateNamesLine(chunks.front(), line, lineNumber, languageIds, referenced);
+    }
+    chunks.front().sortAndDeduplicate();
+    return AlternateNames(std::move(chunks));
+}
+
+// Memory maps the file and parses newline-aligned chunks of it on threadCount threads.
+// Each thread fills and sorts its own chunk, the chunks are then merged in file order.
+AlternateNames parseAlternateNamesParallel(
+    const std::string &alternateNamesPath,
+    const LanguageIds &languageIds,
+    const GeoNameIdSet &referenced,
+    const std::size_t threadCount,
+    Progress &progress) noexcept
+{
+    MemoryMappedFile file = {};
+    if (!file.open(alternateNamesPath))
+    {
+        std::cout << "Could not memory map \"" << alternateNamesPath << "\", reading it sequentially.\n";
+        return parseAlternateNamesSequential(alternateNamesPath, languageIds, referenced, progress);
+    }
+
+    const auto chunks = splitIntoLineChunks(file.view(), threadCount);
+    std::vector<AlternateNamesChunk> chunkData = std::vector<AlternateNamesChunk>(chunks.size());
+    std::mutex coutMutex = {};
+    {
+        std::vector<std::jthread> workers = {};
+        for (std::size_t i = 0; i < chunks.size(); i++)
+        {
+            workers.emplace_back([&, i]()
+            {
+                std::size_t lineNumber = 0;
+                {
+                    ProgressCounter counter = ProgressCounter(progress);
+                    forEachLine(chunks[i], [&](const std::string_view line)
+                    {
+                        lineNumber++;
+                        counter.line(line.size());
+                        parseAlternateNamesLine(chunkData[i], line, lineNumber, languageIds, referenced);
+                    });
+                }
+                chunkData[i].sortAndDeduplicate();
+                const std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(coutMutex);
+                std::cout << "Finished chunk " << (i + 1) << " of " << chunks.size() << " (" << lineNumber << " lines)\n";
+            });
+        }
+        // The jthreads join when leaving this scope
+    }
+
+    return AlternateNames(std::move(chunkData));
+}
+
+// Parses a gzip or zipped alternateNames.txt on threadCount threads while it is decompressed on another one.
+// Each block of lines becomes a chunk, the chunks are then merged in file order like parseAlternateNamesParallel.
+AlternateNames parseAlternateNamesDecompressed(
+    const std::string &alternateNamesPath,
+    const LanguageIds &languageIds,
+    const GeoNameIdSet &referenced,
+    const std::size_t threadCount,
+    Progress &progress) noexcept
+{
+    DecompressedBlocks blocks = {};
+    if (const auto error = blocks.open(alternateNamesPath, 2 * threadCount); error.has_value())
+    {
+        std::cerr << error.value() << "\n";
+        return AlternateNames();
+    }
+
+    std::vector<std::vector<std::pair<std::size_t, AlternateNamesChunk>>> workerChunks = std::vector<std::vector<std::pair<std::size_t, AlternateNamesChunk>>>(threadCount);
+    std::mutex coutMutex = {};
+    {
+        std::vector<std::jthread> workers = {};
+        for (std::size_t i = 0; i < threadCount; i++)
+        {
+            workers.emplace_back([&, i]()
+            {
+                ProgressCounter counter = ProgressCounter(progress);
+                for (auto block = blocks.next(); block.has_value(); block = blocks.next())
+                {
+                    AlternateNamesChunk chunk = {};
+                    std::size_t lineNumber = 0;
+                    forEachLine(block->text, [&](const std::string_view line)
+                    {
+                        lineNumber++;
+                        counter.line(line.size());
+                        parseAlternateNamesLine(chunk, line, lineNumber, languageIds, referenced);
+                    });
+                    chunk.sortAndDeduplicate();
+                    workerChunks[i].push_back({block->index, std::move(chunk)});
+                    const std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(coutMutex);
+                    std::cout << "Finished block " << (block->index + 1) << " (" << lineNumber << " lines)\n";
+                }
+            });
+        }
+        // The jthreads join when leaving this scope
+    }
+    if (const auto error = blocks.error(); !error.empty())
+    {
+        std::cerr << error << "\n";
+    }
+
+    std::vector<std::pair<std::size_t, AlternateNamesChunk>> indexedChunks = {};
+    for (auto &chunks : workerChunks)
+    {
+        std::move(chunks.begin(), chunks.end(), std::back_inserter(indexedChunks));
+    }
+    std::sort(indexedChunks.begin(), indexedChunks.end(), [](const auto &a, const auto &b)
+              { return a.first < b.first; });
+    std::vector<AlternateNamesChunk> chunkData = {};
+    for (auto &indexedChunk : indexedChunks)
+    {
+        chunkData.push_back(std::move(indexedChunk.second));
+    }
+    return AlternateNames(std::move(chunkData));
+}
+
+AlternateNames parseAlternateNames(
+    const std::string &alternateNamesPath,
+    const LanguageIds &languageIds,
+    const GeoNameIdSet &referenced,
+    const std::size_t threadCount,
+    Progress &progress) noexcept
+{
+    AlternateNames alternateData = threadCount <= 1
+                                       ? parseAlternateNamesSequential(alternateNamesPath, languageIds, referenced, progress)
+                                   : isCompressedFile(alternateNamesPath)
+                                       ? parseAlternateNamesDecompressed(alternateNamesPath, languageIds, referenced, threadCount, progress)
+                                       : parseAlternateNamesParallel(alternateNamesPath, languageIds, referenced, threadCount, progress);
+    std::cout << "Finished creating \"alternateData\" with " << alternateData.size() << " names in " << alternateData.memoryUsage() << " bytes\n";
+    return alternateData;
+}
+
+// Hashes std::string and std::string_view alike, so a map keyed by std::string can be searched with a view
+struct StringViewHash
+{
+    using is_transparent = void;
+
+    std::size_t operator()(const std::string_view sv) const noexcept
+    {
+        return std::hash<std::string_view>{}(sv);
+    }
+};
+
+// Admin1Code -> { LatinizedName, GeoNameId }
+typedef std::unordered_map<Admin1Code, std::pair<std::string, GeoNameId>, StringViewHash, std::equal_to<>> Admin1Map;
+
+// Builds the "${CountryCode}.${IDENTIFIER}" code of an admin1 region in place, so looking it up does not allocate.
+// GeoNames identifiers are a few characters, a code that does not fit is left empty and matches no region.
+class Admin1Key
+{
+    std::array<char, 64> buffer = {};
+    std::size_t size = 0;
+
+public:
+    Admin1Key(const std::string_view countryCode, const std::string_view identifier) noexcept
+    {
+        if (countryCode.size() + 1 + identifier.size() > buffer.size())
+        {
+            return;
+        }
+        std::copy(countryCode.begin(), countryCode.end(), buffer.begin());
+        buffer[countryCode.size()] = '.';
+        std::copy(identifier.begin(), identifier.end(), buffer.begin() + countryCode.size() + 1);
+        size = countryCode.size() + 1 + identifier.size();
+    }
+    std::string_view view() const noexcept
+    {
+        return std::string_view(buffer.data(), size);
+    }
+};
+
+void printAdminDataMap(const Admin1Map &m)
+{
+    std::cout << "\n==========PRINT AdminData MAP==========\n";
+    for (const auto &kvAdmin1Code : m)
+    {
+        std::cout << "Admin1Code: " << kvAdmin1Code.first << "\n";
+        const auto &nameGeoId = kvAdmin1Code.second;
+        std::cout << "\tLatinized: " << nameGeoId.first << "\n";
+        std::cout << "\tGeoNameId: " << nameGeoId.second << "\n";
+    }
+    std::cout << "\n==========PRINT AdminData MAP==========\n";
+}
+
+Admin1Map parseAdminData(const std::string &admin1CodesASCIIPath, Progress &progress)
+{
+
+    // Admin1Code -> { LatinizedName, GeoNameId }
+    Admin1Map adminData = {};
+
+    std::ifstream inputFile = std::ifstream(admin1CodesASCIIPath);
+    ProgressCounter counter = ProgressCounter(progress);
+    std::size_t lineNumber = 0;
+    for (std::string line; std::getline(inputFile, line);)
+    {
+        lineNumber++;
+        counter.line(line.size());
+        const auto strvs = split<4>(line, '\t');
+
+        const Admin1Code admin1code = std::string(strvs.at(0));
+        if (auto it = adminData.find(admin1code); it == adminData.end())
+        {
+            const GeoNameId geonameid = charDigitsToInt(strvs.at(3));
+            const std::string latinName = std::string(strvs.at(1));
+            DBOUT << lineNumber << " Inserting Admin1Code \"" << admin1code << "\" with geonameid \"" << geonameid << "\"\n";
+            adminData.insert({admin1code, {latinName, geonameid}});
+        }
+        else
+        {
+            DBOUT << lineNumber << " Skipping Admin1Code \"" << admin1code << "\" since it already exists.\n";
+        }
+    }
+    std::cout << "Finished creating \"adminData\"\n";
+
+    return adminData;
+}
+
+// Index of an ISO 3166-1 Alpha-2 code, one per pair of uppercase letters
+typedef std::uint16_t CountryId;
+
+constexpr std::size_t COUNTRY_ID_COUNT = 26 * 26;
+
+std::optional<CountryId> toCountryId(const std::string_view code) noexcept
+{
+    if (code.size() != 2 || code[0] < 'A' || code[0] > 'Z' || code[1] < 'A' || code[1] > 'Z')
+    {
+        return std::nullopt;
+    }
+    return static_cast<CountryId>((code[0] - 'A') * 26 + (code[1] - 'A'));
+}
+
+// The country names of localized-countries/*.json for every selected language and English.
+// The names are a dense [row x CountryId] table, a lookup is a single array read.
+class LocalizedCountryNames
+{
+    // One row per LanguageId, followed by the English row used for latinization when English is not selected
+    std::vector<std::optional<std::string>> names = {};
+    std::size_t latinizedRow = 0;
+
+    // Reads one localized-countries file into row, returns false if the file could not be used
+    static bool parseFile(const std::string &filepath, const ISOLanguage &lang, std::optional<std::string> *row) noexcept
+    {
+        if (!std::filesystem::exists(filepath))
+        {
+            DBOUT << "The file: \"" << filepath << "\" does not exist.\n";
+            return false;
+        }
+        DBOUT << "The file \"" << filepath << "\" exists, reading it.\n";
+
+        std::ifstream file = std::ifstream(filepath);
+        nlohmann::json json;
+        try
+        {
+            json = nlohmann::json::parse(file);
+        }
+        catch (const std::exception &e)
+        {
+            DBOUT << "Received an exception.\n\t" << e.what() << "\n";
+            return false;
+        }
+        if (!json.is_object())
+        {
+            DBOUT << "Expected a JSON object, but didn't get one.\n";
+            return false;
+        }
+        for (const auto &kv : json.items())
+        {
+            const auto &countryCode = kv.key();
+            const auto countryId = toCountryId(countryCode);
+            if (!countryId.has_value())
+            {
+                DBOUT << "Received invalid country code: \"" << countryCode << "\" for " << lang << ".\n";
+                continue;
+            }
+            const auto &value = kv.value();
+            if (!value.is_string())
+            {
+                DBOUT << "Value associated with country code \"" << countryCode << "\" was not a string for " << lang << ".\n";
+                continue;
+            }
+            row[countryId.value()] = value.get<std::string>();
+        }
+        DBOUT << "Finished adding language \"" << lang << "\" to the table.\n";
+        return true;
+    }
+
+public:
+    // Loads the file of every selected language and English, threadCount files at a time
+    LocalizedCountryNames(const std::string &countryLocalizationsPath, const LanguageIds &languageIds, const std::size_t threadCount) noexcept
+    {
+        std::vector<ISOLanguage> rowLanguages = {};
+        for (LanguageId language = 0; language < languageIds.size(); language++)
+        {
+            rowLanguages.push_back(languageIds.language(language));
+        }
+        if (const auto english = languageIds.find("en"); english.has_value())
+        {
+            latinizedRow = english.value();
+        }
+        else
+        {
+            latinizedRow = rowLanguages.size();
+            rowLanguages.push_back("en");
+        }
+        names.resize(rowLanguages.size() * COUNTRY_ID_COUNT);
+
+        std::atomic<std::size_t> nextRow = 0;
+        {
+            std::vector<std::jthread> workers = {};
+            for (std::size_t i = 0; i < std::min(threadCount, rowLanguages.size()); i++)
+            {
+                workers.emplace_back([&]()
+                {
+                    for (std::size_t row = nextRow++; row < rowLanguages.size(); row = nextRow++)
+                    {
+                        const std::string filepath = countryLocalizationsPath + rowLanguages[row] + ".json";
+                        parseFile(filepath, rowLanguages[row], names.data() + row * COUNTRY_ID_COUNT);
+                    }
+                });
+            }
+            // The jthreads join when leaving this scope
+        }
+        std::cout << "Finished loading country names for " << rowLanguages.size() << " languages\n";
+    }
+
+    const std::optional<std::string> &find(const LanguageId language, const CountryId country) const noexcept
+    {
+        return names[language * COUNTRY_ID_COUNT + country];
+    }
+    // The English name, used as the latinized country name
+    const std::optional<std::string> &findLatinized(const CountryId country) const noexcept
+    {
+        return names[latinizedRow * COUNTRY_ID_COUNT + country];
+    }
+};
+
+// The alternate names file of an input folder: alternateNames.txt, or the alternateNames.zip or alternateNames.txt.gz
+// GeoNames distributes when it was not extracted
+std::string findAlternateNamesPath(const std::string &inputPath) noexcept
+{
+    for (const auto filename : {"alternateNames.txt", "alternateNames.zip", "alternateNames.txt.gz"})
+    {
+        if (std::filesystem::exists(inputPath + filename))
+        {
+            return inputPath + filename;
+        }
+    }
+    return inputPath + "alternateNames.txt";
+}
+
+// Reads the cities file and returns the GeoNameIds whose alternate names parseCities will look up:
+// every city that will be written and the admin1 region of each of those cities.
+GeoNameIdSet collectReferencedGeoNameIds(
+    const std::string &citiesPath,
+    const Admin1Map &admin1Map,
+    const std::set<ISOCountryCode> &SELECTED_COUNTRIES,
+    Progress &progress) noexcept
+{
+    GeoNameIdSet referenced = {};
+
+    LineReader inputFile = {};
+    inputFile.open(citiesPath);
+    ProgressCounter counter = ProgressCounter(progress);
+    for (std::string_view line; inputFile.next(line);)
+    {
+        counter.line(line.size());
+        const auto strvs = split<11>(line, '\t');
+
+        // Skip the same cities as parseCities
+        const auto countryCode = strvs.at(8);
+        if (SELECTED_COUNTRIES.size() != 0)
+        {
+            if (SELECTED_COUNTRIES.find(std::string(countryCode)) == SELECTED_COUNTRIES.end())
+            {
+                continue;
+            }
+        }
+        if (countryCode.size() != 2)
+        {
+            continue;
+        }
+
+        referenced.insert(charDigitsToInt(strvs.at(0)));
+        if (const auto admin1MapIter = admin1Map.find(Admin1Key(countryCode, strvs.at(10)).view()); admin1MapIter != admin1Map.end())
+        {
+            referenced.insert(admin1MapIter->second.second);
+        }
+    }
+    std::cout << "Finished collecting " << referenced.size() << " referenced GeoNameIds\n";
+
+    return referenced;
+}
+
+// Builds the Record of one line of the cities file from the read-only tables parseCities loads.
+// build only reads the tables, so several threads can build records at once.
+class RecordBuilder
+{
+    const LanguageIds &languageIds;
+    const std::set<ISOCountryCode> &SELECTED_COUNTRIES;
+    const Admin1Map &admin1Map;
+    const AlternateNames &alternateNames;
+    const LocalizedCountryNames &countryNames;
+
+public:
+    RecordBuilder(
+        const LanguageIds &languageIds,
+        const std::set<ISOCountryCode> &SELECTED_COUNTRIES,
+        const Admin1Map &admin1Map,
+        const AlternateNames &alternateNames,
+        const LocalizedCountryNames &countryNames) noexcept
+        : languageIds{languageIds}, SELECTED_COUNTRIES{SELECTED_COUNTRIES}, admin1Map{admin1Map}, alternateNames{alternateNames}, countryNames{countryNames} {}
+
+    // Overwrites r with the record of line, returns false if the city is not selected.
+    // r keeps the capacity of its language slots, so once every slot exists building a record does not allocate.
+    bool build(Record &r, const std::string_view line, const std::size_t lineNumber) const noexcept
+    {
+        const auto strvs = split<18>(line, '\t');
+
+        // Set the country code
+        const auto countryCode = strvs.at(8);
+        if (countryCode.size() != 2)
+        {
+            DBOUT << lineNumber << " Received invalid country code, was not 2-characters. Received: \"" << countryCode << "\".\n";
+            return false;
+        }
+        // Two characters always fit in the small string buffer, this does not allocate
+        if (SELECTED_COUNTRIES.size() != 0 && SELECTED_COUNTRIES.find(ISOCountryCode(countryCode)) == SELECTED_COUNTRIES.end())
+        {
+            return false;
+        }
+        r.countryCode = NCharString<2>(countryCode);
+
+        // Set the geonameid
+        const GeoNameId geonameid = charDigitsToInt(strvs.at(0));
+        r.gni = geonameid;
+
+        // Set location/geographic data
+        const auto latitude = parseMicrodegrees(strvs.at(4), MAX_LATITUDE_MICRODEGREES);
+        const auto longitude = parseMicrodegrees(strvs.at(5), MAX_LONGITUDE_MICRODEGREES);
+        if (!latitude.has_value() || !longitude.has_value())
+        {
+            std::cerr << "Skipping line " << lineNumber << " of the cities file, its coordinates \"" << strvs.at(4) << "\", \"" << strvs.at(5) << "\" are not valid.\n";
+            return false;
+        }
+        r.location.timezone = strvs.at(17);
+        r.location.latitude = latitude.value();
+        r.location.longitude = longitude.value();
+
+        // An empty or malformed population is 0, one past the uint32 range is clamped
+        std::uint64_t population = 0;
+        std::from_chars(strvs.at(14).data(), strvs.at(14).data() + strvs.at(14).size(), population);
+        r.population = static_cast<std::uint32_t>(std::min<std::uint64_t>(population, std::numeric_limits<std::uint32_t>::max()));
+        // The feature class of every city is P, the code tells capitals (PPLC) and seats (PPLA...) apart
+        r.featureCode = strvs.at(7);
+
+        r.latinizedName = {};
+        r.languageIds = &languageIds;
+        r.localizedNames.assign(languageIds.size(), std::nullopt);
+        // The slot of language, created empty the first time one of its names is found
+        const auto localizedSlot = [&](const LanguageId language) -> LocalizedNames &
+        {
+            auto &slot = r.localizedNames[language];
+            if (!slot.has_value())
+            {
+                slot = LocalizedNames{};
+            }
+            return slot.value();
+        };
+
+        // Attempt to set admin1Name data for latinized and locale
+        if (const auto admin1MapIter = admin1Map.find(Admin1Key(countryCode, strvs.at(10)).view()); admin1MapIter != admin1Map.end())
+        {
+            // Found administrative region
+            const auto &p = admin1MapIter->second;
+            // Set the latinized admin1Name
+            r.latinizedName.admin1Name = p.first;
+            // Search for admin1 locale names
+            for (const auto &entry : alternateNames.find(p.second))
+            {
+                // An alternate name exists for a selected language
+                localizedSlot(entry.language).admin1Name = alternateNames.name(entry);
+            }
+            DBOUT << lineNumber << " Finished setting admin1 names.\n";
+        }
+        else
+        {
+            // Can't find administrative region
+            DBOUT << lineNumber << " Could not find admin1 code.\n";
+        }
+
+        // Atempt to set cityName for latinized and locale
+        {
+            // Set the latinized city name
+            r.latinizedName.cityName = strvs.at(1);
+            const auto cityNames = alternateNames.find(geonameid);
+            for (const auto &entry : cityNames)
+            {
+                // An alternate name exists for a selected language
+                localizedSlot(entry.language).cityName = alternateNames.name(entry);
+            }
+            if (cityNames.empty())
+            {
+                DBOUT << lineNumber << " Could not find geonameid " << lineNumber << " in alternate names.\n";
+            }
+        }
+
+        // Attempt to set countryName for latinized and locale
+        {
+            // Country codes were checked to be 2 characters, but may still not be letters
+            const auto countryId = toCountryId(countryCode);
+            // Default latinized is English
+            if (countryId.has_value() && countryNames.findLatinized(countryId.value()).has_value())
+            {
+                r.latinizedName.countryName = countryNames.findLatinized(countryId.value()).value();
+            }
+            else
+            {
+                DBOUT << lineNumber << " Could not find english latinized country name for \"" << countryCode << "\".\n";
+            }
+            // Find localized for each selected languages
+            for (LanguageId language = 0; countryId.has_value() && language < languageIds.size(); language++)
+            {
+                if (const auto &localizedName = countryNames.find(language, countryId.value()); localizedName.has_value())
+                {
+                    localizedSlot(language).countryName = localizedName.value();
+                }
+                else
+                {
+                    DBOUT << lineNumber << " Could not find localized country name for language \"" << languageIds.language(language) << "\" and country \"" << countryCode << "\".\n";
+                }
+            }
+        }
+
+        return true;
+    }
+};
+
+// The order the records are written in. The curves put cities that are close on the map next to each other in
+// the output, so a query and its neighbours touch the same pages and the output compresses better.
+enum class RecordOrder
+{
+    File,
+    Hilbert,
+    Morton,
+};
+
+std::optional<RecordOrder> parseRecordOrder(const std::string_view sv) noexcept
+{
+    if (sv == "file")
+    {
+        return RecordOrder::File;
+    }
+    if (sv == "hilbert")
+    {
+        return RecordOrder::Hilbert;
+    }
+    if (sv == "morton")
+    {
+        return RecordOrder::Morton;
+    }
+    return std::nullopt;
+}
+
+// The lines of the cities file in the order their records are written, with their line number in the file.
+// In file order the lines are streamed, otherwise the file is read whole and its lines are sorted by the
+// curve key of their coordinates. Lines with the same key, or coordinates that are not valid, keep file order.
+class CityLines
+{
+    LineReader file = {};
+    std::size_t lineNumber = 0;
+
+    std::string text = {};
+    struct SortedLine
+    {
+        std::uint32_t key;
+        std::uint32_t size;
+        std::size_t offset;
+        std::size_t lineNumber;
+    };
+    std::vector<SortedLine> sorted = {};
+    std::size_t position = 0;
+    bool isSorted = false;
+
+public:
+    // Returns false if the file could not be opened
+    bool open(const std::string &citiesPath, const RecordOrder order) noexcept
+    {
+        if (!file.open(citiesPath))
+        {
+            return false;
+        }
+        isSorted = order != RecordOrder::File;
+        if (!isSorted)
+        {
+            return true;
+        }
+        for (std::string_view line; file.next(line);)
+        {
+            lineNumber++;
+            const auto strvs = split<6>(line, '\t');
+            const auto latitude = parseMicrodegrees(strvs.at(4), MAX_LATITUDE_MICRODEGREES);
+            const auto longitude = parseMicrodegrees(strvs.at(5), MAX_LONGITUDE_MICRODEGREES);
+            std::uint32_t key = 0xFFFFFFFF;
+            if (latitude.has_value() && longitude.has_value())
+            {
+                key = order == RecordOrder::Hilbert ? SpatialIndex::hilbertKey(toDegrees(latitude.value()), toDegrees(longitude.value()))
+                                                    : SpatialIndex::mortonKey(toDegrees(latitude.value()), toDegrees(longitude.value()));
+            }
+            sorted.push_back({key, static_cast<std::uint32_t>(line.size()), text.size(), lineNumber});
+            text.append(line);
+        }
+        std::stable_sort(sorted.begin(), sorted.end(), [](const SortedLine &a, const SortedLine &b)
+                         { return a.key < b.key; });
+        std::cout << "Sorted " << sorted.size() << " cities along the curve\n";
+        return true;
+    }
+
+    // The line stays valid until the next call
+    bool next(std::string_view &line, std::size_t &number) noexcept
+    {
+        if (!isSorted)
+        {
+            if (!file.next(line))
+            {
+                return false;
+            }
+            number = ++lineNumber;
+            return true;
+        }
+        if (position == sorted.size())
+        {
+            return false;
+        }
+        const SortedLine &sortedLine = sorted[position++];
+        line = std::string_view(text.data() + sortedLine.offset, sortedLine.size);
+        number = sortedLine.lineNumber;
+        return true;
+    }
+};
+
+// Lines of the cities file and the records built from them, the unit of work of parseCitiesPipelined
+struct CityBatch
+{
+    // Position of the batch in the output
+    std::size_t index = 0;
+    std::size_t lineCount = 0;
+    // Only the first lineCount entries are used, the others keep their memory for the next batch
+    std::vector<std::string> lines = {};
+    std::vector<std::size_t> lineNumbers = {};
+    std::vector<Record> records = {};
+    std::vector<bool> isSelected = {};
+};
+
+void parseCitiesSequential(RecordSink &sink, CityLines &cityLines, const RecordBuilder &builder, Progress &progress) noexcept
+{
+    ProgressCounter counter = ProgressCounter(progress);
+    std::size_t lineNumber = 0;
+    Record r = {};
+    for (std::string_view line; cityLines.next(line, lineNumber);)
+    {
+        counter.line(line.size());
+        if (builder.build(r, line, lineNumber))
+        {
+            sink.write(r);
+        }
+    }
+}
+
+// Reads the cities lines on one thread, builds the records of batches of lines on threadCount threads and
+// writes them to sink on the calling thread in the order of the lines, so the output is the same as parseCitiesSequential.
+// A fixed set of batches circulates between the stages, so a slow sink holds back the reader instead of filling memory.
+void parseCitiesPipelined(RecordSink &sink, CityLines &cityLines, const RecordBuilder &builder, const std::size_t threadCount, Progress &progress) noexcept
+{
+    constexpr std::size_t BATCH_LINES = 256;
+    std::vector<CityBatch> batches = std::vector<CityBatch>(2 * threadCount + 2);
+
+    std::mutex mutex = {};
+    std::condition_variable changed = {};
+    std::deque<CityBatch *> freeBatches = {};
+    std::deque<CityBatch *> readBatches = {};
+    std::map<std::size_t, CityBatch *> builtBatches = {};
+    bool isReadingFinished = false;
+    std::size_t batchCount = 0;
+    for (auto &batch : batches)
+    {
+        batch.lines.resize(BATCH_LINES);
+        batch.lineNumbers.resize(BATCH_LINES);
+        batch.records.resize(BATCH_LINES);
+        batch.isSelected.resize(BATCH_LINES);
+        freeBatches.push_back(&batch);
+    }
+
+    {
+        std::jthread reader = std::jthread([&]()
+        {
+            for (bool isEnd = false; !isEnd;)
+            {
+                CityBatch *batch = nullptr;
+                {
+                    std::unique_lock<std::mutex> lock = std::unique_lock<std::mutex>(mutex);
+                    changed.wait(lock, [&]()
+                                 { return !freeBatches.empty(); });
+                    batch = freeBatches.front();
+                    freeBatches.pop_front();
+                }
+                batch->lineCount = 0;
+                std::string_view line = {};
+                while (batch->lineCount < BATCH_LINES && !(isEnd = !cityLines.next(line, batch->lineNumbers[batch->lineCount])))
+                {
+                    batch->lines[batch->lineCount++].assign(line);
+                }
+                const std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(mutex);
+                if (batch->lineCount == 0)
+                {
+                    freeBatches.push_back(batch);
+                    continue;
+                }
+                batch->index = batchCount++;
+                readBatches.push_back(batch);
+                changed.notify_all();
+            }
+            const std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(mutex);
+            isReadingFinished = true;
+            changed.notify_all();
+        });
+
+        std::vector<std::jthread> workers = {};
+        for (std::size_t worker = 0; worker < threadCount; worker++)
+        {
+            workers.emplace_back([&]()
+            {
+                while (true)
+                {
+                    CityBatch *batch = nullptr;
+                    {
+                        std::unique_lock<std::mutex> lock = std::unique_lock<std::mutex>(mutex);
+                        changed.wait(lock, [&]()
+                                     { return !readBatches.empty() || isReadingFinished; });
+                        if (readBatches.empty())
+                        {
+                            return;
+                        }
+                        batch = readBatches.front();
+                        readBatches.pop_front();
+                    }
+                    for (std::size_t i = 0; i < batch->lineCount; i++)
                     {
-                        LocalizedNames ln = {};
-                        ln.countryName = localizedName.value();
-                        r.localizedNames.insert({language, ln});
+                        batch->isSelected[i] = builder.build(batch->records[i], batch->lines[i], batch->lineNumbers[i]);
                     }
+                    const std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(mutex);
+                    builtBatches.insert({batch->index, batch});
+                    changed.notify_all();
                 }
-                else
+            });
+        }
+
+        ProgressCounter counter = ProgressCounter(progress);
+        for (std::size_t nextIndex = 0;; nextIndex++)
+        {
+            CityBatch *batch = nullptr;
+            {
+                std::unique_lock<std::mutex> lock = std::unique_lock<std::mutex>(mutex);
+                changed.wait(lock, [&]()
+                             { return builtBatches.find(nextIndex) != builtBatches.end() || (isReadingFinished && nextIndex == batchCount); });
+                const auto iter = builtBatches.find(nextIndex);
+                if (iter == builtBatches.end())
+                {
+                    break;
+                }
+                batch = iter->second;
+                builtBatches.erase(iter);
+            }
+            for (std::size_t i = 0; i < batch->lineCount; i++)
+            {
+                counter.line(batch->lines[i].size());
+                if (batch->isSelected[i])
+                {
+                    sink.write(batch->records[i]);
+                }
+            }
+            const std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(mutex);
+            freeBatches.push_back(batch);
+            changed.notify_all();
+        }
+        // The jthreads join when leaving this scope
+    }
+}
+
+// Creates a Record for every selected city and passes it to sink in the given order.
+// With more than one thread the records are built in parallel and still passed to sink in that order.
+// Every input file is a stage of stats.
+void parseCities(
+    RecordSink &sink,
+    const std::string &citiesPath,
+    const std::string &alternateNamesPath,
+    const std::set<ISOLanguage> &SELECTED_LANGUAGES,
+    const std::set<ISOCountryCode> &SELECTED_COUNTRIES,
+    const std::string &admin1CodesASCIIPath,
+    const std::string &countryLocalizationsPath,
+    const std::size_t threadCount,
+    const RecordOrder order,
+    RunStats &stats) noexcept
+{
+    const LanguageIds languageIds = LanguageIds(SELECTED_LANGUAGES);
+
+    Stage admin1Stage = stats.begin("admin1CodesASCII");
+    const auto admin1Map = parseAdminData(admin1CodesASCIIPath, admin1Stage.progress());
+    admin1Stage.table("admin1Map.size", static_cast<double>(admin1Map.size()));
+    admin1Stage.table("admin1Map.loadFactor", admin1Map.load_factor());
+    stats.finish(admin1Stage);
+
+    // Only keep the alternate names that will be looked up, so memory scales with the output
+    Stage referencedStage = stats.begin("referencedGeoNameIds");
+    const auto referenced = collectReferencedGeoNameIds(citiesPath, admin1Map, SELECTED_COUNTRIES, referencedStage.progress());
+    referencedStage.table("referenced.size", static_cast<double>(referenced.size()));
+    referencedStage.table("referenced.bytes", static_cast<double>(referenced.memoryUsage()));
+    stats.finish(referencedStage);
+
+    Stage alternateNamesStage = stats.begin("alternateNames");
+    const auto alternateNames = parseAlternateNames(alternateNamesPath, languageIds, referenced, threadCount, alternateNamesStage.progress());
+    alternateNamesStage.table("alternateNames.size", static_cast<double>(alternateNames.size()));
+    alternateNamesStage.table("alternateNames.bytes", static_cast<double>(alternateNames.memoryUsage()));
+    stats.finish(alternateNamesStage);
+
+    Stage countriesStage = stats.begin("localizedCountries");
+    const auto countryNames = LocalizedCountryNames(countryLocalizationsPath, languageIds, threadCount);
+    stats.finish(countriesStage);
+
+    Stage citiesStage = stats.begin("cities");
+    const RecordBuilder builder = RecordBuilder(languageIds, SELECTED_COUNTRIES, admin1Map, alternateNames, countryNames);
+    CityLines cityLines = {};
+    cityLines.open(citiesPath, order);
+    if (threadCount > 1)
+    {
+        parseCitiesPipelined(sink, cityLines, builder, threadCount, citiesStage.progress());
+    }
+    else
+    {
+        parseCitiesSequential(sink, cityLines, builder, citiesStage.progress());
+    }
+    stats.finish(citiesStage);
+
+    // Sinks that collect the records write them here
+    Stage outputStage = stats.begin("output");
+    sink.finish();
+    sink.describe(outputStage);
+    stats.finish(outputStage);
+}
+
+// A snapshot is an input folder holding only the rows a set of outputs uses: the cities of the selected countries,
+// the alternate names of those cities and of every admin1 region in the selected languages, admin1CodesASCII.txt and
+// the localized-countries files of the selected languages. The generator reads it like any other input folder, and the
+// GeoNames daily modification and deletion files are applied to it without reading the full dumps again.
+//
+// snapshot.json records the languages and countries the snapshot was made for, the rule of the cities file it was
+// made from and the dates of the applied deltas. The cities file of a snapshot is always named cities.txt.
+struct SnapshotInfo
+{
+    std::set<ISOLanguage> languages = {};
+    // Every country when empty
+    std::set<ISOCountryCode> countries = {};
+    // A city of the cities file has this feature class, and a population above minPopulation or one of seatFeatureCodes.
+    // The feature class is empty when the rule of the file is not known, every city then keeps its place.
+    std::string featureClass = {};
+    std::uint32_t minPopulation = 0;
+    std::set<std::string> seatFeatureCodes = {};
+    std::set<std::string> appliedDates = {};
+};
+
+// Sets the rule of the GeoNames cities file citiesPath in info, from the number of its name like cities15000.txt.
+// The rules are those of the GeoNames readme, an unknown file leaves them empty.
+void setSnapshotCitiesRule(SnapshotInfo &info, const std::string &citiesPath) noexcept
+{
+    // Without every extension, the file may be compressed like cities15000.txt.gz
+    std::string filename = std::filesystem::path(citiesPath).filename().string();
+    filename = filename.substr(0, filename.find('.'));
+    const std::map<std::string, std::set<std::string>> seats = {
+        {"cities500", {"PPLC", "PPLA", "PPLA2", "PPLA3", "PPLA4"}},
+        {"cities1000", {"PPLC", "PPLA", "PPLA2", "PPLA3"}},
+        {"cities5000", {"PPLC", "PPLA"}},
+        {"cities15000", {"PPLC"}},
+    };
+    const auto iter = seats.find(filename);
+    if (iter == seats.end())
+    {
+        std::cout << "The cities file " << std::quoted(filename) << " is not a GeoNames cities file, the deltas will not remove cities that no longer belong in it.\n";
+        return;
+    }
+    info.featureClass = "P";
+    info.minPopulation = static_cast<std::uint32_t>(charDigitsToInt(std::string_view(filename).substr(6)));
+    info.seatFeatureCodes = iter->second;
+}
+
+// Whether a line of the cities file still belongs in the cities file the snapshot was made from
+bool meetsSnapshotCitiesRule(const std::string_view line, const SnapshotInfo &info) noexcept
+{
+    if (info.featureClass.empty())
+    {
+        return true;
+    }
+    const auto strvs = split<15>(line, '\t');
+    std::uint64_t population = 0;
+    std::from_chars(strvs.at(14).data(), strvs.at(14).data() + strvs.at(14).size(), population);
+    return strvs.at(6) == info.featureClass &&
+           (population > info.minPopulation || info.seatFeatureCodes.find(std::string(strvs.at(7))) != info.seatFeatureCodes.end());
+}
+
+std::string snapshotCitiesPath(const std::string &snapshotPath) noexcept
+{
+    return snapshotPath + "cities.txt";
+}
+
+bool writeSnapshotInfo(const std::string &snapshotPath, const SnapshotInfo &info) noexcept
+{
+    const nlohmann::json json = {
+        {"languages", info.languages},
+        {"countries", info.countries},
+        {"featureClass", info.featureClass},
+        {"minPopulation", info.minPopulation},
+        {"seatFeatureCodes", info.seatFeatureCodes},
+        {"appliedDates", info.appliedDates},
+    };
+    std::ofstream file = std::ofstream(snapshotPath + "snapshot.json");
+    file << json.dump(4) << '\n';
+    return file.good();
+}
+
+std::optional<SnapshotInfo> readSnapshotInfo(const std::string &snapshotPath) noexcept
+{
+    std::ifstream file = std::ifstream(snapshotPath + "snapshot.json");
+    if (!file.good())
+    {
+        return std::nullopt;
+    }
+    try
+    {
+        const nlohmann::json json = nlohmann::json::parse(file);
+        SnapshotInfo info = {};
+        info.languages = json.at("languages").get<std::set<ISOLanguage>>();
+        info.countries = json.at("countries").get<std::set<ISOCountryCode>>();
+        // Snapshots made before the rule was recorded keep every city
+        info.featureClass = json.value("featureClass", std::string());
+        info.minPopulation = json.value("minPopulation", std::uint32_t(0));
+        info.seatFeatureCodes = json.value("seatFeatureCodes", std::set<std::string>());
+        info.appliedDates = json.at("appliedDates").get<std::set<std::string>>();
+        return info;
+    }
+    catch (const std::exception &e)
+    {
+        DBOUT << "Received an exception.\n\t" << e.what() << "\n";
+        return std::nullopt;
+    }
+}
+
+// Whether the snapshot holds a city of this country code, the same rule parseCities uses to skip cities
+bool isSnapshotCountry(const std::string_view countryCode, const std::set<ISOCountryCode> &countries) noexcept
+{
+    return countryCode.size() == 2 && (countries.size() == 0 || countries.find(std::string(countryCode)) != countries.end());
+}
+
+// Whether a line of alternateNames.txt belongs in a snapshot
+bool isSnapshotAlternateName(const std::string_view line, const LanguageIds &languageIds, const GeoNameIdSet &referenced) noexcept
+{
+    const auto strvs = split<5>(line, '\t');
+    return languageIds.find(strvs.at(2)).has_value() && referenced.contains(charDigitsToInt(strvs.at(1)));
+}
+
+// The lines of a snapshot file keyed by the GeoNameId or alternateNameId in their first column.
+// Removed lines are left empty so the file order of the other lines never changes, new lines are appended.
+class SnapshotLines
+{
+    std::vector<std::string> lines = {};
+    std::unordered_map<int, std::size_t> indices = {};
+
+public:
+    bool read(const std::string &path) noexcept
+    {
+        std::ifstream file = std::ifstream(path);
+        if (!file.good())
+        {
+            return false;
+        }
+        for (std::string line; std::getline(file, line);)
+        {
+            set(std::move(line));
+        }
+        return true;
+    }
+    bool write(const std::string &path) const noexcept
+    {
+        // Written next to the file and renamed, so an interrupted update leaves the previous file intact
+        const std::string temporaryPath = path + ".tmp";
+        {
+            std::ofstream file = std::ofstream(temporaryPath, std::ios::out | std::ios::binary);
+            for (const auto &line : lines)
+            {
+                if (!line.empty())
                 {
-                    DBOUT << lineNumber << " Could not find localized country name for language \"" << language << "\" and country \"" << countryCode << "\".\n";
+                    file << line << '\n';
                 }
             }
+            if (!file.good())
+            {
+                return false;
+            }
+        }
+        std::error_code error = {};
+        std::filesystem::rename(temporaryPath, path, error);
+        return !error;
+    }
+    // Replaces the line with the same key, or appends it
+    void set(std::string &&line) noexcept
+    {
+        const int key = charDigitsToInt(split<2>(line, '\t').at(0));
+        if (const auto iter = indices.find(key); iter != indices.end())
+        {
+            lines[iter->second] = std::move(line);
+            return;
+        }
+        indices.insert({key, lines.size()});
+        lines.push_back(std::move(line));
+    }
+    bool contains(const int key) const noexcept
+    {
+        return indices.find(key) != indices.end();
+    }
+    // Returns false when there is no line with this key
+    bool erase(const int key) noexcept
+    {
+        const auto iter = indices.find(key);
+        if (iter == indices.end())
+        {
+            return false;
+        }
+        lines[iter->second].clear();
+        indices.erase(iter);
+        return true;
+    }
+    // Removes every line for which isRemoved returns true, returns how many were
+    template <typename F>
+    std::size_t eraseIf(F &&isRemoved) noexcept
+    {
+        std::size_t count = 0;
+        for (auto iter = indices.begin(); iter != indices.end();)
+        {
+            if (isRemoved(std::string_view(lines[iter->second])))
+            {
+                lines[iter->second].clear();
+                iter = indices.erase(iter);
+                count++;
+            }
+            else
+            {
+                iter++;
+            }
+        }
+        return count;
+    }
+    template <typename F>
+    void forEach(F &&onLine) const
+    {
+        for (const auto &line : lines)
+        {
+            if (!line.empty())
+            {
+                onLine(std::string_view(line));
+            }
+        }
+    }
+    std::size_t size() const noexcept
+    {
+        return indices.size();
+    }
+};
+
+// Every GeoNameId whose alternate names a snapshot keeps: its cities and every admin1 region, so a city that moves
+// to another region in a delta still finds the names of its new region
+GeoNameIdSet snapshotReferencedGeoNameIds(
+    const SnapshotLines &cities,
+    const Admin1Map &admin1Map) noexcept
+{
+    GeoNameIdSet referenced = {};
+    cities.forEach([&](const std::string_view line)
+                   { referenced.insert(charDigitsToInt(split<2>(line, '\t').at(0))); });
+    for (const auto &kv : admin1Map)
+    {
+        referenced.insert(kv.second.second);
+    }
+    return referenced;
+}
+
+// Writes the alternate names of alternateNamesPath that belong in a snapshot to os, in file order.
+// Memory maps the file and filters newline-aligned chunks of it on threadCount threads like parseAlternateNamesParallel.
+void writeSnapshotAlternateNames(
+    std::ostream &os,
+    const std::string &alternateNamesPath,
+    const LanguageIds &languageIds,
+    const GeoNameIdSet &referenced,
+    const std::size_t threadCount) noexcept
+{
+    MemoryMappedFile file = {};
+    if (threadCount <= 1 || isCompressedFile(alternateNamesPath) || !file.open(alternateNamesPath))
+    {
+        LineReader inputFile = {};
+        inputFile.open(alternateNamesPath);
+        for (std::string_view line; inputFile.next(line);)
+        {
+            if (isSnapshotAlternateName(line, languageIds, referenced))
+            {
+                os << line << '\n';
+            }
+        }
+        return;
+    }
+
+    const auto chunks = splitIntoLineChunks(file.view(), threadCount);
+    std::vector<std::string> kept = std::vector<std::string>(chunks.size());
+    {
+        std::vector<std::jthread> workers = {};
+        for (std::size_t i = 0; i < chunks.size(); i++)
+        {
+            workers.emplace_back([&, i]()
+            {
+                forEachLine(chunks[i], [&](const std::string_view line)
+                {
+                    if (isSnapshotAlternateName(line, languageIds, referenced))
+                    {
+                        kept[i].append(line);
+                        kept[i] += '\n';
+                    }
+                });
+            });
+        }
+        // The jthreads join when leaving this scope
+    }
+    for (const auto &lines : kept)
+    {
+        os << lines;
+    }
+}
+
+// Creates the snapshot folder from the full input files, returns false if a file could not be written
+bool createSnapshot(
+    const std::string &snapshotPath,
+    const std::string &citiesPath,
+    const std::string &inputPath,
+    const std::set<ISOLanguage> &SELECTED_LANGUAGES,
+    const std::set<ISOCountryCode> &SELECTED_COUNTRIES,
+    const std::size_t threadCount,
+    Progress &progress) noexcept
+{
+    std::error_code error = {};
+    std::filesystem::create_directories(snapshotPath + "localized-countries/", error);
+    if (error)
+    {
+        std::cerr << "Could not create the snapshot folder " << std::quoted(snapshotPath) << ": " << error.message() << "\n";
+        return false;
+    }
+
+    SnapshotLines cities = {};
+    {
+        LineReader inputFile = {};
+        inputFile.open(citiesPath);
+        ProgressCounter counter = ProgressCounter(progress);
+        for (std::string_view line; inputFile.next(line);)
+        {
+            counter.line(line.size());
+            if (isSnapshotCountry(split<9>(line, '\t').at(8), SELECTED_COUNTRIES))
+            {
+                cities.set(std::string(line));
+            }
+        }
+    }
+    if (!cities.write(snapshotCitiesPath(snapshotPath)))
+    {
+        std::cerr << "Could not write the snapshot cities file.\n";
+        return false;
+    }
+
+    std::filesystem::copy_file(inputPath + "admin1CodesASCII.txt", snapshotPath + "admin1CodesASCII.txt", std::filesystem::copy_options::overwrite_existing, error);
+    if (error)
+    {
+        std::cerr << "Could not copy admin1CodesASCII.txt to the snapshot: " << error.message() << "\n";
+        return false;
+    }
+    std::set<ISOLanguage> countryLanguages = SELECTED_LANGUAGES;
+    countryLanguages.insert("en");
+    for (const auto &language : countryLanguages)
+    {
+        const std::string filepath = inputPath + "localized-countries/" + language + ".json";
+        if (std::filesystem::exists(filepath))
+        {
+            std::filesystem::copy_file(filepath, snapshotPath + "localized-countries/" + language + ".json", std::filesystem::copy_options::overwrite_existing, error);
+        }
+    }
+
+    const LanguageIds languageIds = LanguageIds(SELECTED_LANGUAGES);
+    const auto admin1Map = parseAdminData(inputPath + "admin1CodesASCII.txt", progress);
+    const auto referenced = snapshotReferencedGeoNameIds(cities, admin1Map);
+    {
+        std::ofstream alternateNamesFile = std::ofstream(snapshotPath + "alternateNames.txt", std::ios::out | std::ios::binary);
+        writeSnapshotAlternateNames(alternateNamesFile, findAlternateNamesPath(inputPath), languageIds, referenced, threadCount);
+        if (!alternateNamesFile.good())
+        {
+            std::cerr << "Could not write the snapshot alternateNames.txt.\n";
+            return false;
+        }
+    }
+
+    SnapshotInfo info = {};
+    info.languages = SELECTED_LANGUAGES;
+    info.countries = SELECTED_COUNTRIES;
+    setSnapshotCitiesRule(info, citiesPath);
+    if (!writeSnapshotInfo(snapshotPath, info))
+    {
+        std::cerr << "Could not write the snapshot snapshot.json.\n";
+        return false;
+    }
+    std::cout << "Finished creating the snapshot with " << cities.size() << " cities\n";
+    return true;
+}
+
+// The GeoNames daily files of one date, empty when the folder does not hold that file
+struct DailyDeltaFiles
+{
+    std::string modifications;
+    std::string deletes;
+    std::string alternateNamesModifications;
+    std::string alternateNamesDeletes;
+};
+
+// Finds modifications-YYYY-MM-DD.txt, deletes-YYYY-MM-DD.txt, alternateNamesModifications-YYYY-MM-DD.txt and
+// alternateNamesDeletes-YYYY-MM-DD.txt in deltasPath, ordered by date
+std::map<std::string, DailyDeltaFiles> findDeltaFiles(const std::string &deltasPath) noexcept
+{
+    std::map<std::string, DailyDeltaFiles> days = {};
+    std::error_code error = {};
+    for (const auto &entry : std::filesystem::directory_iterator(deltasPath, error))
+    {
+        const std::string filename = entry.path().filename().string();
+        const std::array<std::pair<std::string_view, std::string DailyDeltaFiles::*>, 4> kinds = {{
+            {"modifications-", &DailyDeltaFiles::modifications},
+            {"deletes-", &DailyDeltaFiles::deletes},
+            {"alternateNamesModifications-", &DailyDeltaFiles::alternateNamesModifications},
+            {"alternateNamesDeletes-", &DailyDeltaFiles::alternateNamesDeletes},
+        }};
+        for (const auto &[prefix, member] : kinds)
+        {
+            if (filename.starts_with(prefix) && filename.ends_with(".txt"))
+            {
+                const std::string date = filename.substr(prefix.size(), filename.size() - prefix.size() - 4);
+                days[date].*member = entry.path().string();
+            }
+        }
+    }
+    return days;
+}
+
+// Applies every delta of deltasPath that is not yet in the snapshot, in date order, and rewrites its files.
+// A modified city replaces its row and a deleted one is removed, like a city whose new row no longer meets the rule
+// of the cities file. Cities the snapshot does not hold are not added, a place that grows into the cities file needs
+// a new snapshot. Alternate names are kept, replaced and removed with the same rule createSnapshot uses, and the names
+// of removed cities are dropped, so the snapshot stays the same as one made from the updated dumps.
+bool applySnapshotDeltas(const std::string &snapshotPath, const std::string &deltasPath, Progress &progress) noexcept
+{
+    auto info = readSnapshotInfo(snapshotPath);
+    if (!info.has_value())
+    {
+        std::cerr << "Could not read the snapshot.json of " << std::quoted(snapshotPath) << ".\n";
+        return false;
+    }
+    SnapshotLines cities = {};
+    SnapshotLines alternateNames = {};
+    if (!cities.read(snapshotCitiesPath(snapshotPath)) || !alternateNames.read(snapshotPath + "alternateNames.txt"))
+    {
+        std::cerr << "Could not read the snapshot files of " << std::quoted(snapshotPath) << ".\n";
+        return false;
+    }
+    const LanguageIds languageIds = LanguageIds(info->languages);
+    const auto admin1Map = parseAdminData(snapshotPath + "admin1CodesASCII.txt", progress);
+
+    std::size_t updatedCities = 0;
+    std::size_t deletedCities = 0;
+    std::size_t updatedNames = 0;
+    std::size_t deletedNames = 0;
+    const auto forEachFileLine = [](const std::string &path, const auto &onLine)
+    {
+        if (path.empty())
+        {
+            return;
         }
+        std::ifstream file = std::ifstream(path);
+        for (std::string line; std::getline(file, line);)
+        {
+            onLine(line);
+        }
+    };
+    for (const auto &[date, files] : findDeltaFiles(deltasPath))
+    {
+        if (info->appliedDates.find(date) != info->appliedDates.end())
+        {
+            DBOUT << "Skipping the deltas of " << date << ", they were already applied.\n";
+            continue;
+        }
+
+        forEachFileLine(files.modifications, [&](std::string &line)
+        {
+            const auto strvs = split<9>(line, '\t');
+            const GeoNameId geonameid = charDigitsToInt(strvs.at(0));
+            if (!isSnapshotCountry(strvs.at(8), info->countries) || !meetsSnapshotCitiesRule(line, info.value()))
+            {
+                // The city moved to a country the snapshot does not hold, or no longer belongs in the cities file
+                deletedCities += cities.erase(geonameid);
+            }
+            else if (cities.contains(geonameid))
+            {
+                cities.set(std::move(line));
+                updatedCities++;
+            }
+        });
+        forEachFileLine(files.deletes, [&](const std::string &line)
+                        { deletedCities += cities.erase(charDigitsToInt(split<2>(line, '\t').at(0))); });
+
+        // The cities of this date decide which alternate names are kept
+        const auto referenced = snapshotReferencedGeoNameIds(cities, admin1Map);
+        forEachFileLine(files.alternateNamesModifications, [&](std::string &line)
+        {
+            if (isSnapshotAlternateName(line, languageIds, referenced))
+            {
+                alternateNames.set(std::move(line));
+                updatedNames++;
+            }
+            else
+            {
+                // The name may have moved to another language or place
+                deletedNames += alternateNames.erase(charDigitsToInt(split<2>(line, '\t').at(0)));
+            }
+        });
+        forEachFileLine(files.alternateNamesDeletes, [&](const std::string &line)
+                        { deletedNames += alternateNames.erase(charDigitsToInt(split<2>(line, '\t').at(0))); });
+
+        info->appliedDates.insert(date);
+        std::cout << "Applied the deltas of " << date << "\n";
+    }
+    // The names of the cities removed above are no longer referenced
+    const auto referenced = snapshotReferencedGeoNameIds(cities, admin1Map);
+    deletedNames += alternateNames.eraseIf([&](const std::string_view line)
+                                           { return !referenced.contains(charDigitsToInt(split<3>(line, '\t').at(1))); });
+
+    if (!cities.write(snapshotCitiesPath(snapshotPath)) || !alternateNames.write(snapshotPath + "alternateNames.txt") || !writeSnapshotInfo(snapshotPath, info.value()))
+    {
+        std::cerr << "Could not write the snapshot files of " << std::quoted(snapshotPath) << ".\n";
+        return false;
+    }
+    std::cout << "Finished updating the snapshot, " << updatedCities << " cities updated, " << deletedCities << " removed, "
+              << updatedNames << " alternate names updated, " << deletedNames << " removed\n";
+    return true;
+}
 
-        r.toStreamAsTxt(outputFile);
-        outputFile << '\n';
+// Writes the stages of stats as the JSON report of --stats, run holds what the run was asked to do
+bool writeStats(const std::string &statsPath, const RunStats &stats, const nlohmann::json &run) noexcept
+{
+    nlohmann::json stages = nlohmann::json::array();
+    for (const auto &stage : stats.stages())
+    {
+        nlohmann::json tables = nlohmann::json::object();
+        for (const auto &[name, value] : stage.tables)
+        {
+            tables[name] = value;
+        }
+        stages.push_back({
+            {"name", stage.name},
+            {"wallSeconds", stage.wallSeconds},
+            {"cpuSeconds", stage.cpuSeconds},
+            {"lines", stage.lines},
+            {"bytes", stage.bytes},
+            {"linesPerSecond", stage.wallSeconds > 0 ? stage.lines / stage.wallSeconds : 0.0},
+            {"megabytesPerSecond", stage.wallSeconds > 0 ? stage.bytes / stage.wallSeconds / 1e6 : 0.0},
+            {"peakRssBytes", stage.peakRssBytes},
+            {"tables", tables},
+        });
     }
+    const nlohmann::json report = {
+        {"run", run},
+        {"wallSeconds", stats.wallSeconds()},
+        {"cpuSeconds", stats.cpuSeconds()},
+        {"peakRssBytes", peakRssBytes()},
+        {"stages", stages},
+    };
+    std::ofstream file = std::ofstream(statsPath);
+    file << report.dump(4) << '\n';
+    return file.good();
 }
 
+// Benchmarks/GeneratorBenchmark.cpp includes this file to call the parsers directly, it defines GENERATORCPP_NO_MAIN
+#ifndef GENERATORCPP_NO_MAIN
 #include <argparse/argparse.hpp>
 
+// One output file, with its own format, languages and countries
+struct OutputProfile
+{
+    std::string output;
+    std::string format;
+    std::set<ISOLanguage> languages;
+    // Every country when empty
+    std::set<ISOCountryCode> countries;
+    // Cells per degree of the nearest city grid, 0 for no grid
+    int grid;
+};
+
+// Validates an ISO 639-1 code and adds it to languages, prints the reason and returns false when it is invalid
+bool addSelectedLanguage(std::set<ISOLanguage> &languages, const std::string_view sv) noexcept
+{
+    if (sv.size() != 2)
+    {
+        std::cerr << "Language provided is not an ISO 639-1 code, it has more than 2 characters.\n";
+        return false;
+    }
+    for (const auto c : sv)
+    {
+        if (!(('a' <= c) && (c <= 'z')))
+        {
+            std::cerr << "Language provided is not an ISO 639-1 code, the characters are not lowercase.\n";
+            return false;
+        }
+    }
+    languages.insert(std::string(sv));
+    DBOUT << "Added language \"" << sv << "\" to selected set.\n";
+    return true;
+}
+
+// Validates an ISO 3166-1 Alpha-2 code and adds it to countries, prints the reason and returns false when it is invalid
+bool addSelectedCountry(std::set<ISOCountryCode> &countries, const std::string_view sv) noexcept
+{
+    if (sv.size() != 2)
+    {
+        std::cerr << "Country code provided is not an ISO 3166-1 Alpha-2 code, it has more than 2 characters.\n";
+        return false;
+    }
+    for (const auto c : sv)
+    {
+        if (!(('A' <= c) && (c <= 'Z')))
+        {
+            std::cerr << "Country code provided is not an ISO ISO 3166-1 Alpha-2 code, the characters are not uppercase.\n";
+            return false;
+        }
+    }
+    countries.insert(std::string(sv));
+    DBOUT << "Added country \"" << sv << "\" to selected set.\n";
+    return true;
+}
+
+// Checks the values of a profile that do not depend on how it was given, prints the reason and returns false when one is invalid
+bool validateProfile(const OutputProfile &profile) noexcept
+{
+    if (profile.format != "txt" && profile.format != "json" && profile.format != "binary" && profile.format != "packs")
+    {
+        std::cerr << "--format argument must be \"txt\", \"json\", \"binary\" or \"packs\". Received: " << std::quoted(profile.format) << "\n";
+        return false;
+    }
+    if (profile.grid < 0 || profile.grid > static_cast<int>(NEAREST_GRID_MAX_CELLS_PER_DEGREE))
+    {
+        std::cerr << "--grid argument must be between 0 and " << NEAREST_GRID_MAX_CELLS_PER_DEGREE << ". Received: " << profile.grid << "\n";
+        return false;
+    }
+    if (profile.grid != 0 && profile.format != "binary")
+    {
+        std::cerr << "--grid argument requires --format binary.\n";
+        return false;
+    }
+    return true;
+}
+
+// Reads the profiles file, a JSON array of objects such as:
+// {"output": "output/en+latinized-world.json", "format": "json", "languages": ["en"], "countries": [], "grid": 0}
+// Only "output" is required, the other keys default to the same values as the command line arguments.
+std::optional<std::vector<OutputProfile>> parseProfilesFile(const std::string &profilesPath) noexcept
+{
+    std::ifstream file = std::ifstream(profilesPath);
+    if (!file.good())
+    {
+        std::cerr << "--profiles argument could not be opened. Received: " << std::quoted(profilesPath) << "\n";
+        return std::nullopt;
+    }
+    std::vector<OutputProfile> profiles = {};
+    try
+    {
+        const nlohmann::json json = nlohmann::json::parse(file);
+        if (!json.is_array() || json.empty())
+        {
+            std::cerr << "--profiles file must hold a non-empty JSON array of profiles.\n";
+            return std::nullopt;
+        }
+        for (const auto &item : json)
+        {
+            OutputProfile profile = {};
+            profile.output = item.at("output").get<std::string>();
+            profile.format = item.value("format", std::string("txt"));
+            profile.grid = item.value("grid", 0);
+            for (const auto &language : item.value("languages", std::vector<std::string>()))
+            {
+                if (!addSelectedLanguage(profile.languages, language))
+                {
+                    return std::nullopt;
+                }
+            }
+            for (const auto &country : item.value("countries", std::vector<std::string>()))
+            {
+                if (!addSelectedCountry(profile.countries, country))
+                {
+                    return std::nullopt;
+                }
+            }
+            if (!validateProfile(profile))
+            {
+                return std::nullopt;
+            }
+            profiles.push_back(std::move(profile));
+        }
+    }
+    catch (const std::exception &err)
+    {
+        std::cerr << "--profiles file is not a valid list of profiles. Received: " << err.what() << "\n";
+        return std::nullopt;
+    }
+    return profiles;
+}
+
 int main(int argc, char *argv[])
 {
     argparse::ArgumentParser program = argparse::ArgumentParser("GeoNamesJSON", "0.1");
 
     program.add_argument("--output", "-o")
-        .help("specify output file path.")
-        .required();
+        .help("specify output file path. Required unless --profiles is used.");
     program.add_argument("--cities", "-ct")
-        .help("specify path to the cities.txt file.")
-        .required();
+        .help("specify path to the cities.txt file, it can also be the cities[n].zip or a gzip file. Required unless --deltas is used.");
     program.add_argument("--input", "-i")
-        .help("specify path to all required input files. View README.md for more information.")
-        .required();
+        .help("specify path to all required input files. View README.md for more information. Required unless --deltas is used.");
 
     program.add_argument("--languages", "--language", "-l")
         .help("select languages to include in output file. Provide a comma-seperated list of 639-1 codes.");
     program.add_argument("--countries", "--country", "-cu")
         .help("select countries to include in output file. Defaults to every country. Provide a comma-seperated list of ISO 3166-1 codes.");
+    program.add_argument("--format", "-f")
+        .help("select the output format: \"txt\" for the tab-separated intermediate file, \"json\" for the file generate.js creates from it, \"binary\" for the memory-mappable dataset read by QueryCPP or \"packs\" for a folder with a base pack and one name pack per language.")
+        .default_value(std::string("txt"));
+    program.add_argument("--threads", "-t")
+        .help("number of threads used to parse alternateNames.txt. Defaults to every core, 1 reads the file sequentially.")
+        .default_value(0)
+        .scan<'i', int>();
+    program.add_argument("--grid", "-g")
+        .help("cells per degree of the nearest city grid stored in a binary output, from 1 to 20. Defaults to 0, no grid.")
+        .default_value(0)
+        .scan<'i', int>();
+    program.add_argument("--order")
+        .help("order of the records in the outputs: \"file\" keeps the order of the cities file, \"hilbert\" or \"morton\" sort them along that curve so nearby cities are stored together.")
+        .default_value(std::string("file"));
+    program.add_argument("--stats")
+        .help("path of a JSON report with the wall and CPU time, throughput, table sizes and peak memory of every stage of the run.");
+    program.add_argument("--profiles", "-p")
+        .help("path to a JSON file listing several outputs, each with its own output, format, languages, countries and grid. The inputs are read once for all of them. Replaces --output, --format, --languages, --countries and --grid.");
+    program.add_argument("--snapshot", "-s")
+        .help("folder of the snapshot holding only the input rows of the outputs. It is created from --cities and --input, or updated with --deltas, and the outputs are then generated from it.");
+    program.add_argument("--deltas", "-d")
+        .help("folder with GeoNames daily modifications, deletes, alternateNamesModifications and alternateNamesDeletes files to apply to --snapshot instead of reading --cities and --input.");
 
     try
     {
@@ -590,105 +2421,322 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    std::string citiesArgument = program.get<std::string>("--cities");
-    DBOUT << "cities argument: " << std::quoted(citiesArgument) << '\n';
-    if (!std::filesystem::exists(citiesArgument))
+    const bool isUpdate = program.is_used("--deltas");
+    std::string citiesArgument = "";
+    std::string inputArgument = "";
+    if (isUpdate)
     {
-        std::cerr << "--cities argument was not an existing file. Received: " << std::quoted(citiesArgument) << "\n";
-        return 1;
+        if (!program.is_used("--snapshot"))
+        {
+            std::cerr << "--deltas argument requires --snapshot.\n";
+            return 1;
+        }
+        if (program.is_used("--cities") || program.is_used("--input"))
+        {
+            std::cerr << "--deltas argument can not be combined with --cities or --input, the snapshot is the input.\n";
+            return 1;
+        }
+    }
+    else
+    {
+        if (!program.is_used("--cities") || !program.is_used("--input"))
+        {
+            std::cerr << "--cities and --input arguments are required unless --deltas is used.\n";
+            std::cerr << program << '\n';
+            return 1;
+        }
+        citiesArgument = program.get<std::string>("--cities");
+        DBOUT << "cities argument: " << std::quoted(citiesArgument) << '\n';
+        if (!std::filesystem::exists(citiesArgument))
+        {
+            std::cerr << "--cities argument was not an existing file. Received: " << std::quoted(citiesArgument) << "\n";
+            return 1;
+        }
+
+        inputArgument = program.get<std::string>("--input");
+        DBOUT << "input argument: " << std::quoted(inputArgument) << '\n';
+        if (!std::filesystem::exists(inputArgument))
+        {
+            std::cerr << "--input argument could not be found in filesystem. Received: " << std::quoted(inputArgument) << "\n";
+            return 1;
+        }
+        if (!std::filesystem::is_directory(inputArgument))
+        {
+            std::cerr << "--input argument was not a folder. View README.md for more information. Received:" << std::quoted(inputArgument) << "\n";
+            return 1;
+        }
+        if (!inputArgument.ends_with('/') && !inputArgument.ends_with('\\'))
+        {
+            inputArgument += '/';
+        }
     }
 
-    std::string inputArgument = program.get<std::string>("--input");
-    DBOUT << "input argument: " << std::quoted(inputArgument) << '\n';
-    if (!std::filesystem::exists(inputArgument))
+    std::vector<OutputProfile> profiles = {};
+    if (program.is_used("--profiles"))
     {
-        std::cerr << "--input argument could not be found in filesystem. Received: " << std::quoted(inputArgument) << "\n";
-        return 1;
+        for (const auto name : {"--output", "--format", "--languages", "--countries", "--grid"})
+        {
+            if (program.is_used(name))
+            {
+                std::cerr << "--profiles argument can not be combined with " << name << ", set it in the profiles file instead.\n";
+                return 1;
+            }
+        }
+        const std::string profilesArgument = program.get<std::string>("--profiles");
+        DBOUT << "profiles argument: " << std::quoted(profilesArgument) << '\n';
+        auto parsedProfiles = parseProfilesFile(profilesArgument);
+        if (!parsedProfiles.has_value())
+        {
+            return 1;
+        }
+        profiles = std::move(parsedProfiles.value());
+    }
+    else
+    {
+        OutputProfile profile = {};
+        try
+        {
+            profile.output = program.get<std::string>("--output");
+        }
+        catch (const std::exception &)
+        {
+            std::cerr << "--output argument is required unless --profiles is used.\n";
+            return 1;
+        }
+        profile.format = program.get<std::string>("--format");
+        DBOUT << "format argument: " << std::quoted(profile.format) << '\n';
+
+        try
+        {
+            auto languagesArgument = program.get<std::string>("--languages");
+            const auto splits = split(languagesArgument, ',');
+            for (const auto sv : splits)
+            {
+                if (!addSelectedLanguage(profile.languages, sv))
+                {
+                    return 1;
+                }
+            }
+        }
+        catch (const std::exception &err)
+        {
+            DBOUT << "No selected languages for localization. Only english latinization will be provided.\n";
+            DBOUT << "Received: " << err.what() << "\n";
+        }
+
+        try
+        {
+            auto countriesArgument = program.get<std::string>("--countries");
+            const auto splits = split(countriesArgument, ',');
+            for (const auto sv : splits)
+            {
+                if (!addSelectedCountry(profile.countries, sv))
+                {
+                    return 1;
+                }
+            }
+        }
+        catch (const std::exception &err)
+        {
+            DBOUT << "No selected countries, every country will be included.\n";
+            DBOUT << "Received: " << err.what() << "\n";
+        }
+
+        profile.grid = program.get<int>("--grid");
+        if (!validateProfile(profile))
+        {
+            return 1;
+        }
+        profiles.push_back(std::move(profile));
     }
-    if (!std::filesystem::is_directory(inputArgument))
+
+    const int threadsArgument = program.get<int>("--threads");
+    if (threadsArgument < 0)
     {
-        std::cerr << "--input argument was not a folder. View README.md for more information. Received:" << std::quoted(inputArgument) << "\n";
+        std::cerr << "--threads argument must not be negative. Received: " << threadsArgument << "\n";
         return 1;
     }
-    if (!inputArgument.ends_with('/') && !inputArgument.ends_with('\\'))
+    std::size_t threadCount = static_cast<std::size_t>(threadsArgument);
+    if (threadCount == 0)
     {
-        inputArgument += '/';
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
     }
+    DBOUT << "Using " << threadCount << " threads.\n";
 
-    std::string outputArgument = program.get<std::string>("--output");
-    DBOUT << "output argument: " << std::quoted(outputArgument) << '\n';
-    std::ofstream outputFile = std::ofstream(outputArgument);
-    if (!outputFile.good())
+    const std::string orderArgument = program.get<std::string>("--order");
+    const auto order = parseRecordOrder(orderArgument);
+    if (!order.has_value())
     {
-        std::cerr << "--output argument was not good. Could not open stream. Received: " << outputArgument << "\n";
+        std::cerr << "--order argument must be \"file\", \"hilbert\" or \"morton\". Received: " << std::quoted(orderArgument) << "\n";
         return 1;
     }
 
+    // The inputs are parsed once for the languages and countries of every profile
     std::set<ISOLanguage> SELECTED_LANGUAGES = {};
-    try
+    std::set<ISOCountryCode> SELECTED_COUNTRIES = {};
+    const bool everyCountry = std::any_of(profiles.begin(), profiles.end(), [](const OutputProfile &profile)
+                                          { return profile.countries.size() == 0; });
+    for (const auto &profile : profiles)
+    {
+        SELECTED_LANGUAGES.insert(profile.languages.begin(), profile.languages.end());
+        if (!everyCountry)
+        {
+            SELECTED_COUNTRIES.insert(profile.countries.begin(), profile.countries.end());
+        }
+    }
+
+    RunStats stats = RunStats(true);
+    if (program.is_used("--snapshot"))
     {
-        auto languagesArgument = program.get<std::string>("--languages");
-        const auto splits = split(languagesArgument, ',');
-        for (const auto sv : splits)
+        std::string snapshotArgument = program.get<std::string>("--snapshot");
+        DBOUT << "snapshot argument: " << std::quoted(snapshotArgument) << '\n';
+        if (!snapshotArgument.ends_with('/') && !snapshotArgument.ends_with('\\'))
         {
-            if (sv.size() != 2)
+            snapshotArgument += '/';
+        }
+        if (isUpdate)
+        {
+            const std::string deltasArgument = program.get<std::string>("--deltas");
+            DBOUT << "deltas argument: " << std::quoted(deltasArgument) << '\n';
+            if (!std::filesystem::is_directory(deltasArgument))
             {
-                std::cerr << "Language provided is not an ISO 639-1 code, it has more than 2 characters.\n";
+                std::cerr << "--deltas argument was not a folder. Received: " << std::quoted(deltasArgument) << "\n";
                 return 1;
             }
-            for (const auto c : sv)
+            const auto info = readSnapshotInfo(snapshotArgument);
+            if (!info.has_value())
             {
-                if (!(('a' <= c) && (c <= 'z')))
-                {
-                    std::cerr << "Language provided is not an ISO 639-1 code, the characters are not lowercase.\n";
-                    return 1;
-                }
+                std::cerr << "--snapshot argument is not a snapshot, it has no valid snapshot.json. Received: " << std::quoted(snapshotArgument) << "\n";
+                return 1;
+            }
+            // The snapshot only holds the names and cities it was created for
+            if (!std::includes(info->languages.begin(), info->languages.end(), SELECTED_LANGUAGES.begin(), SELECTED_LANGUAGES.end()))
+            {
+                std::cerr << "The snapshot was not created for every selected language, create it again with them.\n";
+                return 1;
+            }
+            if (info->countries.size() != 0 && (SELECTED_COUNTRIES.size() == 0 || !std::includes(info->countries.begin(), info->countries.end(), SELECTED_COUNTRIES.begin(), SELECTED_COUNTRIES.end())))
+            {
+                std::cerr << "The snapshot was not created for every selected country, create it again with them.\n";
+                return 1;
             }
-            SELECTED_LANGUAGES.insert(std::string(sv));
-            DBOUT << "Added language \"" << sv << "\" to selected set.\n";
+            Stage deltasStage = stats.begin("deltas");
+            if (!applySnapshotDeltas(snapshotArgument, deltasArgument, deltasStage.progress()))
+            {
+                return 1;
+            }
+            stats.finish(deltasStage);
         }
-    }
-    catch (const std::exception &err)
-    {
-        DBOUT << "No selected languages for localization. Only english latinization will be provided.\n";
-        DBOUT << "Received: " << err.what() << "\n";
+        else
+        {
+            Stage snapshotStage = stats.begin("snapshot");
+            if (!createSnapshot(snapshotArgument, citiesArgument, inputArgument, SELECTED_LANGUAGES, SELECTED_COUNTRIES, threadCount, snapshotStage.progress()))
+            {
+                return 1;
+            }
+            stats.finish(snapshotStage);
+        }
+        citiesArgument = snapshotCitiesPath(snapshotArgument);
+        inputArgument = snapshotArgument;
     }
 
-    std::set<ISOCountryCode> SELECTED_COUNTRIES = {};
-    try
+    const std::string inputLocalizedCountriesFolderPath = inputArgument + "localized-countries/";
+    const std::string inputAlternateNamesPath = findAlternateNamesPath(inputArgument);
+    const std::string inputAdmin1CodesASCIIPath = inputArgument + "admin1CodesASCII.txt";
+
+    // The streams are declared before the sinks so they outlive them
+    std::vector<std::unique_ptr<std::ofstream>> outputFiles = {};
+    std::vector<std::unique_ptr<RecordSink>> sinks = {};
+    for (const auto &profile : profiles)
     {
-        auto countriesArgument = program.get<std::string>("--countries");
-        const auto splits = split(countriesArgument, ',');
-        for (const auto sv : splits)
+        DBOUT << "output argument: " << std::quoted(profile.output) << '\n';
+        if (profile.format == "packs")
         {
-            if (sv.size() != 2)
+            // The output is a folder, the sink writes a file per pack into it
+            std::error_code error = {};
+            std::filesystem::create_directories(profile.output, error);
+            const std::filesystem::path folder = std::filesystem::path(profile.output);
+            std::vector<std::string> filenames = {std::string(PackRecordSink::MANIFEST_FILENAME), std::string(PackRecordSink::BASE_FILENAME)};
+            for (const auto &language : profile.languages)
             {
-                std::cerr << "Country code provided is not an ISO 3166-1 Alpha-2 code, it has more than 2 characters.\n";
-                return 1;
+                filenames.push_back(PackRecordSink::namesFilename(language));
             }
-            for (const auto c : sv)
+            std::vector<std::ostream *> streams = {};
+            for (const auto &filename : filenames)
             {
-                if (!(('A' <= c) && (c <= 'Z')))
+                outputFiles.push_back(std::make_unique<std::ofstream>(folder / filename, std::ios::out | std::ios::binary));
+                if (error || !outputFiles.back()->good())
                 {
-                    std::cerr << "Country code provided is not an ISO ISO 3166-1 Alpha-2 code, the characters are not uppercase.\n";
+                    std::cerr << "--output argument was not good. Could not open " << std::quoted(filename) << " in the folder. Received: " << profile.output << "\n";
                     return 1;
                 }
+                streams.push_back(outputFiles.back().get());
+            }
+            const std::vector<std::ostream *> namesStreams = std::vector<std::ostream *>(streams.begin() + 2, streams.end());
+            std::unique_ptr<RecordSink> sink = std::make_unique<PackRecordSink>(*streams[0], *streams[1], profile.languages, namesStreams);
+            if (profiles.size() > 1)
+            {
+                sink = std::make_unique<ProfileRecordSink>(std::move(sink), profile.languages, profile.countries);
             }
-            SELECTED_COUNTRIES.insert(std::string(sv));
-            DBOUT << "Added country \"" << sv << "\" to selected set.\n";
+            sinks.push_back(std::move(sink));
+            continue;
         }
+        outputFiles.push_back(std::make_unique<std::ofstream>(profile.output, profile.format != "txt" ? std::ios::out | std::ios::binary : std::ios::out));
+        std::ofstream &outputFile = *outputFiles.back();
+        if (!outputFile.good())
+        {
+            std::cerr << "--output argument was not good. Could not open stream. Received: " << profile.output << "\n";
+            return 1;
+        }
+
+        std::unique_ptr<RecordSink> sink = nullptr;
+        if (profile.format == "binary")
+        {
+            sink = std::make_unique<BinaryRecordSink>(outputFile, profile.languages, static_cast<std::uint32_t>(profile.grid));
+        }
+        else if (profile.format == "json")
+        {
+            sink = std::make_unique<JsonRecordSink>(outputFile);
+        }
+        else
+        {
+            sink = std::make_unique<TxtRecordSink>(outputFile);
+        }
+        if (profiles.size() > 1)
+        {
+            sink = std::make_unique<ProfileRecordSink>(std::move(sink), profile.languages, profile.countries);
+        }
+        sinks.push_back(std::move(sink));
     }
-    catch (const std::exception &err)
-    {
-        DBOUT << "No selected countries, every country will be included.\n";
-        DBOUT << "Received: " << err.what() << "\n";
-    }
+    std::unique_ptr<RecordSink> sink = sinks.size() == 1 ? std::move(sinks.front()) : std::make_unique<FanOutRecordSink>(std::move(sinks));
 
-    const std::string inputLocalizedCountriesFolderPath = inputArgument + "localized-countries/";
-    const std::string inputAlternateNamesPath = inputArgument + "alternateNames.txt";
-    const std::string inputAdmin1CodesASCIIPath = inputArgument + "admin1CodesASCII.txt";
+    parseCities(*sink, citiesArgument, inputAlternateNamesPath, SELECTED_LANGUAGES, SELECTED_COUNTRIES, inputAdmin1CodesASCIIPath, inputLocalizedCountriesFolderPath, threadCount, order.value(), stats);
 
-    parseCities(outputFile, citiesArgument, inputAlternateNamesPath, SELECTED_LANGUAGES, SELECTED_COUNTRIES, inputAdmin1CodesASCIIPath, inputLocalizedCountriesFolderPath);
+    if (program.is_used("--stats"))
+    {
+        const std::string statsArgument = program.get<std::string>("--stats");
+        DBOUT << "stats argument: " << std::quoted(statsArgument) << '\n';
+        nlohmann::json outputs = nlohmann::json::array();
+        for (const auto &profile : profiles)
+        {
+            outputs.push_back({{"output", profile.output}, {"format", profile.format}});
+        }
+        const nlohmann::json run = {
+            {"cities", citiesArgument},
+            {"input", inputArgument},
+            {"languages", SELECTED_LANGUAGES},
+            {"countries", SELECTED_COUNTRIES},
+            {"threads", threadCount},
+            {"order", orderArgument},
+            {"outputs", outputs},
+        };
+        if (!writeStats(statsArgument, stats, run))
+        {
+            std::cerr << "--stats argument was not good. Could not write the report. Received: " << std::quoted(statsArgument) << "\n";
+            return 1;
+        }
+    }
 
     return 0;
 }
+#endif // !GENERATORCPP_NO_MAIN
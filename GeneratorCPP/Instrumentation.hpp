@@ -0,0 +1,254 @@
+#ifndef __HEADER_INSTRUMENTATION_HPP_CPP_
+#define __HEADER_INSTRUMENTATION_HPP_CPP_
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdint>
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Measurements of the stages of a GeneratorCPP run: wall and CPU time, lines and bytes read, the tables a stage
+// built and the peak RSS when it finished. GeneratorCPP writes them with --stats, progress goes to std::cerr.
+
+// The most memory the process has held so far
+inline std::size_t peakRssBytes() noexcept
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = {};
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize;
+#elif defined(__linux__)
+    std::ifstream status = std::ifstream("/proc/self/status");
+    for (std::string line; std::getline(status, line);)
+    {
+        if (line.starts_with("VmHWM:"))
+        {
+            std::size_t kilobytes = 0;
+            std::istringstream(line.substr(6)) >> kilobytes;
+            return kilobytes * 1024;
+        }
+    }
+    return 0;
+#else
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    // macOS reports bytes
+    return static_cast<std::size_t>(usage.ru_maxrss);
+#endif
+}
+
+// User and system time of every thread of the process so far
+inline double processCpuSeconds() noexcept
+{
+#ifdef _WIN32
+    FILETIME creation = {}, exit = {}, kernel = {}, user = {};
+    GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+    const auto ticks = [](const FILETIME &time)
+    {
+        return (static_cast<std::uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+    };
+    // FILETIME counts 100 ns ticks
+    return static_cast<double>(ticks(kernel) + ticks(user)) / 1e7;
+#else
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) + static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#endif
+}
+
+// Counts the lines and bytes a stage has read and reports them on std::cerr at most once per interval.
+// add is thread-safe, loops count with a ProgressCounter that only adds every few thousand lines.
+class Progress
+{
+    std::string stage;
+    bool isReported;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::duration interval;
+    std::atomic<std::size_t> lines_ = 0;
+    std::atomic<std::size_t> bytes_ = 0;
+    // Time of the next report since start, in steady_clock ticks
+    std::atomic<std::int64_t> nextReport;
+
+public:
+    Progress(std::string stage, const bool isReported, const std::chrono::steady_clock::duration interval = std::chrono::seconds(1)) noexcept
+        : stage{std::move(stage)}, isReported{isReported}, interval{interval}, nextReport{interval.count()} {}
+
+    void add(const std::size_t lines, const std::size_t bytes) noexcept
+    {
+        const std::size_t totalLines = lines_.fetch_add(lines) + lines;
+        const std::size_t totalBytes = bytes_.fetch_add(bytes) + bytes;
+        if (!isReported)
+        {
+            return;
+        }
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        std::int64_t next = nextReport.load();
+        // Only the thread that moves the next report forward prints
+        if (elapsed.count() < next || !nextReport.compare_exchange_strong(next, (elapsed + interval).count()))
+        {
+            return;
+        }
+        const double seconds = std::chrono::duration<double>(elapsed).count();
+        std::ostringstream message = {};
+        message << std::fixed << std::setprecision(1) << "[" << stage << "] " << totalLines << " lines, "
+                << totalBytes / 1e6 << " MB, " << totalLines / seconds / 1e6 << " M lines/s\n";
+        std::cerr << message.str();
+    }
+
+    const std::string &name() const noexcept
+    {
+        return stage;
+    }
+    std::size_t lines() const noexcept
+    {
+        return lines_.load();
+    }
+    std::size_t bytes() const noexcept
+    {
+        return bytes_.load();
+    }
+};
+
+// The lines one thread reads, added to a Progress in batches
+class ProgressCounter
+{
+    Progress &progress;
+    std::size_t lines = 0;
+    std::size_t bytes = 0;
+
+public:
+    static constexpr std::size_t BATCH_LINES = 4096;
+
+    explicit ProgressCounter(Progress &progress) noexcept : progress{progress} {}
+    ~ProgressCounter()
+    {
+        flush();
+    }
+    ProgressCounter(const ProgressCounter &) = delete;
+    ProgressCounter &operator=(const ProgressCounter &) = delete;
+
+    // size does not include the line break
+    void line(const std::size_t size) noexcept
+    {
+        lines++;
+        bytes += size + 1;
+        if (lines == BATCH_LINES)
+        {
+            flush();
+        }
+    }
+    void flush() noexcept
+    {
+        if (lines != 0)
+        {
+            progress.add(lines, bytes);
+            lines = 0;
+            bytes = 0;
+        }
+    }
+};
+
+struct StageStats
+{
+    std::string name = {};
+    double wallSeconds = 0;
+    double cpuSeconds = 0;
+    std::size_t lines = 0;
+    std::size_t bytes = 0;
+    std::size_t peakRssBytes = 0;
+    // Sizes and load factors of the tables the stage built, in the order they were added
+    std::vector<std::pair<std::string, double>> tables = {};
+};
+
+// A running stage, from its construction to RunStats::finish
+class Stage
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double startCpuSeconds = processCpuSeconds();
+    Progress progress_;
+    std::vector<std::pair<std::string, double>> tables = {};
+
+    friend class RunStats;
+
+public:
+    Stage(std::string name, const bool isReported) noexcept : progress_{std::move(name), isReported} {}
+
+    Progress &progress() noexcept
+    {
+        return progress_;
+    }
+    void table(std::string name, const double value) noexcept
+    {
+        tables.push_back({std::move(name), value});
+    }
+};
+
+// The stages of a run in the order they finished
+class RunStats
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double startCpuSeconds = processCpuSeconds();
+    bool isProgressReported;
+    std::vector<StageStats> stages_ = {};
+
+public:
+    explicit RunStats(const bool isProgressReported) noexcept : isProgressReported{isProgressReported} {}
+
+    // Stage holds atomics and can not be moved, the result is constructed in place
+    Stage begin(std::string name) const noexcept
+    {
+        return Stage(std::move(name), isProgressReported);
+    }
+    const StageStats &finish(Stage &stage) noexcept
+    {
+        StageStats stats = {};
+        stats.name = stage.progress_.name();
+        stats.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - stage.start).count();
+        stats.cpuSeconds = processCpuSeconds() - stage.startCpuSeconds;
+        stats.lines = stage.progress_.lines();
+        stats.bytes = stage.progress_.bytes();
+        stats.peakRssBytes = peakRssBytes();
+        stats.tables = std::move(stage.tables);
+        stages_.push_back(std::move(stats));
+        const StageStats &s = stages_.back();
+        if (isProgressReported)
+        {
+            std::ostringstream message = {};
+            message << std::fixed << std::setprecision(2) << "[" << s.name << "] finished in " << s.wallSeconds << " s ("
+                    << s.cpuSeconds << " s CPU), " << s.lines << " lines, peak RSS " << s.peakRssBytes / 1e6 << " MB\n";
+            std::cerr << message.str();
+        }
+        return s;
+    }
+
+    const std::vector<StageStats> &stages() const noexcept
+    {
+        return stages_;
+    }
+    double wallSeconds() const noexcept
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    double cpuSeconds() const noexcept
+    {
+        return processCpuSeconds() - startCpuSeconds;
+    }
+};
+
+#endif // !__HEADER_INSTRUMENTATION_HPP_CPP_
@@ -0,0 +1,125 @@
+#ifndef __HEADER_JSONWRITER_HPP_CPP_
+#define __HEADER_JSONWRITER_HPP_CPP_
+
+#include <string>
+#include <string_view>
+#include <ostream>
+#include <charconv>
+#include <limits>
+#include <cstddef>
+
+// Writes JSON tokens into a buffer that is flushed to the stream once it is full.
+// Strings and numbers are written the same way JavaScript's JSON.stringify writes them,
+// so the output is byte-identical to what generate.js produces.
+class JsonWriter
+{
+    std::ostream &os;
+    std::string buffer = {};
+    std::size_t capacity;
+
+    void flushIfFull() noexcept
+    {
+        if (buffer.size() >= capacity)
+        {
+            flush();
+        }
+    }
+
+public:
+    JsonWriter(std::ostream &os, const std::size_t capacity = 1 << 20) : os{os}, capacity{capacity}
+    {
+        buffer.reserve(capacity + 1024);
+    }
+    ~JsonWriter()
+    {
+        flush();
+    }
+
+    void flush() noexcept
+    {
+        os.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        buffer.clear();
+    }
+
+    void raw(const char c) noexcept
+    {
+        buffer += c;
+    }
+
+    void raw(const std::string_view sv) noexcept
+    {
+        buffer.append(sv);
+        flushIfFull();
+    }
+
+    // Escapes '"', '\\' and control characters, everything else (including UTF-8) is copied as is
+    void string(const std::string_view sv) noexcept
+    {
+        static constexpr char HEX[] = "0123456789abcdef";
+        buffer += '"';
+        std::size_t start = 0;
+        for (std::size_t i = 0; i < sv.size(); i++)
+        {
+            const unsigned char c = static_cast<unsigned char>(sv[i]);
+            if (c >= 0x20 && c != '"' && c != '\\')
+            {
+                continue;
+            }
+            buffer.append(sv.substr(start, i - start));
+            start = i + 1;
+            switch (c)
+            {
+            case '"':
+                buffer += "\\\"";
+                break;
+            case '\\':
+                buffer += "\\\\";
+                break;
+            case '\b':
+                buffer += "\\b";
+                break;
+            case '\f':
+                buffer += "\\f";
+                break;
+            case '\n':
+                buffer += "\\n";
+                break;
+            case '\r':
+                buffer += "\\r";
+                break;
+            case '\t':
+                buffer += "\\t";
+                break;
+            default:
+                buffer += "\\u00";
+                buffer += HEX[c >> 4];
+                buffer += HEX[c & 0xF];
+                break;
+            }
+        }
+        buffer.append(sv.substr(start));
+        buffer += '"';
+        flushIfFull();
+    }
+
+    // Writes the shortest representation that round-trips, like JavaScript does for numbers
+    // between 1e-6 and 1e21. Non-finite numbers are written as null and -0 as 0, like JSON.stringify.
+    void number(const double value) noexcept
+    {
+        if (value != value || value == std::numeric_limits<double>::infinity() || value == -std::numeric_limits<double>::infinity())
+        {
+            buffer += "null";
+            return;
+        }
+        if (value == 0)
+        {
+            buffer += '0';
+            return;
+        }
+        char digits[64] = {};
+        const auto result = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::fixed);
+        buffer.append(digits, result.ptr);
+    }
+};
+
+#endif // !__HEADER_JSONWRITER_HPP_CPP_
@@ -0,0 +1,219 @@
+#ifndef __HEADER_MEMORYMAPPEDFILE_HPP_CPP_
+#define __HEADER_MEMORYMAPPEDFILE_HPP_CPP_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A read-only view of an entire file mapped into memory.
+// The view stays valid for as long as the object is alive, the object can be moved but not copied.
+class MemoryMappedFile
+{
+    const char *data_ = nullptr;
+    std::size_t size_ = 0;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+
+    void close() noexcept
+    {
+#ifdef _WIN32
+        if (data_ != nullptr)
+        {
+            UnmapViewOfFile(data_);
+        }
+        if (mapping_ != nullptr)
+        {
+            CloseHandle(mapping_);
+        }
+        if (file_ != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(file_);
+        }
+        file_ = INVALID_HANDLE_VALUE;
+        mapping_ = nullptr;
+#else
+        if (data_ != nullptr)
+        {
+            munmap(const_cast<char *>(data_), size_);
+        }
+        if (fd_ != -1)
+        {
+            ::close(fd_);
+        }
+        fd_ = -1;
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+public:
+    MemoryMappedFile() noexcept = default;
+    MemoryMappedFile(const MemoryMappedFile &) = delete;
+    MemoryMappedFile &operator=(const MemoryMappedFile &) = delete;
+    MemoryMappedFile(MemoryMappedFile &&other) noexcept
+    {
+        *this = std::move(other);
+    }
+    MemoryMappedFile &operator=(MemoryMappedFile &&other) noexcept
+    {
+        if (this != &other)
+        {
+            close();
+            data_ = other.data_;
+            size_ = other.size_;
+#ifdef _WIN32
+            file_ = other.file_;
+            mapping_ = other.mapping_;
+            other.file_ = INVALID_HANDLE_VALUE;
+            other.mapping_ = nullptr;
+#else
+            fd_ = other.fd_;
+            other.fd_ = -1;
+#endif
+            other.data_ = nullptr;
+            other.size_ = 0;
+        }
+        return *this;
+    }
+    ~MemoryMappedFile()
+    {
+        close();
+    }
+
+    // Maps the file at path, returns false if the file could not be opened or mapped.
+    // An empty file is mapped successfully with a size of 0.
+    bool open(const std::string &path) noexcept
+    {
+        close();
+#ifdef _WIN32
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        LARGE_INTEGER fileSize = {};
+        if (!GetFileSizeEx(file_, &fileSize))
+        {
+            close();
+            return false;
+        }
+        if (fileSize.QuadPart == 0)
+        {
+            return true;
+        }
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_ == nullptr)
+        {
+            close();
+            return false;
+        }
+        data_ = static_cast<const char *>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        if (data_ == nullptr)
+        {
+            close();
+            return false;
+        }
+        size_ = static_cast<std::size_t>(fileSize.QuadPart);
+#else
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if (fd_ == -1)
+        {
+            return false;
+        }
+        struct stat st = {};
+        if (fstat(fd_, &st) != 0)
+        {
+            close();
+            return false;
+        }
+        if (st.st_size == 0)
+        {
+            return true;
+        }
+        void *mapped = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (mapped == MAP_FAILED)
+        {
+            close();
+            return false;
+        }
+        data_ = static_cast<const char *>(mapped);
+        size_ = static_cast<std::size_t>(st.st_size);
+        // The parsers only walk forward through the file
+        madvise(mapped, size_, MADV_SEQUENTIAL);
+#endif
+        return true;
+    }
+
+    const char *data() const noexcept
+    {
+        return data_;
+    }
+    std::size_t size() const noexcept
+    {
+        return size_;
+    }
+    std::string_view view() const noexcept
+    {
+        return std::string_view(data_, size_);
+    }
+};
+
+// Cuts view into at most chunkCount pieces whose boundaries fall directly after a '\n'.
+// Every line of view is contained in exactly one chunk, chunks may be empty.
+inline std::vector<std::string_view> splitIntoLineChunks(const std::string_view view, const std::size_t chunkCount) noexcept
+{
+    std::vector<std::string_view> chunks = {};
+    std::size_t begin = 0;
+    for (std::size_t i = 1; i <= chunkCount && begin < view.size(); i++)
+    {
+        std::size_t end = view.size();
+        if (i != chunkCount)
+        {
+            end = std::max(begin, view.size() / chunkCount * i);
+            const auto newline = view.find('\n', end);
+            end = newline == std::string_view::npos ? view.size() : newline + 1;
+        }
+        chunks.push_back(view.substr(begin, end - begin));
+        begin = end;
+    }
+    return chunks;
+}
+
+// Calls onLine for every line of chunk, the same way std::getline would split it.
+// The '\n' is not part of the line, a last line without a '\n' is still visited.
+template <typename F>
+void forEachLine(const std::string_view chunk, F &&onLine)
+{
+    std::size_t begin = 0;
+    while (begin < chunk.size())
+    {
+        auto end = chunk.find('\n', begin);
+        if (end == std::string_view::npos)
+        {
+            end = chunk.size();
+        }
+        onLine(chunk.substr(begin, end - begin));
+        begin = end + 1;
+    }
+}
+
+#endif // !__HEADER_MEMORYMAPPEDFILE_HPP_CPP_
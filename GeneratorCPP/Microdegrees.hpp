@@ -0,0 +1,107 @@
+#ifndef __HEADER_MICRODEGREES_HPP_CPP_
+#define __HEADER_MICRODEGREES_HPP_CPP_
+
+#include <string_view>
+#include <optional>
+#include <charconv>
+#include <cstdint>
+#include <cstddef>
+
+// Coordinates in fixed-point millionths of a degree. A microdegree is about 11 cm at the equator,
+// finer than the 5 decimals of the cities file, and ±180 degrees fit in an int32.
+typedef std::int32_t Microdegrees;
+
+constexpr std::int64_t MICRODEGREES_PER_DEGREE = 1000000;
+constexpr Microdegrees MAX_LATITUDE_MICRODEGREES = 90 * MICRODEGREES_PER_DEGREE;
+constexpr Microdegrees MAX_LONGITUDE_MICRODEGREES = 180 * MICRODEGREES_PER_DEGREE;
+
+// Parses a decimal number of degrees like "-12.34567", rounded to the nearest microdegree.
+// Returns std::nullopt when sv is not [+-]digits[.digits] or is outside [-maxMicrodegrees, maxMicrodegrees].
+inline std::optional<Microdegrees> parseMicrodegrees(const std::string_view sv, const Microdegrees maxMicrodegrees) noexcept
+{
+    const char *first = sv.data();
+    const char *const last = sv.data() + sv.size();
+    const bool isNegative = first != last && *first == '-';
+    if (first != last && (*first == '-' || *first == '+'))
+    {
+        first++;
+    }
+    // from_chars would accept a second sign
+    if (first == last || *first < '0' || *first > '9')
+    {
+        return std::nullopt;
+    }
+    std::int64_t degrees = 0;
+    auto result = std::from_chars(first, last, degrees);
+    // Anything past 3 digits is out of range, this also keeps the arithmetic below from overflowing
+    if (result.ec != std::errc() || degrees > 1000)
+    {
+        return std::nullopt;
+    }
+    std::int64_t value = degrees * MICRODEGREES_PER_DEGREE;
+    if (result.ptr != last)
+    {
+        if (*result.ptr != '.')
+        {
+            return std::nullopt;
+        }
+        const char *digit = result.ptr + 1;
+        std::int64_t scale = MICRODEGREES_PER_DEGREE / 10;
+        for (; digit != last && *digit >= '0' && *digit <= '9'; digit++)
+        {
+            if (scale > 0)
+            {
+                value += (*digit - '0') * scale;
+            }
+            else if (scale == 0 && *digit >= '5')
+            {
+                // The first digit past the microdegrees rounds half away from zero
+                value++;
+            }
+            scale = scale > 0 ? scale / 10 : -1;
+        }
+        if (digit != last || digit == result.ptr + 1)
+        {
+            return std::nullopt;
+        }
+    }
+    if (value > maxMicrodegrees)
+    {
+        return std::nullopt;
+    }
+    return static_cast<Microdegrees>(isNegative ? -value : value);
+}
+
+inline double toDegrees(const Microdegrees microdegrees) noexcept
+{
+    // Both operands are exact, so this is the double nearest to the decimal value
+    return static_cast<double>(microdegrees) / static_cast<double>(MICRODEGREES_PER_DEGREE);
+}
+
+// Writes microdegrees as decimal degrees without trailing zeros, like "-12.34567" or "3".
+// buffer must hold at least MICRODEGREES_TEXT_SIZE characters, returns the number written.
+constexpr std::size_t MICRODEGREES_TEXT_SIZE = 16;
+inline std::size_t formatMicrodegrees(char *buffer, const Microdegrees microdegrees) noexcept
+{
+    const std::int64_t value = microdegrees;
+    const std::int64_t magnitude = value < 0 ? -value : value;
+    char *out = buffer;
+    if (value < 0)
+    {
+        *out++ = '-';
+    }
+    out = std::to_chars(out, buffer + MICRODEGREES_TEXT_SIZE, magnitude / MICRODEGREES_PER_DEGREE).ptr;
+    std::int64_t fraction = magnitude % MICRODEGREES_PER_DEGREE;
+    if (fraction != 0)
+    {
+        *out++ = '.';
+        for (std::int64_t scale = MICRODEGREES_PER_DEGREE / 10; fraction != 0; scale /= 10)
+        {
+            *out++ = static_cast<char>('0' + fraction / scale);
+            fraction %= scale;
+        }
+    }
+    return static_cast<std::size_t>(out - buffer);
+}
+
+#endif // !__HEADER_MICRODEGREES_HPP_CPP_
@@ -0,0 +1,306 @@
+#ifndef __HEADER_NEARESTGRID_HPP_CPP_
+#define __HEADER_NEARESTGRID_HPP_CPP_
+
+#include <vector>
+#include <span>
+#include <optional>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
+
+#include "SpatialIndex.hpp"
+#include "Microdegrees.hpp"
+
+// A raster of the nearest record over the whole globe, stored in the binary dataset.
+//
+// The globe is cut into cells of 1 / cellsPerDegree degrees of latitude and longitude, row 0 starts at
+// latitude -90 and column 0 at longitude -180. Every cell holds one uint32:
+// - the id of the nearest record of every point inside the cell, when that record is the same everywhere,
+// - NEAREST_GRID_LIST | offset, when the nearest record is one of a short list of candidates. The candidates
+//   section holds the list at offset as { count, id[count] } with the ids in ascending order,
+// - NEAREST_GRID_AMBIGUOUS, when there are more than NEAREST_GRID_MAX_CANDIDATES candidates.
+// The candidates are exact: the nearest record of a point is always among those of its cell.
+
+constexpr std::uint32_t NEAREST_GRID_LIST = 0x80000000;
+constexpr std::uint32_t NEAREST_GRID_AMBIGUOUS = 0xFFFFFFFF;
+constexpr std::uint32_t NEAREST_GRID_MAX_CANDIDATES = 8;
+constexpr std::uint32_t NEAREST_GRID_MAX_CELLS_PER_DEGREE = 20;
+
+struct NearestGridHeader
+{
+    std::uint32_t cellsPerDegree;
+    std::uint32_t rows;
+    std::uint32_t columns;
+    std::uint32_t maxCandidates;
+};
+static_assert(sizeof(NearestGridHeader) == 16, "NearestGridHeader must not have padding");
+
+struct NearestGrid
+{
+    NearestGridHeader header = {};
+    std::vector<std::uint32_t> cells = {};
+    std::vector<std::uint32_t> candidates = {};
+    std::size_t listCells = 0;
+    std::size_t ambiguousCells = 0;
+};
+
+// Returns the largest dot product between n and a point of the cell [phi0, phi1] x [lambda0, lambda1], in radians.
+// On the sphere, the dot product only has one local maximum, so the largest value is either that maximum
+// or on an edge of the cell. On each edge the dot product is a sinusoid whose peak has a closed form.
+inline double maximumDotInCell(const UnitVector &n, const double phi0, const double phi1, const double lambda0, const double lambda1) noexcept
+{
+    const auto dot = [&](const double phi, const double lambda)
+    {
+        return std::cos(phi) * (n.x * std::cos(lambda) + n.y * std::sin(lambda)) + n.z * std::sin(phi);
+    };
+    const auto inside = [](const double value, const double low, const double high)
+    {
+        return value >= low && value <= high;
+    };
+    const double length = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+    if (length == 0)
+    {
+        return 0;
+    }
+    double maximum = std::max({dot(phi0, lambda0), dot(phi0, lambda1), dot(phi1, lambda0), dot(phi1, lambda1)});
+    const double peakPhi = std::asin(std::clamp(n.z / length, -1.0, 1.0));
+    const double peakLambda = std::atan2(n.y, n.x);
+    if (inside(peakPhi, phi0, phi1) && inside(peakLambda, lambda0, lambda1))
+    {
+        return length;
+    }
+    // Along a parallel the peak is at the longitude of n
+    if (inside(peakLambda, lambda0, lambda1))
+    {
+        maximum = std::max({maximum, dot(phi0, peakLambda), dot(phi1, peakLambda)});
+    }
+    // Along a meridian the dot product is a * cos(phi) + n.z * sin(phi)
+    for (const double lambda : {lambda0, lambda1})
+    {
+        const double phi = std::atan2(n.z, n.x * std::cos(lambda) + n.y * std::sin(lambda));
+        if (inside(phi, phi0, phi1))
+        {
+            maximum = std::max(maximum, dot(phi, lambda));
+        }
+    }
+    return maximum;
+}
+
+// Builds the grid of the points of coordinates, count pairs of { latitude, longitude } in degrees like SpatialIndex.
+// The candidates of a cell are the records within reach of the cell that are nearer than the nearest record
+// of its center somewhere in the cell: for a point p of the cell and the nearest record s of its center,
+// a record q can only be nearest to p if q is nearer than s, which is a half-space test against the cell.
+inline NearestGrid buildNearestGrid(const double *coordinates, const std::size_t count, const std::uint32_t cellsPerDegree) noexcept
+{
+    NearestGrid grid = {};
+    grid.header = {cellsPerDegree, 180 * cellsPerDegree, 360 * cellsPerDegree, NEAREST_GRID_MAX_CANDIDATES};
+    if (count == 0 || count >= NEAREST_GRID_LIST)
+    {
+        grid.cells.assign(std::size_t(grid.header.rows) * grid.header.columns, NEAREST_GRID_AMBIGUOUS);
+        grid.ambiguousCells = grid.cells.size();
+        return grid;
+    }
+    const SpatialIndex index = SpatialIndex(coordinates, count);
+    std::vector<UnitVector> points = {};
+    points.reserve(count);
+    for (std::size_t i = 0; i < count; i++)
+    {
+        points.push_back(toUnitVector(coordinates[2 * i], coordinates[2 * i + 1]));
+    }
+    const auto chord = [](const UnitVector &a, const UnitVector &b)
+    {
+        return std::sqrt((a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y) + (a.z - b.z) * (a.z - b.z));
+    };
+
+    grid.cells.reserve(std::size_t(grid.header.rows) * grid.header.columns);
+    // Every record within reach is collected, so a cell with too many of them is not pruned any further
+    const std::size_t limit = 16 * NEAREST_GRID_MAX_CANDIDATES;
+    std::vector<std::int32_t> reachable = {};
+    std::vector<std::uint32_t> candidates = {};
+    std::vector<std::uint32_t> previous = {};
+    std::uint32_t previousOffset = 0;
+    const double size = 1.0 / cellsPerDegree;
+    for (std::uint32_t row = 0; row < grid.header.rows; row++)
+    {
+        const double latitude0 = -90 + row * size;
+        const double latitude1 = -90 + (row + 1) * size;
+        for (std::uint32_t column = 0; column < grid.header.columns; column++)
+        {
+            const double longitude0 = -180 + column * size;
+            const double longitude1 = -180 + (column + 1) * size;
+            const double centerLatitude = (latitude0 + latitude1) / 2;
+            const double centerLongitude = (longitude0 + longitude1) / 2;
+            const UnitVector center = toUnitVector(centerLatitude, centerLongitude);
+
+            // The cell is inside the ball of radius r around its center, the farthest points are corners
+            double r = 0;
+            for (const auto &corner : {toUnitVector(latitude0, longitude0), toUnitVector(latitude0, longitude1),
+                                       toUnitVector(latitude1, longitude0), toUnitVector(latitude1, longitude1)})
+            {
+                r = std::max(r, chord(center, corner));
+            }
+            const auto nearest = static_cast<std::uint32_t>(index.nearest(centerLatitude, centerLongitude, std::numeric_limits<double>::infinity()));
+            // A point p of the cell is at most r + d from s, so its nearest record is at most 2r + d from the center
+            const double reach = chord(center, points[nearest]) + 2 * r + 1e-9;
+            reachable.clear();
+            index.within(center, reach, reachable, limit);
+            if (reachable.size() >= limit)
+            {
+                grid.cells.push_back(NEAREST_GRID_AMBIGUOUS);
+                grid.ambiguousCells++;
+                continue;
+            }
+
+            candidates.clear();
+            candidates.push_back(nearest);
+            for (const auto id : reachable)
+            {
+                const auto &q = points[id];
+                const auto &s = points[nearest];
+                const UnitVector n = {q.x - s.x, q.y - s.y, q.z - s.z};
+                // The margin keeps records that are only nearer because of rounding, ties included
+                if (static_cast<std::uint32_t>(id) != nearest &&
+                    maximumDotInCell(n, latitude0 * RAD_CONVERT, latitude1 * RAD_CONVERT, longitude0 * RAD_CONVERT, longitude1 * RAD_CONVERT) > -1e-12)
+                {
+                    candidates.push_back(static_cast<std::uint32_t>(id));
+                }
+            }
+            if (candidates.size() == 1)
+            {
+                grid.cells.push_back(nearest);
+                continue;
+            }
+            if (candidates.size() > NEAREST_GRID_MAX_CANDIDATES)
+            {
+                grid.cells.push_back(NEAREST_GRID_AMBIGUOUS);
+                grid.ambiguousCells++;
+                continue;
+            }
+            std::sort(candidates.begin(), candidates.end());
+            // Neighbouring cells often have the same candidates, they share one list
+            if (candidates != previous)
+            {
+                previous = candidates;
+                previousOffset = static_cast<std::uint32_t>(grid.candidates.size());
+                grid.candidates.push_back(static_cast<std::uint32_t>(candidates.size()));
+                grid.candidates.insert(grid.candidates.end(), candidates.begin(), candidates.end());
+            }
+            grid.cells.push_back(NEAREST_GRID_LIST | previousOffset);
+            grid.listCells++;
+        }
+    }
+    return grid;
+}
+
+// A read-only view of a grid stored in a binary dataset
+class NearestGridView
+{
+    const NearestGridHeader *header = nullptr;
+    const std::uint32_t *cells = nullptr;
+    const std::uint32_t *candidateLists = nullptr;
+
+public:
+    NearestGridView() noexcept = default;
+
+    // Returns false if the grid is not consistent or references a record that does not exist
+    bool open(const NearestGridHeader *h, const std::uint32_t *c, const std::size_t cellCount,
+              const std::uint32_t *lists, const std::size_t listsSize, const std::size_t recordCount) noexcept
+    {
+        if (h->cellsPerDegree == 0 || h->cellsPerDegree > NEAREST_GRID_MAX_CELLS_PER_DEGREE ||
+            h->rows != 180 * h->cellsPerDegree || h->columns != 360 * h->cellsPerDegree ||
+            cellCount != std::size_t(h->rows) * h->columns)
+        {
+            return false;
+        }
+        for (std::size_t i = 0; i < cellCount; i++)
+        {
+            const auto cell = c[i];
+            if (cell == NEAREST_GRID_AMBIGUOUS)
+            {
+                continue;
+            }
+            if ((cell & NEAREST_GRID_LIST) == 0)
+            {
+                if (cell >= recordCount)
+                {
+                    return false;
+                }
+                continue;
+            }
+            const std::size_t offset = cell & ~NEAREST_GRID_LIST;
+            if (offset >= listsSize || lists[offset] == 0 || lists[offset] > h->maxCandidates || lists[offset] > listsSize - offset - 1)
+            {
+                return false;
+            }
+            for (std::size_t j = 1; j <= lists[offset]; j++)
+            {
+                if (lists[offset + j] >= recordCount)
+                {
+                    return false;
+                }
+            }
+        }
+        header = h;
+        cells = c;
+        candidateLists = lists;
+        return true;
+    }
+
+    bool empty() const noexcept
+    {
+        return header == nullptr;
+    }
+
+    // Returns the records that can be nearest to { latitude, longitude }.
+    // The span is empty when the grid cannot answer and the exact index has to be searched.
+    std::span<const std::uint32_t> candidates(const double latitude, const double longitude) const noexcept
+    {
+        if (header == nullptr || !(latitude >= -90 && latitude <= 90 && longitude >= -180 && longitude <= 180))
+        {
+            return {};
+        }
+        const auto row = std::min<std::size_t>(header->rows - 1, static_cast<std::size_t>((latitude + 90) * header->cellsPerDegree));
+        const auto column = std::min<std::size_t>(header->columns - 1, static_cast<std::size_t>((longitude + 180) * header->cellsPerDegree));
+        const std::uint32_t *cell = cells + row * header->columns + column;
+        if (*cell == NEAREST_GRID_AMBIGUOUS)
+        {
+            return {};
+        }
+        if ((*cell & NEAREST_GRID_LIST) == 0)
+        {
+            return std::span<const std::uint32_t>(cell, 1);
+        }
+        const std::uint32_t *list = candidateLists + (*cell & ~NEAREST_GRID_LIST);
+        return std::span<const std::uint32_t>(list + 1, list[0]);
+    }
+
+    // Same result as SpatialIndex::nearest over the records, or std::nullopt when the exact index has to be searched.
+    // Records at exactly the same distance may be resolved to a different one of them.
+    std::optional<std::int32_t> nearest(const double latitude, const double longitude, const double maxChord,
+                                        const Microdegrees *latitudes, const Microdegrees *longitudes) const noexcept
+    {
+        const auto records = candidates(latitude, longitude);
+        if (records.empty())
+        {
+            return std::nullopt;
+        }
+        const UnitVector q = toUnitVector(latitude, longitude);
+        std::int32_t best = -1;
+        double bestChordSquared = maxChord * maxChord;
+        for (const auto id : records)
+        {
+            const UnitVector p = toUnitVector(toDegrees(latitudes[id]), toDegrees(longitudes[id]));
+            const double chordSquared = (p.x - q.x) * (p.x - q.x) + (p.y - q.y) * (p.y - q.y) + (p.z - q.z) * (p.z - q.z);
+            if (chordSquared < bestChordSquared)
+            {
+                best = static_cast<std::int32_t>(id);
+                bestChordSquared = chordSquared;
+            }
+        }
+        return best;
+    }
+};
+
+#endif // !__HEADER_NEARESTGRID_HPP_CPP_
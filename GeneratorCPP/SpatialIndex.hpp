@@ -0,0 +1,799 @@
+#ifndef __HEADER_SPATIALINDEX_HPP_CPP_
+#define __HEADER_SPATIALINDEX_HPP_CPP_
+
+#include <vector>
+#include <span>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+#include <thread>
+#include <utility>
+
+// Same constants as the JavaScript haversine in index.js
+constexpr double EARTH_RADIUS_KM = 6371;
+constexpr double RAD_CONVERT = 3.14159265358979323846 / 180;
+
+struct UnitVector
+{
+    double x;
+    double y;
+    double z;
+
+    double operator[](const std::size_t dimension) const noexcept
+    {
+        return dimension == 0 ? x : (dimension == 1 ? y : z);
+    }
+};
+
+inline UnitVector toUnitVector(const double latitude, const double longitude) noexcept
+{
+    const double phi = latitude * RAD_CONVERT;
+    const double lambda = longitude * RAD_CONVERT;
+    return {std::cos(phi) * std::cos(lambda), std::cos(phi) * std::sin(lambda), std::sin(phi)};
+}
+
+// Converts a great-circle distance in km into the straight-line distance between the points on the unit sphere.
+// The chord grows with the great-circle distance, so comparing chords gives the same answer as comparing haversines.
+// Like kd-tree-javascript, a maxDistance that is 0 or not a number means there is no limit.
+inline double chordFromDistance(const double km) noexcept
+{
+    if (!(km > 0))
+    {
+        return std::numeric_limits<double>::infinity();
+    }
+    const double angle = km / EARTH_RADIUS_KM;
+    if (angle >= 3.14159265358979323846)
+    {
+        return std::numeric_limits<double>::infinity();
+    }
+    return 2 * std::sin(angle / 2);
+}
+
+inline double distanceFromChord(const double chord) noexcept
+{
+    return 2 * EARTH_RADIUS_KM * std::asin(std::min(1.0, chord / 2));
+}
+
+// The attributes of a point that a filtered search can test
+struct PointAttributes
+{
+    std::uint32_t population;
+    // The two characters of the ISO 3166-1 code, the first one in the high byte
+    std::uint16_t country;
+    // Any id of the feature code, points with the same code have the same id
+    std::uint32_t feature;
+};
+
+inline std::uint16_t toCountryKey(const char first, const char second) noexcept
+{
+    return static_cast<std::uint16_t>((static_cast<unsigned char>(first) << 8) | static_cast<unsigned char>(second));
+}
+
+// What a filtered search accepts, an empty list accepts every value
+struct PointFilter
+{
+    std::uint32_t minPopulation = 0;
+    std::vector<std::uint16_t> countries = {};
+    std::vector<std::uint32_t> features = {};
+
+    // One of 64 bits for a country or feature, a subtree whose values have none of the bits of a filter is skipped
+    static std::uint64_t bit(const std::uint32_t value) noexcept
+    {
+        return std::uint64_t(1) << ((value * 0x9E3779B1u) >> 26);
+    }
+    template <typename T>
+    static std::uint64_t mask(const std::vector<T> &values) noexcept
+    {
+        std::uint64_t m = 0;
+        for (const auto value : values)
+        {
+            m |= bit(value);
+        }
+        return values.empty() ? ~std::uint64_t(0) : m;
+    }
+
+    bool isEmpty() const noexcept
+    {
+        return minPopulation == 0 && countries.empty() && features.empty();
+    }
+    bool accepts(const PointAttributes &a) const noexcept
+    {
+        return a.population >= minPopulation &&
+               (countries.empty() || std::find(countries.begin(), countries.end(), a.country) != countries.end()) &&
+               (features.empty() || std::find(features.begin(), features.end(), a.feature) != features.end());
+    }
+};
+
+// An internal node: its point, also stored at its position in the point arrays, and the dimension it splits on
+struct SpatialIndexNode
+{
+    UnitVector point;
+    std::uint32_t dimension;
+    std::uint32_t reserved;
+};
+static_assert(sizeof(SpatialIndexNode) == 32, "SpatialIndexNode must not have padding");
+
+// The arrays of an index, what a binary dataset stores so the index can be opened without building it
+struct SpatialIndexArrays
+{
+    std::span<const SpatialIndexNode> nodes;
+    std::span<const double> xs;
+    std::span<const double> ys;
+    std::span<const double> zs;
+    std::span<const std::int32_t> ids;
+};
+
+// A static kd-tree over points on the unit sphere.
+// The points are stored structure-of-arrays in tree order: the node of the range [first, last)
+// is the point in the middle of the range, its left subtree is before it and its right subtree after it.
+// Ranges of at most LEAF_SIZE points are leaves, they are scanned in one vectorizable loop.
+// The internal nodes are also stored in Eytzinger order, the root first and the children of node k at 2k + 1 and
+// 2k + 2, so a node is one read of 32 bytes and the top levels that every search visits share a few cache lines.
+// The positions of the points do not change, the arrays may be owned or the mapped pages of a dataset.
+// Queries do not allocate.
+class SpatialIndex
+{
+public:
+    static constexpr std::size_t LEAF_SIZE = 16;
+
+private:
+    static constexpr std::size_t NONE = static_cast<std::size_t>(-1);
+
+    // Empty when the arrays belong to a dataset
+    std::vector<SpatialIndexNode> ownedNodes = {};
+    std::vector<double> ownedXs = {};
+    std::vector<double> ownedYs = {};
+    std::vector<double> ownedZs = {};
+    std::vector<std::int32_t> ownedIds = {};
+
+    // Nodes that are not in the tree, below a leaf, are zero and never read
+    std::span<const SpatialIndexNode> nodes = {};
+    std::span<const double> xs = {};
+    std::span<const double> ys = {};
+    std::span<const double> zs = {};
+    // The record id of each point
+    std::span<const std::int32_t> ids = {};
+
+    // What a subtree holds: the largest population and the bits of its countries and features
+    struct Summary
+    {
+        std::uint32_t maxPopulation;
+        std::uint64_t countries;
+        std::uint64_t features;
+
+        void add(const PointAttributes &a) noexcept
+        {
+            maxPopulation = std::max(maxPopulation, a.population);
+            countries |= PointFilter::bit(a.country);
+            features |= PointFilter::bit(a.feature);
+        }
+        void add(const Summary &other) noexcept
+        {
+            maxPopulation = std::max(maxPopulation, other.maxPopulation);
+            countries |= other.countries;
+            features |= other.features;
+        }
+    };
+    // Empty until setAttributes. The attributes are in tree order, the summary of a subtree is at the position
+    // of its node, or at its first position for a leaf, which is never the position of a node.
+    std::vector<PointAttributes> attributes = {};
+    std::vector<Summary> summaries = {};
+
+    static double chordSquared(const UnitVector &p, const UnitVector &q) noexcept
+    {
+        const double dx = p.x - q.x;
+        const double dy = p.y - q.y;
+        const double dz = p.z - q.z;
+        return dx * dx + dy * dy + dz * dz;
+    }
+
+    void build(std::vector<UnitVector> &points, std::vector<std::int32_t> &order, const std::size_t first, const std::size_t last, const std::size_t node) noexcept
+    {
+        if (last - first <= LEAF_SIZE)
+        {
+            return;
+        }
+        // Split on the dimension with the largest extent
+        UnitVector low = points[order[first]];
+        UnitVector high = low;
+        for (std::size_t i = first; i < last; i++)
+        {
+            const auto &p = points[order[i]];
+            low = {std::min(low.x, p.x), std::min(low.y, p.y), std::min(low.z, p.z)};
+            high = {std::max(high.x, p.x), std::max(high.y, p.y), std::max(high.z, p.z)};
+        }
+        const double extents[3] = {high.x - low.x, high.y - low.y, high.z - low.z};
+        const std::size_t dimension = std::max_element(extents, extents + 3) - extents;
+
+        const std::size_t middle = first + (last - first) / 2;
+        std::nth_element(order.begin() + first, order.begin() + middle, order.begin() + last,
+                         [&](const std::int32_t a, const std::int32_t b)
+                         { return points[a][dimension] < points[b][dimension]; });
+        ownedNodes[node] = {points[order[middle]], static_cast<std::uint32_t>(dimension), 0};
+        build(points, order, first, middle, 2 * node + 1);
+        build(points, order, middle + 1, last, 2 * node + 2);
+    }
+
+    // The tree position of the nearest point found so far
+    struct Best
+    {
+        std::size_t position;
+        double chordSquared;
+    };
+
+    double chordSquaredTo(const std::size_t position, const UnitVector &q) const noexcept
+    {
+        return chordSquared({xs[position], ys[position], zs[position]}, q);
+    }
+
+    void search(const std::size_t first, const std::size_t last, const std::size_t node, const UnitVector &q, Best &best) const noexcept
+    {
+        if (last - first <= LEAF_SIZE)
+        {
+            // The distances are computed in a loop without branches so the compiler can use SIMD
+            double chordsSquared[LEAF_SIZE] = {};
+            const std::size_t count = last - first;
+            for (std::size_t i = 0; i < count; i++)
+            {
+                const double dx = xs[first + i] - q.x;
+                const double dy = ys[first + i] - q.y;
+                const double dz = zs[first + i] - q.z;
+                chordsSquared[i] = dx * dx + dy * dy + dz * dz;
+            }
+            for (std::size_t i = 0; i < count; i++)
+            {
+                if (chordsSquared[i] < best.chordSquared)
+                {
+                    best = {first + i, chordsSquared[i]};
+                }
+            }
+            return;
+        }
+        const std::size_t middle = first + (last - first) / 2;
+        const SpatialIndexNode &n = nodes[node];
+        const double nodeChordSquared = chordSquared(n.point, q);
+        if (nodeChordSquared < best.chordSquared)
+        {
+            best = {middle, nodeChordSquared};
+        }
+        const double difference = q[n.dimension] - n.point[n.dimension];
+        if (difference < 0)
+        {
+            search(first, middle, 2 * node + 1, q, best);
+            if (difference * difference < best.chordSquared)
+            {
+                search(middle + 1, last, 2 * node + 2, q, best);
+            }
+        }
+        else
+        {
+            search(middle + 1, last, 2 * node + 2, q, best);
+            if (difference * difference < best.chordSquared)
+            {
+                search(first, middle, 2 * node + 1, q, best);
+            }
+        }
+    }
+
+    // The nearest and second nearest points found so far
+    struct BestPair
+    {
+        std::size_t position;
+        double chordSquared;
+        double secondChordSquared;
+
+        void offer(const std::size_t candidate, const double candidateChordSquared) noexcept
+        {
+            if (candidateChordSquared < chordSquared)
+            {
+                secondChordSquared = chordSquared;
+                position = candidate;
+                chordSquared = candidateChordSquared;
+            }
+            else if (candidateChordSquared < secondChordSquared && candidate != position)
+            {
+                secondChordSquared = candidateChordSquared;
+            }
+        }
+    };
+
+    // Like search, but a subtree can only be skipped when it is farther than the second nearest point
+    void searchPair(const std::size_t first, const std::size_t last, const std::size_t node, const UnitVector &q, BestPair &best) const noexcept
+    {
+        if (last - first <= LEAF_SIZE)
+        {
+            double chordsSquared[LEAF_SIZE] = {};
+            const std::size_t count = last - first;
+            for (std::size_t i = 0; i < count; i++)
+            {
+                const double dx = xs[first + i] - q.x;
+                const double dy = ys[first + i] - q.y;
+                const double dz = zs[first + i] - q.z;
+                chordsSquared[i] = dx * dx + dy * dy + dz * dz;
+            }
+            for (std::size_t i = 0; i < count; i++)
+            {
+                best.offer(first + i, chordsSquared[i]);
+            }
+            return;
+        }
+        const std::size_t middle = first + (last - first) / 2;
+        const SpatialIndexNode &n = nodes[node];
+        best.offer(middle, chordSquared(n.point, q));
+        const double difference = q[n.dimension] - n.point[n.dimension];
+        if (difference < 0)
+        {
+            searchPair(first, middle, 2 * node + 1, q, best);
+            if (difference * difference < best.secondChordSquared)
+            {
+                searchPair(middle + 1, last, 2 * node + 2, q, best);
+            }
+        }
+        else
+        {
+            searchPair(middle + 1, last, 2 * node + 2, q, best);
+            if (difference * difference < best.secondChordSquared)
+            {
+                searchPair(first, middle, 2 * node + 1, q, best);
+            }
+        }
+    }
+
+    Summary summarize(const std::size_t first, const std::size_t last) noexcept
+    {
+        Summary summary = {0, 0, 0};
+        if (first == last)
+        {
+            return summary;
+        }
+        if (last - first <= LEAF_SIZE)
+        {
+            for (std::size_t i = first; i < last; i++)
+            {
+                summary.add(attributes[i]);
+            }
+            summaries[first] = summary;
+            return summary;
+        }
+        const std::size_t middle = first + (last - first) / 2;
+        summary.add(attributes[middle]);
+        summary.add(summarize(first, middle));
+        summary.add(summarize(middle + 1, last));
+        summaries[middle] = summary;
+        return summary;
+    }
+
+    // The k nearest accepted points found so far, a max-heap on the chord
+    struct Neighbours
+    {
+        std::size_t k;
+        double maxChordSquared;
+        std::vector<std::pair<double, std::size_t>> &heap;
+
+        double bound() const noexcept
+        {
+            return heap.size() == k ? heap.front().first : maxChordSquared;
+        }
+        void offer(const std::size_t position, const double chordSquared) noexcept
+        {
+            if (!(chordSquared < bound()))
+            {
+                return;
+            }
+            if (heap.size() == k)
+            {
+                std::pop_heap(heap.begin(), heap.end());
+                heap.pop_back();
+            }
+            heap.push_back({chordSquared, position});
+            std::push_heap(heap.begin(), heap.end());
+        }
+    };
+
+    // Like search, but only accepted points are offered and a subtree whose summary rules the filter out is skipped.
+    // isFiltered is false when the filter is empty, or when the index has no attributes to test.
+    void searchFiltered(const std::size_t first, const std::size_t last, const std::size_t node, const UnitVector &q, const PointFilter &filter, const std::uint64_t countryMask, const std::uint64_t featureMask, const bool isFiltered, Neighbours &best) const noexcept
+    {
+        if (first == last)
+        {
+            return;
+        }
+        const bool isLeaf = last - first <= LEAF_SIZE;
+        const std::size_t middle = first + (last - first) / 2;
+        if (isFiltered)
+        {
+            const Summary &summary = summaries[isLeaf ? first : middle];
+            if (summary.maxPopulation < filter.minPopulation || (summary.countries & countryMask) == 0 || (summary.features & featureMask) == 0)
+            {
+                return;
+            }
+        }
+        if (isLeaf)
+        {
+            for (std::size_t i = first; i < last; i++)
+            {
+                if (!isFiltered || filter.accepts(attributes[i]))
+                {
+                    best.offer(i, chordSquaredTo(i, q));
+                }
+            }
+            return;
+        }
+        const SpatialIndexNode &n = nodes[node];
+        if (!isFiltered || filter.accepts(attributes[middle]))
+        {
+            best.offer(middle, chordSquared(n.point, q));
+        }
+        const double difference = q[n.dimension] - n.point[n.dimension];
+        if (difference < 0)
+        {
+            searchFiltered(first, middle, 2 * node + 1, q, filter, countryMask, featureMask, isFiltered, best);
+            if (difference * difference < best.bound())
+            {
+                searchFiltered(middle + 1, last, 2 * node + 2, q, filter, countryMask, featureMask, isFiltered, best);
+            }
+        }
+        else
+        {
+            searchFiltered(middle + 1, last, 2 * node + 2, q, filter, countryMask, featureMask, isFiltered, best);
+            if (difference * difference < best.bound())
+            {
+                searchFiltered(first, middle, 2 * node + 1, q, filter, countryMask, featureMask, isFiltered, best);
+            }
+        }
+    }
+
+    void collect(const std::size_t first, const std::size_t last, const std::size_t node, const UnitVector &q, const double maxChordSquared, std::vector<std::int32_t> &results, const std::size_t limit) const noexcept
+    {
+        if (last - first <= LEAF_SIZE)
+        {
+            for (std::size_t i = first; i < last && results.size() < limit; i++)
+            {
+                if (chordSquaredTo(i, q) <= maxChordSquared)
+                {
+                    results.push_back(ids[i]);
+                }
+            }
+            return;
+        }
+        const std::size_t middle = first + (last - first) / 2;
+        const SpatialIndexNode &n = nodes[node];
+        if (results.size() < limit && chordSquared(n.point, q) <= maxChordSquared)
+        {
+            results.push_back(ids[middle]);
+        }
+        const double difference = q[n.dimension] - n.point[n.dimension];
+        if (difference < 0 || difference * difference <= maxChordSquared)
+        {
+            collect(first, middle, 2 * node + 1, q, maxChordSquared, results, limit);
+        }
+        if (difference >= 0 || difference * difference <= maxChordSquared)
+        {
+            collect(middle + 1, last, 2 * node + 2, q, maxChordSquared, results, limit);
+        }
+    }
+
+    bool checkNodes(const SpatialIndexArrays &arrays, const std::size_t first, const std::size_t last, const std::size_t node) const noexcept
+    {
+        if (last - first <= LEAF_SIZE)
+        {
+            return true;
+        }
+        const std::size_t middle = first + (last - first) / 2;
+        const SpatialIndexNode &n = arrays.nodes[node];
+        return n.dimension < 3 && n.point.x == arrays.xs[middle] && n.point.y == arrays.ys[middle] && n.point.z == arrays.zs[middle] &&
+               checkNodes(arrays, first, middle, 2 * node + 1) && checkNodes(arrays, middle + 1, last, 2 * node + 2);
+    }
+
+public:
+    SpatialIndex() noexcept = default;
+
+    // The number of node slots of a tree of count points
+    static std::size_t nodeCount(const std::size_t count, const std::size_t node = 0) noexcept
+    {
+        if (count <= LEAF_SIZE)
+        {
+            return 0;
+        }
+        const std::size_t middle = count / 2;
+        return std::max({node + 1, nodeCount(middle, 2 * node + 1), nodeCount(count - middle - 1, 2 * node + 2)});
+    }
+
+    // coordinates holds count pairs of { latitude, longitude } in degrees, the id of a point is its pair index
+    SpatialIndex(const double *coordinates, const std::size_t count) noexcept
+    {
+        std::vector<UnitVector> points = {};
+        points.reserve(count);
+        for (std::size_t i = 0; i < count; i++)
+        {
+            points.push_back(toUnitVector(coordinates[2 * i], coordinates[2 * i + 1]));
+        }
+        std::vector<std::int32_t> order = std::vector<std::int32_t>(count);
+        std::iota(order.begin(), order.end(), 0);
+        ownedNodes.assign(nodeCount(count), {});
+        build(points, order, 0, count, 0);
+
+        ownedXs.reserve(count);
+        ownedYs.reserve(count);
+        ownedZs.reserve(count);
+        for (const auto id : order)
+        {
+            ownedXs.push_back(points[id].x);
+            ownedYs.push_back(points[id].y);
+            ownedZs.push_back(points[id].z);
+        }
+        ownedIds = std::move(order);
+        nodes = ownedNodes;
+        xs = ownedXs;
+        ys = ownedYs;
+        zs = ownedZs;
+        ids = ownedIds;
+    }
+
+    // The spans point into the owned vectors, whose buffers move with them but are not copied
+    SpatialIndex(const SpatialIndex &) = delete;
+    SpatialIndex &operator=(const SpatialIndex &) = delete;
+    SpatialIndex(SpatialIndex &&) noexcept = default;
+    SpatialIndex &operator=(SpatialIndex &&) noexcept = default;
+
+    // Uses the arrays of a built index in place, usually the mapped pages of a dataset, which must outlive the index.
+    // Returns false when they are not the arrays of an index of count points, the index is then left empty.
+    // The searches trust every node, so the node points must be the points at their positions.
+    bool open(const SpatialIndexArrays &arrays, const std::size_t count) noexcept
+    {
+        if (arrays.xs.size() != count || arrays.ys.size() != count || arrays.zs.size() != count || arrays.ids.size() != count ||
+            arrays.nodes.size() != nodeCount(count) || count > static_cast<std::size_t>(std::numeric_limits<std::int32_t>::max()))
+        {
+            return false;
+        }
+        for (const auto id : arrays.ids)
+        {
+            if (id < 0 || static_cast<std::size_t>(id) >= count)
+            {
+                return false;
+            }
+        }
+        if (!checkNodes(arrays, 0, count, 0))
+        {
+            return false;
+        }
+        *this = SpatialIndex();
+        nodes = arrays.nodes;
+        xs = arrays.xs;
+        ys = arrays.ys;
+        zs = arrays.zs;
+        ids = arrays.ids;
+        return true;
+    }
+
+    // The arrays to store, valid while the index is
+    SpatialIndexArrays arrays() const noexcept
+    {
+        return {nodes, xs, ys, zs, ids};
+    }
+
+    // Returns the id of the point nearest to { latitude, longitude } whose chord is strictly less than maxChord, or -1
+    std::int32_t nearest(const double latitude, const double longitude, const double maxChord) const noexcept
+    {
+        Best best = {NONE, maxChord * maxChord};
+        search(0, ids.size(), 0, toUnitVector(latitude, longitude), best);
+        return best.position == NONE ? -1 : ids[best.position];
+    }
+
+    // The nearest point of a query and how far the second nearest one is at least
+    struct NearestPair
+    {
+        // -1 when there is no point closer than the limit
+        std::int32_t id;
+        // Tree position of the point, a hint for the next query of a session
+        std::size_t position;
+        double chord;
+        // The second nearest point is at least this far, limitChord when no other point is closer
+        double secondChord;
+    };
+
+    // Finds the nearest point of q and the chord of the second nearest one, ignoring points at limitChord or farther.
+    // hintPosition is the position of an earlier answer near q, or noHint(). Its point is at most h from q, so the
+    // search only looks for the second nearest point within 3h: the region the pair proves still has a radius of
+    // at least h, and the search only visits the few nodes around q.
+    NearestPair nearestPair(const UnitVector &q, double limitChord, const std::size_t hintPosition) const noexcept
+    {
+        double hintChordSquared = 0;
+        if (hintPosition < ids.size())
+        {
+            hintChordSquared = chordSquaredTo(hintPosition, q);
+            if (hintChordSquared > 0)
+            {
+                limitChord = std::min(limitChord, 3 * std::sqrt(hintChordSquared));
+            }
+        }
+        BestPair best = {NONE, limitChord * limitChord, limitChord * limitChord};
+        if (hintPosition < ids.size())
+        {
+            best.offer(hintPosition, hintChordSquared);
+        }
+        searchPair(0, ids.size(), 0, q, best);
+        if (best.position == NONE)
+        {
+            return {-1, NONE, limitChord, limitChord};
+        }
+        return {ids[best.position], best.position, std::sqrt(best.chordSquared), std::sqrt(best.secondChordSquared)};
+    }
+
+    static constexpr std::size_t noHint() noexcept
+    {
+        return NONE;
+    }
+
+    // Gives every point the attributes of its id, pointAttributes holds size() of them, and builds the subtree
+    // summaries that let filtered searches skip the subtrees without an accepted point.
+    void setAttributes(const PointAttributes *pointAttributes) noexcept
+    {
+        attributes.resize(ids.size());
+        for (std::size_t i = 0; i < ids.size(); i++)
+        {
+            attributes[i] = pointAttributes[ids[i]];
+        }
+        summaries.assign(ids.size(), {0, 0, 0});
+        summarize(0, ids.size());
+    }
+
+    struct Neighbour
+    {
+        std::int32_t id;
+        double chord;
+    };
+
+    // Replaces results with the k nearest points of q that filter accepts and whose chord is strictly less than
+    // maxChord, nearest first. A k of at least size() finds every accepted point within maxChord.
+    // The filter is evaluated during the search, so the answer is exact and only the accepted points are kept.
+    // A non-empty filter requires setAttributes.
+    void nearestFiltered(const UnitVector &q, const std::size_t k, const double maxChord, const PointFilter &filter, std::vector<Neighbour> &results) const noexcept
+    {
+        results.clear();
+        if (k == 0)
+        {
+            return;
+        }
+        std::vector<std::pair<double, std::size_t>> heap = {};
+        Neighbours best = {k, maxChord * maxChord, heap};
+        const bool isFiltered = !filter.isEmpty() && !attributes.empty();
+        searchFiltered(0, ids.size(), 0, q, filter, PointFilter::mask(filter.countries), PointFilter::mask(filter.features), isFiltered, best);
+        std::sort(heap.begin(), heap.end());
+        for (const auto &[chordSquared, position] : heap)
+        {
+            results.push_back({ids[position], std::sqrt(chordSquared)});
+        }
+    }
+
+    // Appends the ids of the points whose chord to q is at most maxChord to results, in no particular order.
+    // Stops once results holds limit ids, so a caller can tell that there are at least limit of them.
+    void within(const UnitVector &q, const double maxChord, std::vector<std::int32_t> &results, const std::size_t limit) const noexcept
+    {
+        collect(0, ids.size(), 0, q, maxChord * maxChord, results, limit);
+    }
+
+    // Answers count queries of { latitude, longitude } pairs into results, using up to threadCount threads.
+    // Each thread sorts its share of the queries along a Morton curve, so consecutive queries walk the
+    // same part of the tree and the previous answer gives an upper bound that prunes most of the search.
+    // Each result is at the same distance as the one nearest returns, but when several points are exactly as near
+    // the previous answer may win where nearest would return another of them.
+    void nearestBatch(const double *coordinates, const std::size_t count, const double maxChord, std::int32_t *results, std::size_t threadCount) const noexcept
+    {
+        // Below this many queries per thread, starting a thread costs more than it saves
+        constexpr std::size_t MINIMUM_QUERIES_PER_THREAD = 4096;
+        threadCount = std::max<std::size_t>(1, std::min(threadCount, count / MINIMUM_QUERIES_PER_THREAD));
+
+        const auto work = [&](const std::size_t begin, const std::size_t end)
+        {
+            // { Morton key, query index } packed into one integer so sorting compares a single word
+            std::vector<std::uint64_t> order = {};
+            order.reserve(end - begin);
+            for (std::size_t i = begin; i < end; i++)
+            {
+                order.push_back((std::uint64_t(mortonKey(coordinates[2 * i], coordinates[2 * i + 1])) << 32) | i);
+            }
+            std::sort(order.begin(), order.end());
+
+            std::size_t previous = NONE;
+            for (const auto packed : order)
+            {
+                const std::size_t i = static_cast<std::uint32_t>(packed);
+                const UnitVector q = toUnitVector(coordinates[2 * i], coordinates[2 * i + 1]);
+                Best best = {NONE, maxChord * maxChord};
+                if (previous != NONE)
+                {
+                    // The previous answer is a real point, so the nearest point is at least as close
+                    const double chordSquared = chordSquaredTo(previous, q);
+                    if (chordSquared < best.chordSquared)
+                    {
+                        best = {previous, chordSquared};
+                    }
+                }
+                search(0, ids.size(), 0, q, best);
+                results[i] = best.position == NONE ? -1 : ids[best.position];
+                if (best.position != NONE)
+                {
+                    previous = best.position;
+                }
+            }
+        };
+
+        if (threadCount == 1)
+        {
+            work(0, count);
+            return;
+        }
+        std::vector<std::jthread> workers = {};
+        for (std::size_t t = 0; t < threadCount; t++)
+        {
+            workers.emplace_back(work, count * t / threadCount, count * (t + 1) / threadCount);
+        }
+        // The jthreads join when leaving this scope
+    }
+
+    // Maps a coordinate in [low, low + range] to 16 bits
+    static std::uint32_t quantize(const double value, const double low, const double range) noexcept
+    {
+        const double unit = std::clamp((value - low) / range, 0.0, 1.0);
+        return static_cast<std::uint32_t>(unit * 65535);
+    }
+
+    // Interleaves the bits of the quantized latitude and longitude, non-finite coordinates sort last
+    static std::uint32_t mortonKey(const double latitude, const double longitude) noexcept
+    {
+        if (!std::isfinite(latitude) || !std::isfinite(longitude))
+        {
+            return 0xFFFFFFFF;
+        }
+        const auto spread = [](std::uint32_t v)
+        {
+            v = (v | (v << 8)) & 0x00FF00FF;
+            v = (v | (v << 4)) & 0x0F0F0F0F;
+            v = (v | (v << 2)) & 0x33333333;
+            v = (v | (v << 1)) & 0x55555555;
+            return v;
+        };
+        return (spread(quantize(latitude, -90, 180)) << 1) | spread(quantize(longitude, -180, 360));
+    }
+
+    // Distance along a Hilbert curve over the same 65536 x 65536 grid as mortonKey, non-finite coordinates sort last.
+    // Unlike the Morton curve it never jumps between distant cells, so points that are close on the curve are close on the map.
+    static std::uint32_t hilbertKey(const double latitude, const double longitude) noexcept
+    {
+        if (!std::isfinite(latitude) || !std::isfinite(longitude))
+        {
+            return 0xFFFFFFFF;
+        }
+        std::uint32_t x = quantize(longitude, -180, 360);
+        std::uint32_t y = quantize(latitude, -90, 180);
+        std::uint32_t key = 0;
+        for (std::uint32_t s = 1u << 15; s > 0; s >>= 1)
+        {
+            const std::uint32_t rx = (x & s) != 0 ? 1 : 0;
+            const std::uint32_t ry = (y & s) != 0 ? 1 : 0;
+            key += s * s * ((3 * rx) ^ ry);
+            // Rotates the quadrant so the curve inside it starts where the previous quadrant ended
+            if (ry == 0)
+            {
+                if (rx == 1)
+                {
+                    x = 65535 - x;
+                    y = 65535 - y;
+                }
+                std::swap(x, y);
+            }
+        }
+        return key;
+    }
+
+    std::size_t size() const noexcept
+    {
+        return ids.size();
+    }
+};
+
+#endif // !__HEADER_SPATIALINDEX_HPP_CPP_
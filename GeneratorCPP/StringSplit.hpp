@@ -5,74 +5,102 @@
 #include <string_view>
 #include <vector>
 #include <array>
+#include <bit>
+#include <type_traits>
+#include <cstdint>
 
-// This header requires C++17 or later
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#endif
+
+// This header requires C++20 or later
 // These functions split a str into string_view based on the same rules as js string.split()
 // ie: "abaabaaabbabbbabb", 'b' => "a", "aa", "aaa", "", "a", "", "", "a", "", ""
+//
+// The delimiters are found 32 bytes at a time with AVX2 or 16 bytes at a time with SSE2, depending on what the
+// compiler targets (-mavx2 or /arch:AVX2 for AVX2, SSE2 is always available on x86-64). Other targets and
+// constant evaluation scan one byte at a time, the results are the same.
 
-// Splits a string on the delimiter, similar to string.split in JavaScript
-// Returns: A vector of string views
-constexpr std::vector<std::string_view> split(const std::string& str, const char delim) noexcept
+// Calls onDelimiter with the index of every delim in str, in order, one byte at a time.
+// Stops as soon as onDelimiter returns false.
+template <typename F>
+constexpr void forEachDelimiterScalar(const std::string_view str, const char delim, F &&onDelimiter) noexcept
 {
-    std::vector<std::string_view> retval = {};
-    std::pair<std::size_t, std::size_t> bounds = { 0, 0 };
-    std::size_t i = 0;
-    for (; i < str.size(); i++)
+    for (std::size_t i = 0; i < str.size(); i++)
     {
-        if (str[i] == delim)
-        {
-            retval.push_back(std::string_view(str.begin() + bounds.first, str.begin() + bounds.second));
-            bounds = { i + 1, i + 1 };
-        }
-        else
+        if (str[i] == delim && !onDelimiter(i))
         {
-            bounds.second += 1;
+            return;
         }
     }
-    retval.push_back(std::string_view(str.begin() + bounds.first, str.begin() + bounds.second));
-
-    return retval;
 }
 
-// Splits a string on the delimiter, similar to string.split in JavaScript
-// Template parameters:
-//      std::size_t maximum: The maximum number of splits to get.
-// Returns: An array of splits, if not enough delimiters the elements at the end will be invalid
-template <std::size_t maximum>
-constexpr std::array<std::string_view, maximum> split(const std::string& str, const char delim) noexcept
+// Calls onDelimiter with the index of every delim in str, in order.
+// Stops as soon as onDelimiter returns false.
+template <typename F>
+constexpr void forEachDelimiter(const std::string_view str, const char delim, F &&onDelimiter) noexcept
 {
-    std::size_t index = 0;
-    std::array<std::string_view, maximum> retval = {};
-    std::pair<std::size_t, std::size_t> bounds = { 0, 0 };
+    if (std::is_constant_evaluated())
+    {
+        forEachDelimiterScalar(str, delim, onDelimiter);
+        return;
+    }
     std::size_t i = 0;
-    for (; i < str.size(); i++)
+    // Every set bit of mask is a delimiter at index block + bit
+    const auto visit = [&](const std::size_t block, auto mask)
     {
-        if (index == maximum)
+        while (mask != 0)
         {
-            return retval;
-        }
-        if (str[i] == delim)
-        {
-            if (index < maximum)
+            if (!onDelimiter(block + std::countr_zero(mask)))
             {
-                retval[index] = std::string_view(str.begin() + bounds.first, str.begin() + bounds.second);
-                index++;
-                bounds = { i + 1, i + 1 };
-            }
-            else
-            {
-                return retval;
+                return false;
             }
+            mask &= mask - 1;
         }
-        else
+        return true;
+    };
+#if defined(__AVX2__)
+    const __m256i needles = _mm256_set1_epi8(delim);
+    for (; i + 32 <= str.size(); i += 32)
+    {
+        const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(str.data() + i));
+        const auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, needles)));
+        if (!visit(i, mask))
         {
-            bounds.second += 1;
+            return;
         }
     }
-    if (index < maximum)
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    const __m128i needles = _mm_set1_epi8(delim);
+    for (; i + 16 <= str.size(); i += 16)
     {
-        retval[index] = std::string_view(str.begin() + bounds.first, str.begin() + bounds.second);
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(str.data() + i));
+        const auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, needles)));
+        if (!visit(i, mask))
+        {
+            return;
+        }
     }
+#endif
+    forEachDelimiterScalar(str.substr(i), delim, [&](const std::size_t j)
+    { return onDelimiter(i + j); });
+}
+
+// Splits a string on the delimiter, similar to string.split in JavaScript
+// Returns: A vector of string views
+constexpr std::vector<std::string_view> split(const std::string_view str, const char delim) noexcept
+{
+    std::vector<std::string_view> retval = {};
+    std::size_t begin = 0;
+    forEachDelimiter(str, delim, [&](const std::size_t i)
+    {
+        retval.push_back(str.substr(begin, i - begin));
+        begin = i + 1;
+        return true;
+    });
+    retval.push_back(str.substr(begin));
 
     return retval;
 }
@@ -83,42 +111,40 @@ constexpr std::array<std::string_view, maximum> split(const std::string& str, co
 // Effects: modifies count to be the number of segments in the split
 // Returns: An array of splits, if not enough delimiters the elements at the end will be invalid
 template <std::size_t maximum>
-constexpr std::array<std::string_view, maximum> split(const std::string& str, const char delim, std::size_t& count) noexcept
+constexpr std::array<std::string_view, maximum> split(const std::string_view str, const char delim, std::size_t& count) noexcept
 {
     count = 0;
     std::array<std::string_view, maximum> retval = {};
-    std::pair<std::size_t, std::size_t> bounds = { 0, 0 };
-    std::size_t i = 0;
-    for (; i < str.size(); i++)
+    if constexpr (maximum == 0)
     {
-        if (count == maximum)
-        {
-            return retval;
-        }
-        if (str[i] == delim)
-        {
-            if (count < maximum)
-            {
-                retval[count] = std::string_view(str.begin() + bounds.first, str.begin() + bounds.second);
-                count++;
-                bounds = { i + 1, i + 1 };
-            }
-            else
-            {
-                return retval;
-            }
-        }
-        else
-        {
-            bounds.second += 1;
-        }
+        return retval;
     }
+    std::size_t begin = 0;
+    // Only the first maximum segments are kept, the last one ends at the next delimiter
+    forEachDelimiter(str, delim, [&](const std::size_t i)
+    {
+        retval[count] = str.substr(begin, i - begin);
+        count++;
+        begin = i + 1;
+        return count < maximum;
+    });
     if (count < maximum)
     {
-        retval[count] = std::string_view(str.begin() + bounds.first, str.begin() + bounds.second);
+        retval[count] = str.substr(begin);
     }
 
     return retval;
 }
 
+// Splits a string on the delimiter, similar to string.split in JavaScript
+// Template parameters:
+//      std::size_t maximum: The maximum number of splits to get.
+// Returns: An array of splits, if not enough delimiters the elements at the end will be invalid
+template <std::size_t maximum>
+constexpr std::array<std::string_view, maximum> split(const std::string_view str, const char delim) noexcept
+{
+    std::size_t count = 0;
+    return split<maximum>(str, delim, count);
+}
+
 #endif // !__HEADER_STRINGSPLIT_HPP_CPP_
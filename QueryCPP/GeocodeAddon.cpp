@@ -0,0 +1,982 @@
+#define NAPI_VERSION 8
+#include <node_api.h>
+
+#include <string>
+#include <unordered_map>
+#include <optional>
+#include <memory>
+#include <mutex>
+#include <cctype>
+
+#include "SpatialIndex.hpp"
+#include "MemoryMappedFile.hpp"
+#include "DatasetFormat.hpp"
+#include "QuerySession.hpp"
+
+// Node-API binding of SpatialIndex, used by index.js when it has been built.
+//
+// class GeocodeIndex {
+//     constructor(coordinates: Float64Array); // { latitude, longitude } pairs
+//     nearest(latitude: number, longitude: number, maxDistance: number): number; // record index or -1
+//     nearestBatch(coordinates: Float64Array, maxDistance: number): Int32Array; // record indices or -1
+//     sessionNearest(state: Float64Array, latitude: number, longitude: number, maxDistance: number): number; // record index or -1
+//     nearestFiltered(latitude: number, longitude: number, k: number, maxDistance: number): { index: number, distance: number }[];
+//     nearestAsync(coordinates: Float64Array, maxDistance: number): Promise<Int32Array>; // record indices or -1
+// }
+//
+// class GeocodeDataset {
+//     constructor(path: string); // a binary dataset written by GeneratorCPP with --format binary
+//     query(latitude: number, longitude: number, maxDistance: number): ReverseGeoCodeResult | null;
+//     queryBatch(coordinates: Float64Array, maxDistance: number): Int32Array; // record indices or -1
+//     record(index: number): ReverseGeoCodeResult | Error; // an Error object when index is not a record
+//     sessionNearest(state: Float64Array, latitude: number, longitude: number, maxDistance: number): number; // record index or -1
+//     nearestFiltered(latitude: number, longitude: number, k: number, maxDistance: number, filter?: Filter): { index: number, distance: number }[];
+//     nearestInCountry(latitude: number, longitude: number, maxDistance: number, country: string): number; // record index or -1
+//     nearestAsync(coordinates: Float64Array, maxDistance: number, country?: string): Promise<Int32Array>; // record indices or -1
+// }
+//
+// nearestFiltered returns the k nearest records within maxDistance that filter accepts, nearest first, k may be Infinity.
+// Filter is { minPopulation?: number, countries?: string[], featureCodes?: string[] }, only datasets can be filtered.
+//
+// sessionNearest answers the next query of a session, state is a Float64Array of SESSION_STATE_LENGTH
+// (exported as sessionStateLength) that the session keeps between queries, see QuerySession.hpp.
+//
+// nearestAsync searches a batch on a thread of the libuv threadpool and resolves with the nearest record of each
+// query, or with the one of nearestInCountry when a country is given. The event loop only copies the coordinates
+// in and the indices out. The index is read-only once
+// built, so any number of batches search it at the same time. index.js groups queries into batches and limits
+// how many are running.
+
+#define NAPI_CALL(env, call)                                                  \
+    do                                                                        \
+    {                                                                         \
+        if ((call) != napi_ok)                                                \
+        {                                                                     \
+            napi_throw_error((env), nullptr, "Node-API call failed: " #call); \
+            return nullptr;                                                   \
+        }                                                                     \
+    } while (0)
+
+namespace
+{
+    napi_value throwTypeError(napi_env env, const char *message)
+    {
+        napi_throw_type_error(env, nullptr, message);
+        return nullptr;
+    }
+
+    // Reads the ISO 3166-1 code of value into country in upper case, returns false when it is not a string of 2 characters
+    bool getCountryCode(napi_env env, napi_value value, char (&country)[3])
+    {
+        std::size_t length = 0;
+        // The length is read first, a longer string would be truncated to fit country
+        if (napi_get_value_string_utf8(env, value, nullptr, 0, &length) != napi_ok || length != 2 ||
+            napi_get_value_string_utf8(env, value, country, sizeof(country), &length) != napi_ok)
+        {
+            return false;
+        }
+        country[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(country[0])));
+        country[1] = static_cast<char>(std::toupper(static_cast<unsigned char>(country[1])));
+        return true;
+    }
+
+    // The spatial index of a GeocodeIndex and the cell cache its sessions share
+    struct Index
+    {
+        SpatialIndex index = {};
+        NearestCellCache cells = {};
+    };
+
+    void deleteIndex(napi_env, void *data, void *)
+    {
+        delete static_cast<Index *>(data);
+    }
+
+    napi_value constructIndex(napi_env env, napi_callback_info info)
+    {
+        std::size_t argc = 1;
+        napi_value argv[1] = {};
+        napi_value self = nullptr;
+        NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, &self, nullptr));
+        if (argc != 1)
+        {
+            return throwTypeError(env, "GeocodeIndex requires 1 argument, a Float64Array of latitude and longitude pairs.");
+        }
+
+        bool isTypedArray = false;
+        NAPI_CALL(env, napi_is_typedarray(env, argv[0], &isTypedArray));
+        if (!isTypedArray)
+        {
+            return throwTypeError(env, "GeocodeIndex requires a Float64Array.");
+        }
+        napi_typedarray_type type = napi_int8_array;
+        std::size_t length = 0;
+        void *data = nullptr;
+        NAPI_CALL(env, napi_get_typedarray_info(env, argv[0], &type, &length, &data, nullptr, nullptr));
+        if (type != napi_float64_array || length % 2 != 0)
+        {
+            return throwTypeError(env, "GeocodeIndex requires a Float64Array with an even length.");
+        }
+
+        auto *index = new Index{SpatialIndex(static_cast<const double *>(data), length / 2)};
+        if (napi_wrap(env, self, index, deleteIndex, nullptr, nullptr) != napi_ok)
+        {
+            delete index;
+            napi_throw_error(env, nullptr, "Could not wrap GeocodeIndex.");
+            return nullptr;
+        }
+        return self;
+    }
+
+    napi_value nearest(napi_env env, napi_callback_info info)
+    {
+        std::size_t argc = 3;
+        napi_value argv[3] = {};
+        napi_value self = nullptr;
+        NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, &self, nullptr));
+        if (argc != 3)
+        {
+            return throwTypeError(env, "nearest requires 3 arguments: latitude, longitude and maxDistance.");
+        }
+        double values[3] = {};
+        for (std::size_t i = 0; i < 3; i++)
+        {
+            if (napi_get_value_double(env, argv[i], &values[i]) != napi_ok)
+            {
+                return throwTypeError(env, "nearest requires numbers.");
+            }
+        }
+        Index *index = nullptr;
+        NAPI_CALL(env, napi_unwrap(env, self, reinterpret_cast<void **>(&index)));
+
+        const std::int32_t id = index->index.nearest(values[0], values[1], chordFromDistance(values[2]));
+        napi_value result = nullptr;
+        NAPI_CALL(env, napi_create_int32(env, id, &result));
+        return result;
+    }
+
+    // A memory mapped dataset and the spatial index over its coordinates.
+    // Results are read straight from the mapped pages.
+    struct Dataset
+    {
+        MemoryMappedFile file;
+        DatasetView view;
+        SpatialIndex index;
+        NearestCellCache cells;
+        // The string id of every feature code of the dataset, the strings are in the mapped file
+        std::unordered_map<std::string_view, std::uint32_t> featureCodeIds;
+        // One per partition of view.countries(), opened from the dataset, or built when it has none,
+        // the first time a query asks for the country
+        struct CountryIndex
+        {
+            std::once_flag isBuilt;
+            SpatialIndex index;
+        };
+        std::unique_ptr<CountryIndex[]> countryIndexes;
+
+        // Uses the grid of the dataset when it can answer, the index otherwise
+        std::int32_t nearest(const double latitude, const double longitude, const double maxChord) const noexcept
+        {
+            if (const auto id = view.grid().nearest(latitude, longitude, maxChord, view.latitudes(), view.longitudes()); id.has_value())
+            {
+                return id.value();
+            }
+            return index.nearest(latitude, longitude, maxChord);
+        }
+
+        // A lower bound in radians of the angle between { latitude, longitude } and the records of country.
+        // The angle is at least the difference of the latitudes. A point outside the longitudes of the box is also
+        // at least as far as the closest meridian of its sides, which is asin(cos(latitude) * sin(longitude difference)),
+        // or the distance to the nearer pole, asin(cos(latitude)), when the meridian is more than 90 degrees away.
+        static double boxAngle(const double latitude, const double longitude, const DatasetCountry &country) noexcept
+        {
+            const double latitudeGap = std::max({0.0, toDegrees(country.minLatitude) - latitude, latitude - toDegrees(country.maxLatitude)});
+            double angle = std::min(latitudeGap, 180.0) * RAD_CONVERT;
+            const double minLongitude = toDegrees(country.minLongitude);
+            const double maxLongitude = toDegrees(country.maxLongitude);
+            // A box wider than half the sphere is not convex, its longitudes are not used
+            if (maxLongitude - minLongitude <= 180)
+            {
+                const auto distanceTo = [&](const double meridian)
+                {
+                    const double difference = std::fmod(std::abs(longitude - meridian), 360.0);
+                    return std::min(difference, 360 - difference);
+                };
+                const double middle = (minLongitude + maxLongitude) / 2;
+                if (distanceTo(middle) > (maxLongitude - minLongitude) / 2)
+                {
+                    const double longitudeGap = std::min({distanceTo(minLongitude), distanceTo(maxLongitude), 90.0});
+                    angle = std::max(angle, std::asin(std::min(1.0, std::cos(latitude * RAD_CONVERT) * std::sin(longitudeGap * RAD_CONVERT))));
+                }
+            }
+            return angle;
+        }
+
+        // Searches only the records of country, the same answer as the nearest record of that country in the whole index
+        std::int32_t nearestInCountry(const double latitude, const double longitude, const double maxChord, const std::string_view country) noexcept
+        {
+            const DatasetCountry *partition = view.countryPartition(country);
+            if (partition == nullptr)
+            {
+                if (!view.countries().empty())
+                {
+                    return -1;
+                }
+                // Datasets written before the partitions were added
+                PointFilter filter = {};
+                filter.countries.push_back(toCountryKey(country[0], country[1]));
+                std::vector<SpatialIndex::Neighbour> found = {};
+                index.nearestFiltered(toUnitVector(latitude, longitude), 1, maxChord, filter, found);
+                return found.empty() ? -1 : found.front().id;
+            }
+            if (!(2 * std::sin(boxAngle(latitude, longitude, *partition) / 2) < maxChord))
+            {
+                return -1;
+            }
+            const std::size_t partitionIndex = partition - view.countries().data();
+            CountryIndex &countryIndex = countryIndexes[partitionIndex];
+            std::call_once(countryIndex.isBuilt, [&]()
+                           {
+                               if (const auto &arrays = view.countryIndex(partitionIndex); arrays.has_value() && countryIndex.index.open(arrays.value(), partition->count))
+                               {
+                                   return;
+                               }
+                               std::vector<double> coordinates = std::vector<double>(partition->count * 2);
+                               for (std::size_t i = 0; i < partition->count; i++)
+                               {
+                                   coordinates[2 * i] = view.latitude(partition->first + i);
+                                   coordinates[2 * i + 1] = view.longitude(partition->first + i);
+                               }
+                               countryIndex.index = SpatialIndex(coordinates.data(), partition->count); });
+            const std::int32_t id = countryIndex.index.nearest(latitude, longitude, maxChord);
+            return id < 0 ? -1 : static_cast<std::int32_t>(partition->first) + id;
+        }
+    };
+
+    void deleteDataset(napi_env, void *data, void *)
+    {
+        delete static_cast<Dataset *>(data);
+    }
+
+    // Empty names are undefined, like Geocode.#emptyToUndefined in index.js
+    napi_value createName(napi_env env, const std::string_view name)
+    {
+        napi_value value = nullptr;
+        if (name.empty())
+        {
+            napi_get_undefined(env, &value);
+        }
+        else
+        {
+            napi_create_string_utf8(env, name.data(), name.size(), &value);
+        }
+        return value;
+    }
+
+    napi_value createString(napi_env env, const std::string_view str)
+    {
+        napi_value value = nullptr;
+        napi_create_string_utf8(env, str.data(), str.size(), &value);
+        return value;
+    }
+
+    napi_value constructDataset(napi_env env, napi_callback_info info)
+    {
+        std::size_t argc = 1;
+        napi_value argv[1] = {};
+        napi_value self = nullptr;
+        NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, &self, nullptr));
+        std::size_t length = 0;
+        if (argc != 1 || napi_get_value_string_utf8(env, argv[0], nullptr, 0, &length) != napi_ok)
+        {
+            return throwTypeError(env, "GeocodeDataset requires 1 argument, the path of a binary dataset.");
+        }
+        std::string path = std::string(length, '\0');
+        NAPI_CALL(env, napi_get_value_string_utf8(env, argv[0], path.data(), length + 1, &length));
+
+        auto *dataset = new Dataset();
+        if (!dataset->file.open(path))
+        {
+            delete dataset;
+            napi_throw_error(env, nullptr, ("Could not open the dataset \"" + path + "\".").c_str());
+            return nullptr;
+        }
+        if (const auto error = dataset->view.open(dataset->file.data(), dataset->file.size()); error.has_value())
+        {
+            delete dataset;
+            napi_throw_error(env, nullptr, error.value().c_str());
+            return nullptr;
+        }
+        const auto &view = dataset->view;
+        // The index GeneratorCPP stored is used in the mapped pages, older datasets are indexed here
+        if (!view.spatialIndex().has_value() || !dataset->index.open(view.spatialIndex().value(), view.recordCount()))
+        {
+            std::vector<double> coordinates = std::vector<double>(view.recordCount() * 2);
+            for (std::size_t i = 0; i < view.recordCount(); i++)
+            {
+                coordinates[2 * i] = view.latitude(i);
+                coordinates[2 * i + 1] = view.longitude(i);
+            }
+            dataset->index = SpatialIndex(coordinates.data(), view.recordCount());
+        }
+        std::vector<PointAttributes> attributes = std::vector<PointAttributes>(view.recordCount());
+        for (std::size_t i = 0; i < view.recordCount(); i++)
+        {
+            const auto countryCode = view.countryCode(i);
+            attributes[i] = {view.population(i), toCountryKey(countryCode[0], countryCode[1]), view.featureCodeId(i)};
+            dataset->featureCodeIds.emplace(view.featureCode(i), view.featureCodeId(i));
+        }
+        dataset->index.setAttributes(attributes.data());
+        dataset->countryIndexes = std::make_unique<Dataset::CountryIndex[]>(view.countries().size());
+
+        if (napi_wrap(env, self, dataset, deleteDataset, nullptr, nullptr) != napi_ok)
+        {
+            delete dataset;
+            napi_throw_error(env, nullptr, "Could not wrap GeocodeDataset.");
+            return nullptr;
+        }
+        return self;
+    }
+
+    // Creates the same object as Geocode.#parseData in index.js
+    napi_value createResult(napi_env env, const DatasetView &view, const std::size_t record)
+    {
+        napi_value result = nullptr;
+        napi_create_object(env, &result);
+        napi_set_named_property(env, result, "countryCode", createString(env, view.countryCode(record)));
+        napi_set_named_property(env, result, "timezone", createString(env, view.timezone(record)));
+        napi_value population = nullptr;
+        napi_create_uint32(env, view.population(record), &population);
+        napi_set_named_property(env, result, "population", population);
+        napi_set_named_property(env, result, "featureCode", createString(env, view.featureCode(record)));
+
+        napi_value latinized = nullptr;
+        napi_create_object(env, &latinized);
+        napi_set_named_property(env, latinized, "cityName", createName(env, view.latinized(record, CITY_NAME)));
+        napi_set_named_property(env, latinized, "admin1Name", createName(env, view.latinized(record, ADMIN1_NAME)));
+        napi_set_named_property(env, latinized, "countryName", createName(env, view.latinized(record, COUNTRY_NAME)));
+        napi_set_named_property(env, result, "latinized", latinized);
+
+        napi_value locales = nullptr;
+        napi_create_object(env, &locales);
+        for (std::size_t language = 0; language < view.languageCount(); language++)
+        {
+            const auto cityName = view.localized(record, language, CITY_NAME);
+            if (!cityName.has_value())
+            {
+                continue;
+            }
+            napi_value localization = nullptr;
+            napi_create_object(env, &localization);
+            napi_set_named_property(env, localization, "cityName", createName(env, cityName.value()));
+            napi_set_named_property(env, localization, "admin1Name", createName(env, view.localized(record, language, ADMIN1_NAME).value()));
+            napi_set_named_property(env, localization, "countryName", createName(env, view.localized(record, language, COUNTRY_NAME).value()));
+            const auto code = view.language(language);
+            napi_set_property(env, locales, createString(env, code), localization);
+        }
+        napi_set_named_property(env, result, "locales", locales);
+        return result;
+    }
+
+    napi_value queryDataset(napi_env env, napi_callback_info info)
+    {
+        std::size_t argc = 3;
+        napi_value argv[3] = {};
+        napi_value self = nullptr;
+        NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, &self, nullptr));
+        if (argc != 3)
+        {
+            return throwTypeError(env, "query requires 3 arguments: latitude, longitude and maxDistance.");
+        }
+        double values[3] = {};
+        for (std::size_t i = 0; i < 3; i++)
+        {
+            if (napi_get_value_double(env, argv[i], &values[i]) != napi_ok)
+            {
+                return throwTypeError(env, "query requires numbers.");
+            }
+        }
+        Dataset *dataset = nullptr;
+        NAPI_CALL(env, napi_unwrap(env, self, reinterpret_cast<void **>(&dataset)));
+
+        const std::int32_t id = dataset->nearest(values[0], values[1], chordFromDistance(values[2]));
+        if (id < 0)
+        {
+            napi_value null = nullptr;
+            NAPI_CALL(env, napi_get_null(env, &null));
+            return null;
+        }
+        return createResult(env, dataset->view, static_cast<std::size_t>(id));
+    }
+
+    // Runs SpatialIndex::nearestBatch for the { latitude, longitude } pairs of coordinatesValue on every core.
+    // When the dataset has a grid it answers first, only the queries it cannot answer are searched in the index.
+    napi_value nearestBatch(napi_env env, const SpatialIndex &index, const DatasetView *view, napi_value coordinatesValue, napi_value maxDistanceValue)
+    {
+        bool isTypedArray = false;
+        NAPI_CALL(env, napi_is_typedarray(env, coordinatesValue, &isTypedArray));
+        napi_typedarray_type type = napi_int8_array;
+        std::size_t length = 0;
+        void *data = nullptr;
+        if (isTypedArray)
+        {
+            NAPI_CALL(env, napi_get_typedarray_info(env, coordinatesValue, &type, &length, &data, nullptr, nullptr));
+        }
+        if (!isTypedArray || type != napi_float64_array || length % 2 != 0)
+        {
+            return throwTypeError(env, "The coordinates must be a Float64Array of latitude and longitude pairs.");
+        }
+        double maxDistance = 0;
+        if (napi_get_value_double(env, maxDistanceValue, &maxDistance) != napi_ok)
+        {
+            return throwTypeError(env, "maxDistance must be a number.");
+        }
+
+        const std::size_t count = length / 2;
+        void *resultData = nullptr;
+        napi_value buffer = nullptr;
+        napi_value results = nullptr;
+        NAPI_CALL(env, napi_create_arraybuffer(env, count * sizeof(std::int32_t), &resultData, &buffer));
+        NAPI_CALL(env, napi_create_typedarray(env, napi_int32_array, count, buffer, 0, &results));
+        const auto *coordinates = static_cast<const double *>(data);
+        auto *ids = static_cast<std::int32_t *>(resultData);
+        const double maxChord = chordFromDistance(maxDistance);
+        const std::size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+        if (view == nullptr || view->grid().empty())
+        {
+            index.nearestBatch(coordinates, count, maxChord, ids, threadCount);
+            return results;
+        }
+
+        std::vector<double> remaining = {};
+        std::vector<std::size_t> positions = {};
+        for (std::size_t i = 0; i < count; i++)
+        {
+            const auto id = view->grid().nearest(coordinates[2 * i], coordinates[2 * i + 1], maxChord, view->latitudes(), view->longitudes());
+            if (id.has_value())
+            {
+                ids[i] = id.value();
+                continue;
+            }
+            remaining.push_back(coordinates[2 * i]);
+            remaining.push_back(coordinates[2 * i + 1]);
+            positions.push_back(i);
+        }
+        std::vector<std::int32_t> found = std::vector<std::int32_t>(positions.size());
+        index.nearestBatch(remaining.data(), positions.size(), maxChord, found.data(), threadCount);
+        for (std::size_t i = 0; i < positions.size(); i++)
+        {
+            ids[positions[i]] = found[i];
+        }
+        return results;
+    }
+
+    napi_value indexNearestBatch(napi_env env, napi_callback_info info)
+    {
+        std::size_t argc = 2;
+        napi_value argv[2] = {};
+        napi_value self = nullptr;
+        NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, &self, nullptr));
+        if (argc != 2)
+        {
+            return throwTypeError(env, "nearestBatch requires 2 arguments: coordinates and maxDistance.");
+        }
+        Index *index = nullptr;
+        NAPI_CALL(env, napi_unwrap(env, self, reinterpret_cast<void **>(&index)));
+        return nearestBatch(env, index->index, nullptr, argv[0], argv[1]);
+    }
+
+    napi_value datasetQueryBatch(napi_env env, napi_callback_info info)
+    {
+        std::size_t argc = 2;
+        napi_value argv[2] = {};
+        napi_value self = nullptr;
+        NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, &self, nullptr));
+        if (argc != 2)
+        {
+            return throwTypeError(env, "queryBatch requires 2 arguments: coordinates and maxDistance.");
+        }
+        Dataset *dataset = nullptr;
+        NAPI_CALL(env, napi_unwrap(env, self, reinterpret_cast<void **>(&dataset)));
+        return nearestBatch(env, dataset->index, &dataset->view, argv[0], argv[1]);
+    }
+
+    // A batch of nearestAsync, from the call to the resolution of its promise
+    struct NearestWork
+    {
+        napi_async_work work = nullptr;
+        napi_deferred deferred = nullptr;
+        // Keeps the GeocodeIndex or GeocodeDataset alive while the batch is searched
+        napi_ref owner = nullptr;
+        const SpatialIndex *index = nullptr;
+        // Answers from the grid first when it is set
+        Dataset *dataset = nullptr;
+        // Searches only the records of this country when it is not empty, dataset is then set
+        std::string country = {};
+        // Copied, JavaScript may change the Float64Array while the batch is searched
+        std::vector<double> coordinates = {};
+        double maxChord = 0;
+        std::vector<std::int32_t> ids = {};
+    };
+
+    // Runs on a thread of the threadpool, without touching JavaScript values
+    void executeNearestWork(napi_env, void *data)
+    {
+        auto *work = static_cast<NearestWork *>(data);
+        const double *coordinates = work->coordinates.data();
+        for (std::size_t i = 0; i < work->ids.size(); i++)
+        {
+            if (!work->country.empty())
+            {
+                work->ids[i] = work->dataset->nearestInCountry(coordinates[2 * i], coordinates[2 * i + 1], work->maxChord, work->country);
+                continue;
+            }
+            work->ids[i] = work->dataset != nullptr ? work->dataset->nearest(coordinates[2 * i], coordinates[2 * i + 1], work->maxChord)
+                                                    : work->index->nearest(coordinates[2 * i], coordinates[2 * i + 1], work->maxChord);
+        }
+    }
+
+    void completeNearestWork(napi_env env, napi_status status, void *data)
+    {
+        std::unique_ptr<NearestWork> work = std::unique_ptr<NearestWork>(static_cast<NearestWork *>(data));
+        napi_value results = nullptr;
+        if (status == napi_ok)
+        {
+            void *resultData = nullptr;
+            napi_value buffer = nullptr;
+            if (napi_create_arraybuffer(env, work->ids.size() * sizeof(std::int32_t), &resultData, &buffer) != napi_ok ||
+                napi_create_typedarray(env, napi_int32_array, work->ids.size(), buffer, 0, &results) != napi_ok)
+            {
+                results = nullptr;
+            }
+            else if (!work->ids.empty())
+            {
+                std::copy(work->ids.begin(), work->ids.end(), static_cast<std::int32_t *>(resultData));
+            }
+        }
+        if (results != nullptr)
+        {
+            napi_resolve_deferred(env, work->deferred, results);
+        }
+        else
+        {
+            napi_value message = nullptr;
+            napi_value error = nullptr;
+            napi_create_string_utf8(env, status == napi_cancelled ? "The batch was cancelled." : "The batch could not be searched.", NAPI_AUTO_LENGTH, &message);
+            napi_create_error(env, nullptr, message, &error);
+            napi_reject_deferred(env, work->deferred, error);
+        }
+        napi_delete_reference(env, work->owner);
+        napi_delete_async_work(env, work->work);
+    }
+
+    // Queues the search of the { latitude, longitude } pairs of coordinatesValue on the threadpool and returns its promise.
+    // country is empty, or the upper case code of the only country to search, dataset is then set.
+    napi_value nearestAsync(napi_env env, napi_value self, const SpatialIndex &index, Dataset *dataset, napi_value coordinatesValue, napi_value maxDistanceValue, const std::string_view country)
+    {
+        bool isTypedArray = false;
+        NAPI_CALL(env, napi_is_typedarray(env, coordinatesValue, &isTypedArray));
+        napi_typedarray_type type = napi_int8_array;
+        std::size_t length = 0;
+        void *data = nullptr;
+        if (isTypedArray)
+        {
+            NAPI_CALL(env, napi_get_typedarray_info(env, coordinatesValue, &type, &length, &data, nullptr, nullptr));
+        }
+        if (!isTypedArray || type != napi_float64_array || length % 2 != 0)
+        {
+            return throwTypeError(env, "The coordinates must be a Float64Array of latitude and longitude pairs.");
+        }
+        double maxDistance = 0;
+        if (napi_get_value_double(env, maxDistanceValue, &maxDistance) != napi_ok)
+        {
+            return throwTypeError(env, "maxDistance must be a number.");
+        }
+
+        auto work = std::make_unique<NearestWork>();
+        work->index = &index;
+        work->dataset = dataset;
+        work->country = country;
+        work->coordinates.assign(static_cast<const double *>(data), static_cast<const double *>(data) + length);
+        work->maxChord = chordFromDistance(maxDistance);
+        work->ids.resize(length / 2);
+        napi_value promise = nullptr;
+        napi_value name = nullptr;
+        NAPI_CALL(env, napi_create_promise(env, &work->deferred, &promise));
+        NAPI_CALL(env, napi_create_string_utf8(env, "LocalizedGeocode.nearestAsync", NAPI_AUTO_LENGTH, &name));
+        NAPI_CALL(env, napi_create_reference(env, self, 1, &work->owner));
+        if (napi_create_async_work(env, nullptr, name, executeNearestWork, completeNearestWork, work.get(), &work->work) != napi_ok)
+        {
+            napi_delete_reference(env, work->owner);
+            napi_throw_error(env, nullptr, "Could not create the batch.");
+            return nullptr;
+        }
+        if (napi_queue_async_work(env, work->work) != napi_ok)
+        {
+            napi_delete_async_work(env, work->work);
+            napi_delete_reference(env, work->owner);
+            napi_throw_error(env, nullptr, "Could not queue the batch.");
+            return nullptr;
+        }
+        // Deleted by completeNearestWork
+        work.release();
+        return promise;
+    }
+
+    napi_value indexNearestAsync(napi_env env, napi_callback_info info)
+    {
+        std::size_t argc = 2;
+        napi_value argv[2] = {};
+        napi_value self = nullptr;
+        NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, &self, nullptr));
+        if (argc != 2)
+        {
+            return throwTypeError(env, "nearestAsync requires 2 arguments: coordinates and maxDistance.");
+        }
+        Index *index = nullptr;
+        NAPI_CALL(env, napi_unwrap(env, self, reinterpret_cast<void **>(&index)));
+        return nearestAsync(env, self, index->index, nullptr, argv[0], argv[1], {});
+    }
+
+    napi_value datasetNearestAsync(napi_env env, napi_callback_info info)
+    {
+        std::size_t argc = 3;
+        napi_value argv[3] = {};
+        napi_value self = nullptr;
+        NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, &self, nullptr));
+        if (argc != 2 && argc != 3)
+        {
+            return throwTypeError(env, "nearestAsync requires 2 or 3 arguments: coordinates, maxDistance and country.");
+        }
+        char country[3] = {};
+        if (argc == 3 && !getCountryCode(env, argv[2], country))
+        {
+            return throwTypeError(env, "The country must be an ISO 3166-1 Alpha-2 code.");
+        }
+        Dataset *dataset = nullptr;
+        NAPI_CALL(env, napi_unwrap(env, self, reinterpret_cast<void **>(&dataset)));
+        return nearestAsync(env, self, dataset->index, dataset, argv[0], argv[1], std::string_view(country));
+    }
+
+    // Runs sessionNearest with the state Float64Array and the latitude, longitude and maxDistance of argv
+    napi_value sessionNearest(napi_env env, const SpatialIndex &index, NearestCellCache &cells, napi_value *argv)
+    {
+        bool isTypedArray = false;
+        NAPI_CALL(env, napi_is_typedarray(env, argv[0], &isTypedArray));
+        napi_typedarray_type type = napi_int8_array;
+        std::size_t length = 0;
+        void *data = nullptr;
+        if (isTypedArray)
+        {
+            NAPI_CALL(env, napi_get_typedarray_info(env, argv[0], &type, &length, &data, nullptr, nullptr));
+        }
+        if (!isTypedArray || type != napi_float64_array || length != SESSION_STATE_LENGTH)
+        {
+            return throwTypeError(env, "The session state must be a Float64Array of length sessionStateLength.");
+        }
+        double values[3] = {};
+        for (std::size_t i = 0; i < 3; i++)
+        {
+            if (napi_get_value_double(env, argv[i + 1], &values[i]) != napi_ok)
+            {
+                return throwTypeError(env, "sessionNearest requires numbers.");
+            }
+        }
+        // A Float64Array is 8 byte aligned, like SessionState
+        auto &state = *static_cast<SessionState *>(data);
+        const std::int32_t id = ::sessionNearest(index, cells, state, values[0], values[1], chordFromDistance(values[2]));
+        napi_value result = nullptr;
+        NAPI_CALL(env, napi_create_int32(env, id, &result));
+        return result;
+    }
+
+    napi_value indexSessionNearest(napi_env env, napi_callback_info info)
+    {
+        std::size_t argc = 4;
+        napi_value argv[4] = {};
+        napi_value self = nullptr;
+        NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, &self, nullptr));
+        if (argc != 4)
+        {
+            return throwTypeError(env, "sessionNearest requires 4 arguments: state, latitude, longitude and maxDistance.");
+        }
+        Index *index = nullptr;
+        NAPI_CALL(env, napi_unwrap(env, self, reinterpret_cast<void **>(&index)));
+        return sessionNearest(env, index->index, index->cells, argv);
+    }
+
+    napi_value datasetSessionNearest(napi_env env, napi_callback_info info)
+    {
+        std::size_t argc = 4;
+        napi_value argv[4] = {};
+        napi_value self = nullptr;
+        NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, &self, nullptr));
+        if (argc != 4)
+        {
+            return throwTypeError(env, "sessionNearest requires 4 arguments: state, latitude, longitude and maxDistance.");
+        }
+        Dataset *dataset = nullptr;
+        NAPI_CALL(env, napi_unwrap(env, self, reinterpret_cast<void **>(&dataset)));
+        return sessionNearest(env, dataset->index, dataset->cells, argv);
+    }
+
+    // Reads the strings of the array property name of object into values, returns false after throwing when it is not one
+    bool getStrings(napi_env env, napi_value object, const char *name, std::vector<std::string> &values)
+    {
+        bool hasProperty = false;
+        napi_value array = nullptr;
+        napi_valuetype type = napi_undefined;
+        if (napi_has_named_property(env, object, name, &hasProperty) != napi_ok || !hasProperty ||
+            napi_get_named_property(env, object, name, &array) != napi_ok || napi_typeof(env, array, &type) != napi_ok || type == napi_undefined)
+        {
+            return true;
+        }
+        bool isArray = false;
+        std::uint32_t length = 0;
+        if (napi_is_array(env, array, &isArray) != napi_ok || !isArray || napi_get_array_length(env, array, &length) != napi_ok)
+        {
+            throwTypeError(env, (std::string("The filter ") + name + " must be an array of strings.").c_str());
+            return false;
+        }
+        for (std::uint32_t i = 0; i < length; i++)
+        {
+            napi_value element = nullptr;
+            std::size_t size = 0;
+            if (napi_get_element(env, array, i, &element) != napi_ok || napi_get_value_string_utf8(env, element, nullptr, 0, &size) != napi_ok)
+            {
+                throwTypeError(env, (std::string("The filter ") + name + " must be an array of strings.").c_str());
+                return false;
+            }
+            std::string value = std::string(size, '\0');
+            napi_get_value_string_utf8(env, element, value.data(), size + 1, &size);
+            values.push_back(std::move(value));
+        }
+        return true;
+    }
+
+    // Converts the filter object of nearestFiltered, dataset is nullptr for a GeocodeIndex.
+    // Returns std::nullopt after throwing when the filter is not valid.
+    std::optional<PointFilter> getFilter(napi_env env, napi_value value, const Dataset *dataset)
+    {
+        PointFilter filter = {};
+        napi_valuetype type = napi_undefined;
+        if (value == nullptr || napi_typeof(env, value, &type) != napi_ok || type == napi_undefined || type == napi_null)
+        {
+            return filter;
+        }
+        if (type != napi_object)
+        {
+            throwTypeError(env, "The filter must be an object.");
+            return std::nullopt;
+        }
+        bool hasProperty = false;
+        if (napi_has_named_property(env, value, "minPopulation", &hasProperty) == napi_ok && hasProperty)
+        {
+            napi_value minPopulation = nullptr;
+            double population = 0;
+            napi_get_named_property(env, value, "minPopulation", &minPopulation);
+            if (napi_get_value_double(env, minPopulation, &population) != napi_ok || !(population >= 0))
+            {
+                throwTypeError(env, "The filter minPopulation must be a number that is not negative.");
+                return std::nullopt;
+            }
+            filter.minPopulation = static_cast<std::uint32_t>(std::min(std::ceil(population), 4294967295.0));
+        }
+        std::vector<std::string> countries = {};
+        std::vector<std::string> featureCodes = {};
+        if (!getStrings(env, value, "countries", countries) || !getStrings(env, value, "featureCodes", featureCodes))
+        {
+            return std::nullopt;
+        }
+        for (const auto &country : countries)
+        {
+            if (country.size() != 2)
+            {
+                throwTypeError(env, "The filter countries must be ISO 3166-1 Alpha-2 codes.");
+                return std::nullopt;
+            }
+            filter.countries.push_back(toCountryKey(static_cast<char>(std::toupper(static_cast<unsigned char>(country[0]))),
+                                                    static_cast<char>(std::toupper(static_cast<unsigned char>(country[1])))));
+        }
+        for (const auto &code : featureCodes)
+        {
+            // A code that no record has matches nothing
+            std::uint32_t id = DATASET_ABSENT_STRING;
+            if (dataset != nullptr)
+            {
+                if (const auto found = dataset->featureCodeIds.find(code); found != dataset->featureCodeIds.end())
+                {
+                    id = found->second;
+                }
+            }
+            filter.features.push_back(id);
+        }
+        if (!filter.isEmpty() && dataset == nullptr)
+        {
+            throwTypeError(env, "Filters require a dataset opened with Geocode.Open.");
+            return std::nullopt;
+        }
+        return filter;
+    }
+
+    // Runs SpatialIndex::nearestFiltered with the latitude, longitude, k, maxDistance and filter of argv
+    napi_value nearestFiltered(napi_env env, const SpatialIndex &index, const Dataset *dataset, const std::size_t argc, napi_value *argv)
+    {
+        if (argc < 4)
+        {
+            return throwTypeError(env, "nearestFiltered requires latitude, longitude, k, maxDistance and an optional filter.");
+        }
+        double values[4] = {};
+        for (std::size_t i = 0; i < 4; i++)
+        {
+            if (napi_get_value_double(env, argv[i], &values[i]) != napi_ok)
+            {
+                return throwTypeError(env, "nearestFiltered requires numbers.");
+            }
+        }
+        if (!(values[2] >= 1))
+        {
+            napi_throw_range_error(env, nullptr, "k must be at least 1.");
+            return nullptr;
+        }
+        const auto filter = getFilter(env, argc > 4 ? argv[4] : nullptr, dataset);
+        if (!filter.has_value())
+        {
+            return nullptr;
+        }
+        const std::size_t k = values[2] >= static_cast<double>(index.size()) ? index.size() : static_cast<std::size_t>(values[2]);
+        std::vector<SpatialIndex::Neighbour> neighbours = {};
+        index.nearestFiltered(toUnitVector(values[0], values[1]), k, chordFromDistance(values[3]), filter.value(), neighbours);
+
+        napi_value results = nullptr;
+        NAPI_CALL(env, napi_create_array_with_length(env, neighbours.size(), &results));
+        for (std::size_t i = 0; i < neighbours.size(); i++)
+        {
+            napi_value result = nullptr;
+            napi_value id = nullptr;
+            napi_value distance = nullptr;
+            NAPI_CALL(env, napi_create_object(env, &result));
+            NAPI_CALL(env, napi_create_int32(env, neighbours[i].id, &id));
+            NAPI_CALL(env, napi_create_double(env, distanceFromChord(neighbours[i].chord), &distance));
+            NAPI_CALL(env, napi_set_named_property(env, result, "index", id));
+            NAPI_CALL(env, napi_set_named_property(env, result, "distance", distance));
+            NAPI_CALL(env, napi_set_element(env, results, static_cast<std::uint32_t>(i), result));
+        }
+        return results;
+    }
+
+    napi_value indexNearestFiltered(napi_env env, napi_callback_info info)
+    {
+        std::size_t argc = 5;
+        napi_value argv[5] = {};
+        napi_value self = nullptr;
+        NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, &self, nullptr));
+        Index *index = nullptr;
+        NAPI_CALL(env, napi_unwrap(env, self, reinterpret_cast<void **>(&index)));
+        return nearestFiltered(env, index->index, nullptr, argc, argv);
+    }
+
+    napi_value datasetNearestFiltered(napi_env env, napi_callback_info info)
+    {
+        std::size_t argc = 5;
+        napi_value argv[5] = {};
+        napi_value self = nullptr;
+        NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, &self, nullptr));
+        Dataset *dataset = nullptr;
+        NAPI_CALL(env, napi_unwrap(env, self, reinterpret_cast<void **>(&dataset)));
+        return nearestFiltered(env, dataset->index, dataset, argc, argv);
+    }
+
+    napi_value datasetNearestInCountry(napi_env env, napi_callback_info info)
+    {
+        std::size_t argc = 4;
+        napi_value argv[4] = {};
+        napi_value self = nullptr;
+        NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, &self, nullptr));
+        if (argc != 4)
+        {
+            return throwTypeError(env, "nearestInCountry requires 4 arguments: latitude, longitude, maxDistance and country.");
+        }
+        double values[3] = {};
+        for (std::size_t i = 0; i < 3; i++)
+        {
+            if (napi_get_value_double(env, argv[i], &values[i]) != napi_ok)
+            {
+                return throwTypeError(env, "nearestInCountry requires numbers.");
+            }
+        }
+        char country[3] = {};
+        if (!getCountryCode(env, argv[3], country))
+        {
+            return throwTypeError(env, "The country must be an ISO 3166-1 Alpha-2 code.");
+        }
+        Dataset *dataset = nullptr;
+        NAPI_CALL(env, napi_unwrap(env, self, reinterpret_cast<void **>(&dataset)));
+
+        const std::int32_t id = dataset->nearestInCountry(values[0], values[1], chordFromDistance(values[2]), std::string_view(country, 2));
+        napi_value result = nullptr;
+        NAPI_CALL(env, napi_create_int32(env, id, &result));
+        return result;
+    }
+
+    napi_value datasetRecord(napi_env env, napi_callback_info info)
+    {
+        std::size_t argc = 1;
+        napi_value argv[1] = {};
+        napi_value self = nullptr;
+        NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, &self, nullptr));
+        double record = -1;
+        if (argc != 1 || napi_get_value_double(env, argv[0], &record) != napi_ok)
+        {
+            return throwTypeError(env, "record requires 1 argument, the index of a record.");
+        }
+        Dataset *dataset = nullptr;
+        NAPI_CALL(env, napi_unwrap(env, self, reinterpret_cast<void **>(&dataset)));
+        // Like the records of Geocode.Init, an index that is not a record is an error object rather than an exception
+        if (!(record >= 0 && record < static_cast<double>(dataset->view.recordCount()) && std::floor(record) == record))
+        {
+            napi_value message = nullptr;
+            napi_value error = nullptr;
+            NAPI_CALL(env, napi_create_string_utf8(env, "Error whilst retriving data.", NAPI_AUTO_LENGTH, &message));
+            NAPI_CALL(env, napi_create_error(env, nullptr, message, &error));
+            return error;
+        }
+        return createResult(env, dataset->view, static_cast<std::size_t>(record));
+    }
+
+    napi_value init(napi_env env, napi_value exports)
+    {
+        const napi_property_descriptor indexProperties[] = {
+            {"nearest", nullptr, nearest, nullptr, nullptr, nullptr, napi_default, nullptr},
+            {"nearestBatch", nullptr, indexNearestBatch, nullptr, nullptr, nullptr, napi_default, nullptr},
+            {"sessionNearest", nullptr, indexSessionNearest, nullptr, nullptr, nullptr, napi_default, nullptr},
+            {"nearestFiltered", nullptr, indexNearestFiltered, nullptr, nullptr, nullptr, napi_default, nullptr},
+            {"nearestAsync", nullptr, indexNearestAsync, nullptr, nullptr, nullptr, napi_default, nullptr},
+        };
+        napi_value indexConstructor = nullptr;
+        NAPI_CALL(env, napi_define_class(env, "GeocodeIndex", NAPI_AUTO_LENGTH, constructIndex, nullptr,
+                                         sizeof(indexProperties) / sizeof(indexProperties[0]), indexProperties, &indexConstructor));
+        NAPI_CALL(env, napi_set_named_property(env, exports, "GeocodeIndex", indexConstructor));
+
+        const napi_property_descriptor datasetProperties[] = {
+            {"query", nullptr, queryDataset, nullptr, nullptr, nullptr, napi_default, nullptr},
+            {"queryBatch", nullptr, datasetQueryBatch, nullptr, nullptr, nullptr, napi_default, nullptr},
+            {"record", nullptr, datasetRecord, nullptr, nullptr, nullptr, napi_default, nullptr},
+            {"sessionNearest", nullptr, datasetSessionNearest, nullptr, nullptr, nullptr, napi_default, nullptr},
+            {"nearestFiltered", nullptr, datasetNearestFiltered, nullptr, nullptr, nullptr, napi_default, nullptr},
+            {"nearestInCountry", nullptr, datasetNearestInCountry, nullptr, nullptr, nullptr, napi_default, nullptr},
+            {"nearestAsync", nullptr, datasetNearestAsync, nullptr, nullptr, nullptr, napi_default, nullptr},
+        };
+        napi_value datasetConstructor = nullptr;
+        NAPI_CALL(env, napi_define_class(env, "GeocodeDataset", NAPI_AUTO_LENGTH, constructDataset, nullptr,
+                                         sizeof(datasetProperties) / sizeof(datasetProperties[0]), datasetProperties, &datasetConstructor));
+        NAPI_CALL(env, napi_set_named_property(env, exports, "GeocodeDataset", datasetConstructor));
+
+        napi_value sessionStateLength = nullptr;
+        NAPI_CALL(env, napi_create_uint32(env, static_cast<std::uint32_t>(SESSION_STATE_LENGTH), &sessionStateLength));
+        NAPI_CALL(env, napi_set_named_property(env, exports, "sessionStateLength", sessionStateLength));
+        return exports;
+    }
+}
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
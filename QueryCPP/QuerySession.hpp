@@ -0,0 +1,183 @@
+#ifndef __HEADER_QUERYSESSION_HPP_CPP_
+#define __HEADER_QUERYSESSION_HPP_CPP_
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#include "SpatialIndex.hpp"
+
+// Answers for a stream of nearby queries, like the points of a GPS trace.
+//
+// A nearest search at a point c finds the nearest point A at chord d1 and the second nearest at chord d2.
+// Chords are straight-line distances, so the triangle inequality holds: for a query q with chord r to c,
+// A is at most d1 + r away and every other point at least d2 - r. When r < (d2 - d1) / 2 the nearest point
+// of q is still A, and when also r < maxChord - d1 it is still close enough. That radius around c is the
+// part of the Voronoi cell of A that a single search proves, and queries inside it need no search at all.
+
+// One answered search, the center and radius of the region where its answer holds
+struct ProvenNearest
+{
+    UnitVector center;
+    std::int32_t id;
+    // Tree position of the answer, see SpatialIndex::nearestPair
+    std::size_t position;
+    double chord;
+    double secondChord;
+
+    // Whether q is provably answered by id, for a query limited to maxChord
+    bool covers(const UnitVector &q, const double maxChord) const noexcept
+    {
+        const double dx = q.x - center.x;
+        const double dy = q.y - center.y;
+        const double dz = q.z - center.z;
+        const double radius = std::min((secondChord - chord) / 2, maxChord - chord);
+        return radius > 0 && dx * dx + dy * dy + dz * dz < radius * radius;
+    }
+};
+
+// The state a session keeps between queries, the layout of the Float64Array index.js passes in.
+// Every field is a double so JavaScript can read the counters.
+struct SessionState
+{
+    double hasLast;
+    double x;
+    double y;
+    double z;
+    double id;
+    double position;
+    double chord;
+    double secondChord;
+    // Queries answered by the previous answer, by the cell cache, by a search near the previous answer and by a full search
+    double sessionHits;
+    double cacheHits;
+    double localSearches;
+    double fullSearches;
+};
+constexpr std::size_t SESSION_STATE_LENGTH = sizeof(SessionState) / sizeof(double);
+
+// A least recently used cache of proven answers, keyed by the cell of a fixed latitude and longitude grid.
+// It is shared by every session of an index, so hot areas are answered without a search even for a new session.
+// An entry only answers the queries of its cell that its region covers, the others are searched as usual.
+class NearestCellCache
+{
+    static constexpr double CELL_DEGREES = 0.01;
+    static constexpr std::uint64_t LONGITUDE_CELLS = static_cast<std::uint64_t>(360 / CELL_DEGREES) + 1;
+
+    static constexpr std::size_t DEFAULT_CAPACITY = 4096;
+
+    typedef std::list<std::pair<std::uint64_t, ProvenNearest>> Entries;
+
+    std::size_t capacity = DEFAULT_CAPACITY;
+    // Most recently used first
+    Entries entries = {};
+    std::unordered_map<std::uint64_t, Entries::iterator> cells = {};
+    std::mutex mutex = {};
+
+public:
+    NearestCellCache() noexcept = default;
+    explicit NearestCellCache(const std::size_t capacity) noexcept : capacity{capacity} {}
+
+    // latitude and longitude must be finite
+    static std::uint64_t cell(const double latitude, const double longitude) noexcept
+    {
+        const auto row = static_cast<std::uint64_t>(std::floor((std::clamp(latitude, -90.0, 90.0) + 90) / CELL_DEGREES));
+        const auto column = static_cast<std::uint64_t>(std::floor((std::clamp(longitude, -180.0, 180.0) + 180) / CELL_DEGREES));
+        return row * LONGITUDE_CELLS + column;
+    }
+
+    // Returns whether the entry of cell covers q, and copies it to result when it does
+    bool find(const std::uint64_t cell, const UnitVector &q, const double maxChord, ProvenNearest &result) noexcept
+    {
+        const std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(mutex);
+        const auto found = cells.find(cell);
+        if (found == cells.end() || !found->second->second.covers(q, maxChord))
+        {
+            return false;
+        }
+        entries.splice(entries.begin(), entries, found->second);
+        result = found->second->second;
+        return true;
+    }
+
+    void insert(const std::uint64_t cell, const ProvenNearest &answer) noexcept
+    {
+        const std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(mutex);
+        if (capacity == 0)
+        {
+            return;
+        }
+        if (const auto found = cells.find(cell); found != cells.end())
+        {
+            found->second->second = answer;
+            entries.splice(entries.begin(), entries, found->second);
+            return;
+        }
+        if (entries.size() == capacity)
+        {
+            cells.erase(entries.back().first);
+            entries.pop_back();
+        }
+        entries.emplace_front(cell, answer);
+        cells.emplace(cell, entries.begin());
+    }
+};
+
+// Answers the next query of a session, the same answer as SpatialIndex::nearest.
+// A query inside the region of the previous answer is answered at once, then one in the region of the
+// cached answer of its cell. Otherwise the previous answer bounds a search that only visits the nodes around it.
+inline std::int32_t sessionNearest(const SpatialIndex &index, NearestCellCache &cache, SessionState &state, const double latitude, const double longitude, const double maxChord) noexcept
+{
+    // NaN has no cell, and no point is closer to it than maxChord
+    if (!std::isfinite(latitude) || !std::isfinite(longitude))
+    {
+        state.hasLast = 0;
+        return -1;
+    }
+    const UnitVector q = toUnitVector(latitude, longitude);
+    ProvenNearest answer = {};
+    if (state.hasLast != 0)
+    {
+        answer = {{state.x, state.y, state.z}, static_cast<std::int32_t>(state.id), static_cast<std::size_t>(state.position), state.chord, state.secondChord};
+        if (answer.covers(q, maxChord))
+        {
+            state.sessionHits++;
+            return answer.id;
+        }
+    }
+    const std::uint64_t cell = NearestCellCache::cell(latitude, longitude);
+    if (!cache.find(cell, q, maxChord, answer))
+    {
+        const bool hasHint = state.hasLast != 0 && state.position >= 0 && state.position < static_cast<double>(index.size());
+        const std::size_t hint = hasHint ? static_cast<std::size_t>(state.position) : SpatialIndex::noHint();
+        // Points past 2 * maxChord - d1 can not shrink the region below maxChord - d1, so they need not be found
+        const auto found = index.nearestPair(q, 2 * maxChord, hint);
+        (hasHint ? state.localSearches : state.fullSearches)++;
+        if (found.id < 0 || !(found.chord < maxChord))
+        {
+            state.hasLast = 0;
+            return -1;
+        }
+        answer = {q, found.id, found.position, found.chord, found.secondChord};
+        cache.insert(cell, answer);
+    }
+    else
+    {
+        state.cacheHits++;
+    }
+    state.hasLast = 1;
+    state.x = answer.center.x;
+    state.y = answer.center.y;
+    state.z = answer.center.z;
+    state.id = answer.id;
+    state.position = static_cast<double>(answer.position);
+    state.chord = answer.chord;
+    state.secondChord = answer.secondChord;
+    return answer.id;
+}
+
+#endif // !__HEADER_QUERYSESSION_HPP_CPP_
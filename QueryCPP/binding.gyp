@@ -0,0 +1,21 @@
+{
+    "targets": [
+        {
+            "target_name": "LocalizedGeocode",
+            "sources": ["GeocodeAddon.cpp"],
+            "include_dirs": ["../GeneratorCPP"],
+            "cflags_cc": ["-std=c++20", "-O3"],
+            "cflags_cc!": ["-std=gnu++17", "-fno-exceptions"],
+            "xcode_settings": {
+                "CLANG_CXX_LANGUAGE_STANDARD": "c++20",
+                "GCC_ENABLE_CPP_EXCEPTIONS": "YES"
+            },
+            "msvs_settings": {
+                "VCCLCompilerTool": {
+                    "AdditionalOptions": ["/std:c++20"],
+                    "ExceptionHandling": 1
+                }
+            }
+        }
+    ]
+}
@@ -7,6 +7,7 @@ const fs = require("node:fs");
 // Here are the configuration variables, feel free to edit them to alter file generation
 
 const generateIntermediate = true; // This should be true most of the time
+const generateJSONDirectly = true; // GeneratorCPP writes the JSON file itself, without the intermediate file
 const haveLatinized = true; // This should always be true
 // A list of ISO 639-1 codes.
 const selected_languages = ["en", "fr", "ja", "zh"];
@@ -19,20 +20,61 @@ const cities_path = path.join(input_path, "cities15000.txt");
 const immediate_file = path.join(cwd, `./intermediate/${filename}.txt`); // Change this to alter immediate file name and location
 const output_file = path.join(cwd, `./output/${filename}.json`); // Change this to alter output file name and location
 const exe_path = path.join(cwd, "./GeneratorCPP/x64/Release/GeneratorCPP.exe"); // This will have to change depending on platform
+// Several JSON files written from a single read of the input files, for example:
+// [{ filename: "en+latinized-world", languages: ["en"], countries: [] }, { filename: "only-latinized-world", languages: [], countries: [] }]
+// When it is not empty, the variables above that select a single output are ignored.
+const profiles = [];
+const profiles_file = path.join(cwd, "./intermediate/profiles.json");
+// "file" keeps the order of the cities file, "hilbert" or "morton" store nearby cities together, which makes queries faster
+const record_order = "file";
 // END of configuration
 
+const generateProfiles = () => {
+    const json = profiles.map(profile => ({
+        output: path.join(cwd, `./output/${profile.filename}.json`).replace(/\\/g, '/'),
+        format: "json",
+        languages: profile.languages.map(el => el.trim().toLowerCase()),
+        countries: profile.countries.map(el => el.trim().toUpperCase())
+    }));
+    fs.writeFileSync(profiles_file, JSON.stringify(json, null, 4));
+    const command = [
+        `"${exe_path}"`,
+        `--cities "${cities_path}"`,
+        `--input "${input_path}"`,
+        `--profiles "${profiles_file}"`,
+        `--order ${record_order}`
+    ].join(" ").replace(/\\/g, '/');
+    execSync(command, { stdio: 'inherit' });
+    console.log(`Generated ${profiles.length} JSON files from GeneratorCPP.`);
+};
+
 const start = async () => {
-    console.log("Starting generation of intermediate file.");
+    if (profiles.length !== 0) {
+        generateProfiles();
+        return;
+    }
+    if (generateJSONDirectly) {
+        console.log("Starting generation of JSON file.");
+    } else {
+        console.log("Starting generation of intermediate file.");
+    }
     const selected_languages_command = selected_languages.length !== 0 ? `--languages "${selected_languages.map(el => el.trim().toLowerCase()).join(",")}"` : "";
     const selected_countries_command = selected_countries.length !== 0 ? `--countries "${selected_countries.map(el => el.trim().toUpperCase()).join(",")}"` : "";
     const command = [
         `"${exe_path}"`,
         `--cities "${cities_path}"`,
-        `--output "${immediate_file}"`,
+        generateJSONDirectly ? `--output "${output_file}" --format json` : `--output "${immediate_file}"`,
         `--input "${input_path}"`,
         selected_languages_command,
-        selected_countries_command
+        selected_countries_command,
+        `--order ${record_order}`
     ].join(" ").replace(/\\/g, '/');
+    if (generateJSONDirectly) {
+        execSync(command, { stdio: 'inherit' });
+        console.log("Generated JSON file from GeneratorCPP.");
+        console.log("Located at: ", output_file);
+        return;
+    }
     if (generateIntermediate) {
         execSync(command, { stdio: 'inherit' });
     }
@@ -15,6 +15,14 @@ export interface Localization {
 export interface ReverseGeoCodeResult {
     countryCode: ISOCountryCode;
     timezone: IANATimezone;
+    /**
+     * Only in results of a binary dataset opened with Geocode.Open
+     */
+    population?: number;
+    /**
+     * The GeoNames feature code, like "PPLC" for a capital. Only in results of a binary dataset opened with Geocode.Open
+     */
+    featureCode?: string;
     /**
      * This is the English latinization, it may still contain accents.
      * It may not be ASCII.
@@ -30,6 +38,34 @@ export interface ReverseGeoCodeResult {
     locales: Record<ISOLanguage, Localization>;
 }
 
+/**
+ * Which records a filtered query accepts, every condition must hold.
+ * Filters require a binary dataset opened with Geocode.Open.
+ */
+export interface GeocodeFilter {
+    minPopulation?: number;
+    countries?: ISOCountryCode[];
+    /** GeoNames feature codes, like "PPLC" or "PPLA" */
+    featureCodes?: string[];
+}
+
+export interface GeocodeQueryOptions {
+    /**
+     * Only search the cities of this country. Binary datasets store the cities of each country together
+     * with their bounding box, other sources build the index of a country the first time it is asked for.
+     */
+    country?: ISOCountryCode;
+    /** The locales of the result, every available language when omitted */
+    languages?: ISOLanguage[];
+}
+
+export interface GeocodeNeighbour {
+    /** The index of the record for Geocode.record */
+    index: number;
+    /** The distance to the query in km */
+    distance: number;
+}
+
 export class Geocode {
     /**
      * Init() creates a Geocode object based on the provided localization.
@@ -37,11 +73,105 @@ export class Geocode {
      * @param maxDistance The maximum distance at which to search for the nearest city. (default: 100km)
      */
     static Init(array: any, maxDistance?: number): Geocode;
+    /**
+     * Open() creates a Geocode object from a binary dataset generated with `GeneratorCPP --format binary`.
+     * The file is memory mapped, so opening it is fast and its pages are shared between processes.
+     * Requires the native query engine, see `npm run build:native`.
+     * @param path The path of the binary dataset.
+     * @param maxDistance The maximum distance at which to search for the nearest city. (default: 100km)
+     */
+    static Open(path: string, maxDistance?: number): Geocode;
+    /**
+     * OpenPacks() creates a Geocode object from a folder generated with `GeneratorCPP --format packs`.
+     * Only the base pack is read, the name pack of a language is read the first time a result includes that language.
+     * @param folder The folder holding packs.json.
+     * @param maxDistance The maximum distance at which to search for the nearest city. (default: 100km)
+     */
+    static OpenPacks(folder: string, maxDistance?: number): Geocode;
     /**
      * Find the nearest point in the geocoding data. 
      * @param latitude The latitude of the query
      * @param longitude The longitude of the query
+     * @param options The locales of the result, or the country to search in and the locales
+     * @returns The reverse GeoCoding Result or an error object
+     */
+    query(latitude: number, longitude: number, options?: ISOLanguage[] | GeocodeQueryOptions): ReverseGeoCodeResult|Error;
+    /**
+     * Find the nearest point of many queries at once, on every core when the native query engine is built.
+     * @param coordinates The latitude and longitude of each query, one after the other
+     * @returns The index of the nearest record of each query, or -1 if there is none within the maximum search distance
+     */
+    queryBatch(coordinates: Float64Array): Int32Array;
+    /**
+     * Like query, but the search runs on the libuv threadpool instead of the event loop when the native query engine is built.
+     * The calls of one turn of the event loop are searched together in batches, one per country.
+     * The results are still created on the event loop, and with Geocode.Init so is the index of a country the first time it is asked for.
+     * @returns The same result as query, rejected with a RangeError when too many queries are pending and with a TypeError when the country is not a code
+     */
+    queryAsync(latitude: number, longitude: number, options?: ISOLanguage[] | GeocodeQueryOptions): Promise<ReverseGeoCodeResult|Error>;
+    /**
+     * Like queryBatch, but the coordinates are searched in chunks on the libuv threadpool instead of the event loop
+     * when the native query engine is built.
+     * @returns The nearest record of each query like queryBatch, though a query at the same distance of two records
+     * may get the other one. Rejected with a RangeError when too many queries are pending
+     */
+    queryManyAsync(coordinates: Float64Array): Promise<Int32Array>;
+    /** The queries of queryAsync and queryManyAsync that have not been answered yet */
+    readonly pendingQueries: number;
+    /**
+     * Find the k nearest records within the maximum search distance that the filter accepts, nearest first.
+     * The filter is evaluated while searching, so the answer is exact even near borders.
+     * @param k The number of records
+     * @param filter Which records to accept, every record when omitted
+     */
+    queryNearest(latitude: number, longitude: number, k: number, filter?: GeocodeFilter): GeocodeNeighbour[];
+    /**
+     * Find every record closer than radius that the filter accepts, nearest first.
+     * @param radius The distance in km, greater than 0
+     * @param filter Which records to accept, every record when omitted
+     */
+    queryRadius(latitude: number, longitude: number, radius: number, filter?: GeocodeFilter): GeocodeNeighbour[];
+    /**
+     * Get the data of a record found by queryBatch.
+     * @param index The index of the record
+     * @param languages The locales of the result, every available language when omitted
+     * @returns The reverse GeoCoding Result or an error object
+     */
+    record(index: number, languages?: ISOLanguage[]): ReverseGeoCodeResult|Error;
+    /**
+     * Create a session for a stream of nearby queries, like the points of a GPS trace.
+     * It remembers its last answer and the radius where that answer cannot change, so nearby queries skip the search.
+     */
+    session(): GeocodeSession;
+}
+
+export interface GeocodeSessionStats {
+    /** Queries answered by the previous answer of the session */
+    sessionHits: number;
+    /** Queries answered by the cell cache shared by the sessions of a Geocode */
+    cacheHits: number;
+    /** Queries searched starting from the previous answer */
+    localSearches: number;
+    /** Queries searched from scratch */
+    fullSearches: number;
+}
+
+export class GeocodeSession {
+    /**
+     * Find the nearest point in the geocoding data, the same result as Geocode.query.
+     * @param latitude The latitude of the query
+     * @param longitude The longitude of the query
+     * @param languages The locales of the result, every available language when omitted
      * @returns The reverse GeoCoding Result or an error object
      */
-    query(latitude: number, longitude: number): ReverseGeoCodeResult|Error;
+    query(latitude: number, longitude: number, languages?: ISOLanguage[]): ReverseGeoCodeResult|Error;
+    /**
+     * Find the nearest point without creating a result.
+     * @returns The index of the nearest record for Geocode.record, or -1 if there is none within the maximum search distance
+     */
+    nearest(latitude: number, longitude: number): number;
+    /**
+     * How the queries of the session were answered so far.
+     */
+    stats(): GeocodeSessionStats;
 }
\ No newline at end of file
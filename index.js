@@ -1,4 +1,45 @@
-const { kdTree } = require("kd-tree-javascript");
+const fs = require("node:fs");
+const path = require("node:path");
+
+// The native query engine in ./QueryCPP, built with `npm run build:native`.
+// kd-tree-javascript is used when it has not been built.
+const native = (() => {
+    try {
+        return require("./QueryCPP/build/Release/LocalizedGeocode.node");
+    } catch {
+        return null;
+    }
+})();
+const { kdTree } = native === null ? require("kd-tree-javascript") : { kdTree: null };
+
+// Queries of a GPS trace or any other stream of nearby points, created with Geocode.session().
+// A search proves that its answer holds within some distance of the query, half the gap between the nearest
+// and second nearest city, so the next query inside that radius is answered without a search.
+class GeocodeSession {
+    #nearest;
+    #record;
+    #stats;
+
+    constructor(nearest, record, stats) {
+        this.#nearest = nearest;
+        this.#record = record;
+        this.#stats = stats;
+    }
+    query(latitude, longitude, languages) {
+        const id = this.nearest(latitude, longitude);
+        if (id < 0) {
+            return new Error("Could not find city within maximum search distance.");
+        }
+        return this.#record(id, languages);
+    }
+    // The index of the nearest record for Geocode.record, or -1 if there is none within the maximum search distance
+    nearest(latitude, longitude) {
+        return this.#nearest(Number(latitude), Number(longitude));
+    }
+    stats() {
+        return this.#stats();
+    }
+}
 
 class Geocode { 
     static #isInternalConstructing = false;
@@ -54,13 +95,99 @@ class Geocode {
         };
     }
     #maxDistance;
-    #tree;
+    #tree = null;
+    #index = null;
+    #data = null;
+    #dataset = null;
+    // Kept by Geocode.Init for the per-country indexes, the coordinates for the native engine and the points otherwise
+    #coordinates = null;
+    #points = null;
+    // The index of each country Geocode.Init was asked for, { ids, index } or { ids, tree }
+    #countries = new Map();
+    // The name packs of Geocode.OpenPacks, { folder, files: { language: filename }, loaded: Map<language, names> }
+    #packs = null;
+    // Proven answers of the sessions without the native query engine, see GeocodeSession
+    #cells = new Map();
+    static #CELL_DEGREES = 0.01;
+    static #CELL_CAPACITY = 4096;
+    // queryAsync calls of the same turn of the event loop waiting to be searched as one batch
+    #queued = [];
+    // Queries of queryAsync and queryManyAsync that have not been answered yet
+    #pending = 0;
+    // Batches searched on the threadpool, and the batches waiting for one of them to finish
+    #running = 0;
+    #waiting = [];
+    static #ASYNC_BATCH_SIZE = 256;
+    static #ASYNC_CHUNK_SIZE = 16384;
+    static #ASYNC_MAX_PENDING = 65536;
+    // One batch per thread of the libuv threadpool, which also serves fs and dns
+    static #ASYNC_CONCURRENCY = Math.max(1, Number(process.env.UV_THREADPOOL_SIZE) || 4);
 
     static Init(array, maxDistance = 100) {
         Geocode.#isInternalConstructing = true;
         const instance = new Geocode(array, maxDistance);
         return instance;
     }
+    static Open(path, maxDistance = 100) {
+        if (native === null) {
+            throw new Error("Geocode.Open requires the native query engine, build it with `npm run build:native`.");
+        }
+        const dataset = new native.GeocodeDataset(path);
+        Geocode.#isInternalConstructing = true;
+        const instance = new Geocode(dataset, maxDistance);
+        return instance;
+    }
+    // Reads the base pack of a folder written by GeneratorCPP with --format packs.
+    // The name pack of a language is only read the first time a result asks for that language.
+    static OpenPacks(folder, maxDistance = 100) {
+        const manifest = JSON.parse(fs.readFileSync(path.join(folder, "packs.json"), "utf8"));
+        const base = JSON.parse(fs.readFileSync(path.join(folder, manifest.base), "utf8"));
+        const instance = Geocode.Init(base, maxDistance);
+        instance.#packs = { folder, files: manifest.languages, loaded: new Map() };
+        return instance;
+    }
+    #namePack(language) {
+        if (!Object.hasOwn(this.#packs.files, language)) {
+            return undefined;
+        }
+        let names = this.#packs.loaded.get(language);
+        if (names === undefined) {
+            names = JSON.parse(fs.readFileSync(path.join(this.#packs.folder, this.#packs.files[language]), "utf8"));
+            this.#packs.loaded.set(language, names);
+        }
+        return names;
+    }
+    // Adds the names of the packs to the result of a record, and keeps only the requested languages.
+    // Without languages, the result has every language, the same as the single file of those languages.
+    #localize(result, index, languages) {
+        if (result instanceof Error) {
+            return result;
+        }
+        if (this.#packs !== null) {
+            for (const language of languages ?? Object.keys(this.#packs.files)) {
+                const names = this.#namePack(language)?.[index];
+                if (names === undefined || names === null) {
+                    continue;
+                }
+                result.locales[language] = {
+                    cityName: Geocode.#emptyToUndefined(names[0]),
+                    admin1Name: Geocode.#emptyToUndefined(names[1]),
+                    countryName: Geocode.#emptyToUndefined(names[2])
+                };
+            }
+            return result;
+        }
+        if (languages !== undefined) {
+            const locales = {};
+            for (const language of languages) {
+                if (Object.hasOwn(result.locales, language)) {
+                    locales[language] = result.locales[language];
+                }
+            }
+            result.locales = locales;
+        }
+        return result;
+    }
     constructor(array, maxDistance = 100) {
         if (!Geocode.#isInternalConstructing) {
             throw new TypeError("Geocode is not constructable, please use Geocode.Init instead.");
@@ -69,9 +196,32 @@ class Geocode {
         if (arguments.length !== 2) {
             throw new TypeError(`Geocode requires 2 argument, but received ${arguments.length} arguments.`);
         }
+        this.#maxDistance = maxDistance;
+        if (native !== null && array instanceof native.GeocodeDataset) {
+            this.#dataset = array;
+            return;
+        }
         if (!Array.isArray(array)) {
             throw new TypeError("Geocode requires 1 argument, it must be an array.");
         }
+        if (native !== null) {
+            const coordinates = new Float64Array(array.length * 2);
+            const data = [];
+            for (const element of array) {
+                if (!Array.isArray(element)) {
+                    throw new Error("Error parsing array, all first level elements must be an array.");
+                }
+                const longitude = element.pop();
+                const latitude = element.pop();
+                coordinates[data.length * 2] = latitude;
+                coordinates[data.length * 2 + 1] = longitude;
+                data.push(element);
+            }
+            this.#data = data;
+            this.#coordinates = coordinates;
+            this.#index = new native.GeocodeIndex(coordinates);
+            return;
+        }
         const points = [];
         for (const element of array) {
             if (!Array.isArray(element)) {
@@ -82,29 +232,370 @@ class Geocode {
             const point = {
                 latitude: latitude,
                 longitude: longitude,
+                index: points.length,
                 data: element
             }
             points.push(point);
         }
-        this.#maxDistance = maxDistance;
+        this.#data = points.map(point => point.data);
+        this.#points = points;
         this.#tree = new kdTree(points, Geocode.#distance, ["latitude", "longitude"]);
     }
-    query(latitude, longitude) {
+    static #checkCountry(country) {
+        if (typeof country !== "string" || country.length !== 2) {
+            throw new TypeError("The country must be an ISO 3166-1 Alpha-2 code.");
+        }
+    }
+    // The index of the records of country that Geocode.Init builds the first time it is asked for, { ids, index } or { ids, tree }
+    #countryPartition(country) {
+        const code = country.toUpperCase();
+        let partition = this.#countries.get(code);
+        if (partition === undefined) {
+            const ids = [];
+            for (let i = 0; i < this.#data.length; i++) {
+                if (this.#data[i][0] === code) {
+                    ids.push(i);
+                }
+            }
+            if (this.#index !== null) {
+                const coordinates = new Float64Array(ids.length * 2);
+                for (let i = 0; i < ids.length; i++) {
+                    coordinates[2 * i] = this.#coordinates[2 * ids[i]];
+                    coordinates[2 * i + 1] = this.#coordinates[2 * ids[i] + 1];
+                }
+                partition = { ids, index: new native.GeocodeIndex(coordinates) };
+            } else {
+                partition = { ids, tree: new kdTree(ids.map(id => this.#points[id]), Geocode.#distance, ["latitude", "longitude"]) };
+            }
+            this.#countries.set(code, partition);
+        }
+        return partition;
+    }
+    // Searches only the records of country. Binary datasets store the records of each country together with their
+    // own index, Geocode.Init builds the index of a country the first time it is asked for.
+    #nearestInCountry(latitude, longitude, country) {
+        Geocode.#checkCountry(country);
+        const maxDistance = Number(this.#maxDistance) || 0;
+        if (this.#dataset !== null) {
+            return this.#dataset.nearestInCountry(Number(latitude), Number(longitude), maxDistance, country);
+        }
+        const partition = this.#countryPartition(country);
+        if (partition.index !== undefined) {
+            const id = partition.index.nearest(Number(latitude), Number(longitude), maxDistance);
+            return id < 0 ? -1 : partition.ids[id];
+        }
+        const nearest = partition.tree.nearest({ latitude, longitude }, 1, this.#maxDistance);
+        return nearest.length < 1 ? -1 : nearest[0][0].index;
+    }
+    // The last argument of query is a list of languages, or { country, languages }
+    query(latitude, longitude, options) {
+        const { country, languages } = Array.isArray(options) ? { languages: options } : (options ?? {});
+        if (country !== undefined) {
+            const id = this.#nearestInCountry(latitude, longitude, country);
+            if (id < 0) {
+                return new Error("Could not find city within maximum search distance.");
+            }
+            return this.record(id, languages);
+        }
+        if (this.#dataset !== null) {
+            const result = this.#dataset.query(Number(latitude), Number(longitude), Number(this.#maxDistance) || 0);
+            if (result === null) {
+                return new Error("Could not find city within maximum search distance.");
+            }
+            return this.#localize(result, -1, languages);
+        }
+        if (this.#index !== null) {
+            // Like kd-tree-javascript, a maxDistance of 0 or undefined means there is no limit
+            const id = this.#index.nearest(Number(latitude), Number(longitude), Number(this.#maxDistance) || 0);
+            if (id < 0) {
+                return new Error("Could not find city within maximum search distance.");
+            }
+            return this.#localize(Geocode.#parseData(this.#data[id]), id, languages);
+        }
         const nearest = this.#tree.nearest({ 
             latitude: latitude, longitude: longitude 
         }, 1, this.#maxDistance);
         if (nearest.length < 1) {
             return new Error("Could not find city within maximum search distance.");
         } else {
-            const data = nearest.at(0)?.[0]?.data;
-            if (data === undefined) {
+            const point = nearest.at(0)?.[0];
+            if (point?.data === undefined) {
                 return new Error("Error whilst retriving data.");
             }
-            return Geocode.#parseData(data);
+            return this.#localize(Geocode.#parseData(point.data), point.index, languages);
+        }
+    }
+    queryBatch(coordinates) {
+        if (!(coordinates instanceof Float64Array) || coordinates.length % 2 !== 0) {
+            throw new TypeError("queryBatch requires a Float64Array of latitude and longitude pairs.");
+        }
+        const maxDistance = Number(this.#maxDistance) || 0;
+        if (this.#dataset !== null) {
+            return this.#dataset.queryBatch(coordinates, maxDistance);
+        }
+        if (this.#index !== null) {
+            return this.#index.nearestBatch(coordinates, maxDistance);
+        }
+        const results = new Int32Array(coordinates.length / 2);
+        for (let i = 0; i < results.length; i++) {
+            const nearest = this.#tree.nearest({
+                latitude: coordinates[2 * i], longitude: coordinates[2 * i + 1]
+            }, 1, this.#maxDistance);
+            results[i] = nearest.length < 1 ? -1 : nearest[0][0].index;
+        }
+        return results;
+    }
+    // Starts the search of a batch, only in country when it is not undefined
+    #startSearch(coordinates, country) {
+        const maxDistance = Number(this.#maxDistance) || 0;
+        const engine = this.#dataset ?? this.#index;
+        if (country === undefined && engine !== null) {
+            return engine.nearestAsync(coordinates, maxDistance);
+        }
+        if (this.#dataset !== null) {
+            return this.#dataset.nearestAsync(coordinates, maxDistance, country);
+        }
+        if (this.#index !== null) {
+            // The index of a country is built on the event loop the first time it is asked for, then searched on the threadpool
+            const partition = this.#countryPartition(country);
+            return partition.index.nearestAsync(coordinates, maxDistance).then(ids => ids.map(id => id < 0 ? -1 : partition.ids[id]));
+        }
+        // kd-tree-javascript runs on the event loop, one batch per turn so other callbacks still run
+        return new Promise(resolveBatch => setImmediate(() => {
+            if (country === undefined) {
+                resolveBatch(this.queryBatch(coordinates));
+                return;
+            }
+            const ids = new Int32Array(coordinates.length / 2);
+            for (let i = 0; i < ids.length; i++) {
+                ids[i] = this.#nearestInCountry(coordinates[2 * i], coordinates[2 * i + 1], country);
+            }
+            resolveBatch(ids);
+        }));
+    }
+    // Searches a batch off the event loop, once fewer than #ASYNC_CONCURRENCY batches are running
+    #searchAsync(coordinates, country) {
+        return new Promise((resolve, reject) => {
+            const run = () => {
+                this.#running++;
+                let search = null;
+                try {
+                    search = this.#startSearch(coordinates, country);
+                } catch (error) {
+                    search = Promise.reject(error);
+                }
+                search.then(resolve, reject).finally(() => {
+                    this.#running--;
+                    this.#waiting.shift()?.();
+                });
+            };
+            if (this.#running < Geocode.#ASYNC_CONCURRENCY) {
+                run();
+            } else {
+                this.#waiting.push(run);
+            }
+        });
+    }
+    #reserve(count) {
+        // A call larger than the limit is still accepted when nothing else is pending
+        if (this.#pending > 0 && this.#pending + count > Geocode.#ASYNC_MAX_PENDING) {
+            return false;
+        }
+        this.#pending += count;
+        return true;
+    }
+    #flushQueued() {
+        // The queries of each country, and those without one, are searched as separate batches
+        const batches = new Map();
+        for (const query of this.#queued) {
+            const key = query.country?.toUpperCase();
+            if (!batches.has(key)) {
+                batches.set(key, []);
+            }
+            batches.get(key).push(query);
+        }
+        this.#queued = [];
+        for (const [country, queued] of batches) {
+            const coordinates = new Float64Array(queued.length * 2);
+            for (let i = 0; i < queued.length; i++) {
+                coordinates[2 * i] = queued[i].latitude;
+                coordinates[2 * i + 1] = queued[i].longitude;
+            }
+            this.#searchAsync(coordinates, country).then(ids => {
+                this.#pending -= queued.length;
+                for (let i = 0; i < queued.length; i++) {
+                    // Like query, record throws when languages is not a list or a name pack can not be read
+                    try {
+                        queued[i].resolve(ids[i] < 0
+                            ? new Error("Could not find city within maximum search distance.")
+                            : this.record(ids[i], queued[i].languages));
+                    } catch (error) {
+                        queued[i].reject(error);
+                    }
+                }
+            }, error => {
+                this.#pending -= queued.length;
+                for (const query of queued) {
+                    query.reject(error);
+                }
+            });
+        }
+    }
+    // Like query, but the search runs on the threadpool. The calls of one turn of the event loop are searched together
+    // in batches of #ASYNC_BATCH_SIZE, one per country, and the promise is rejected when #ASYNC_MAX_PENDING queries
+    // are already pending or when the country is not a code.
+    queryAsync(latitude, longitude, options) {
+        const { country, languages } = Array.isArray(options) ? { languages: options } : (options ?? {});
+        if (country !== undefined) {
+            try {
+                Geocode.#checkCountry(country);
+            } catch (error) {
+                return Promise.reject(error);
+            }
+        }
+        if (!this.#reserve(1)) {
+            return Promise.reject(new RangeError("Too many pending queries, wait for some of them to finish."));
+        }
+        return new Promise((resolve, reject) => {
+            this.#queued.push({ latitude: Number(latitude), longitude: Number(longitude), country, languages, resolve, reject });
+            if (this.#queued.length === 1) {
+                queueMicrotask(() => {
+                    if (this.#queued.length > 0) {
+                        this.#flushQueued();
+                    }
+                });
+            } else if (this.#queued.length >= Geocode.#ASYNC_BATCH_SIZE) {
+                this.#flushQueued();
+            }
+        });
+    }
+    // Like queryBatch, but the coordinates are searched on the threadpool in chunks of #ASYNC_CHUNK_SIZE queries
+    async queryManyAsync(coordinates) {
+        if (!(coordinates instanceof Float64Array) || coordinates.length % 2 !== 0) {
+            throw new TypeError("queryManyAsync requires a Float64Array of latitude and longitude pairs.");
+        }
+        const count = coordinates.length / 2;
+        if (!this.#reserve(count)) {
+            throw new RangeError("Too many pending queries, wait for some of them to finish.");
+        }
+        try {
+            const chunks = [];
+            for (let first = 0; first < count; first += Geocode.#ASYNC_CHUNK_SIZE) {
+                const last = Math.min(count, first + Geocode.#ASYNC_CHUNK_SIZE);
+                chunks.push(this.#searchAsync(coordinates.slice(2 * first, 2 * last)));
+            }
+            const results = new Int32Array(count);
+            let offset = 0;
+            for (const ids of await Promise.all(chunks)) {
+                results.set(ids, offset);
+                offset += ids.length;
+            }
+            return results;
+        } finally {
+            this.#pending -= count;
+        }
+    }
+    // The queries of queryAsync and queryManyAsync that have not been answered yet
+    get pendingQueries() {
+        return this.#pending;
+    }
+    #nearestFiltered(latitude, longitude, k, maxDistance, filter) {
+        const engine = this.#dataset ?? this.#index;
+        if (engine !== null) {
+            return engine.nearestFiltered(Number(latitude), Number(longitude), k, maxDistance, filter);
+        }
+        if (filter !== undefined && filter !== null) {
+            throw new TypeError("Filters require a dataset opened with Geocode.Open.");
+        }
+        const nearest = this.#tree.nearest({ latitude, longitude }, Math.min(k, this.#data.length), maxDistance);
+        return nearest.sort((a, b) => a[1] - b[1]).map(([point, distance]) => ({ index: point.index, distance }));
+    }
+    queryNearest(latitude, longitude, k, filter) {
+        if (!(k >= 1)) {
+            throw new RangeError("queryNearest requires k to be at least 1.");
+        }
+        return this.#nearestFiltered(latitude, longitude, k, Number(this.#maxDistance) || 0, filter);
+    }
+    queryRadius(latitude, longitude, radius, filter) {
+        // A maxDistance of 0 means there is no limit, a radius of 0 would return every record
+        if (!(radius > 0)) {
+            throw new RangeError("queryRadius requires a radius greater than 0.");
+        }
+        return this.#nearestFiltered(latitude, longitude, Infinity, Number(radius), filter);
+    }
+    session() {
+        const maxDistance = Number(this.#maxDistance) || 0;
+        const engine = this.#dataset ?? this.#index;
+        if (engine !== null) {
+            const state = new Float64Array(native.sessionStateLength);
+            return new GeocodeSession(
+                (latitude, longitude) => engine.sessionNearest(state, latitude, longitude, maxDistance),
+                (id, languages) => this.record(id, languages),
+                () => ({ sessionHits: state[8], cacheHits: state[9], localSearches: state[10], fullSearches: state[11] }));
+        }
+        // Same proof as QueryCPP/QuerySession.hpp, with haversine distances in km
+        const limit = maxDistance > 0 ? maxDistance : Infinity;
+        const stats = { sessionHits: 0, cacheHits: 0, localSearches: 0, fullSearches: 0 };
+        const covers = (answer, point) =>
+            Geocode.#distance(answer, point) < Math.min((answer.secondDistance - answer.distance) / 2, limit - answer.distance);
+        let last = null;
+        const nearest = (latitude, longitude) => {
+            if (!Number.isFinite(latitude) || !Number.isFinite(longitude)) {
+                last = null;
+                return -1;
+            }
+            const point = { latitude, longitude };
+            if (last !== null && covers(last, point)) {
+                stats.sessionHits++;
+                return last.index;
+            }
+            const cell = Math.floor((latitude + 90) / Geocode.#CELL_DEGREES) * 36001 + Math.floor((longitude + 180) / Geocode.#CELL_DEGREES);
+            const cached = this.#cells.get(cell);
+            if (cached !== undefined && covers(cached, point)) {
+                // Moving the entry to the end of the Map keeps it in least recently used order
+                this.#cells.delete(cell);
+                this.#cells.set(cell, cached);
+                stats.cacheHits++;
+                last = cached;
+                return cached.index;
+            }
+            stats.fullSearches++;
+            const found = this.#tree.nearest(point, 2, this.#maxDistance).sort((a, b) => a[1] - b[1]);
+            if (found.length < 1) {
+                last = null;
+                return -1;
+            }
+            last = {
+                latitude, longitude,
+                index: found[0][0].index,
+                distance: found[0][1],
+                // There is no other city closer than the limit
+                secondDistance: found.length > 1 ? found[1][1] : limit
+            };
+            this.#cells.delete(cell);
+            this.#cells.set(cell, last);
+            if (this.#cells.size > Geocode.#CELL_CAPACITY) {
+                this.#cells.delete(this.#cells.keys().next().value);
+            }
+            return last.index;
+        };
+        return new GeocodeSession(nearest, (id, languages) => this.record(id, languages), () => ({ ...stats }));
+    }
+    record(index, languages) {
+        if (!Number.isInteger(index) || index < 0) {
+            return new Error("Error whilst retriving data.");
+        }
+        if (this.#dataset !== null) {
+            return this.#localize(this.#dataset.record(index), index, languages);
+        }
+        const data = this.#data[index];
+        if (data === undefined) {
+            return new Error("Error whilst retriving data.");
         }
+        return this.#localize(Geocode.#parseData(data), index, languages);
     }
-    
 }
 module.exports = {
-    Geocode
+    Geocode,
+    GeocodeSession
 }
\ No newline at end of file